@@ -147,6 +147,11 @@ typedef struct
   
   uint32_t InnerVlanCtrl;          /*!< Specifies Inner VLAN Tag insertion control only when Inner VLAN is enabled. 
                                         This parameter can be a value of @ref ETH_Tx_Packet_Inner_VLAN_Control   */
+
+  uint32_t OneStepTsSec;           /*!< Reference timestamp seconds only when one-step timestamp correction is enabled,
+                                        the egress time minus the reference is added to the correctionField */
+
+  uint32_t OneStepTsNsec;          /*!< Reference timestamp nanoseconds only when one-step timestamp correction is enabled */
   
 }ETH_TxPacketConfig;
 /** 
@@ -171,6 +176,10 @@ typedef struct
   
   uint32_t ItMode;                      /*<! If 1, DMA will generate the Rx complete interrupt.
                                              If 0, DMA will not generate the Rx complete interrupt. */ 
+
+  uint32_t FirstReleasedDesc;           /*<! First descriptor released by the application but not rebuilt yet. */
+
+  uint32_t ReleasedDescNbr;             /*<! Number of descriptors released by the application but not rebuilt yet. */
 }ETH_RxDescListTypeDef;
 /** 
   * 
@@ -915,6 +924,7 @@ typedef struct{
 #define ETH_TX_PACKETS_FEATURES_INNERVLANTAG  ((uint32_t)0x00000008U)
 #define ETH_TX_PACKETS_FEATURES_TSO           ((uint32_t)0x00000010U)
 #define ETH_TX_PACKETS_FEATURES_CRCPAD        ((uint32_t)0x00000020U)
+#define ETH_TX_PACKETS_FEATURES_OSTC          ((uint32_t)0x00000040U)
 /**
   * @}
   */
@@ -1604,6 +1614,8 @@ HAL_StatusTypeDef HAL_ETH_GetRxDataBuffer(ETH_HandleTypeDef *heth, ETH_BufferTyp
 HAL_StatusTypeDef HAL_ETH_GetRxDataLength(ETH_HandleTypeDef *heth, uint32_t *Length);
 HAL_StatusTypeDef HAL_ETH_GetRxDataInfo(ETH_HandleTypeDef *heth, ETH_RxPacketInfo *RxPacketInfo);
 HAL_StatusTypeDef HAL_ETH_BuildRxDescriptors(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef HAL_ETH_ReleaseRxDescriptors(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef HAL_ETH_RebuildReleasedRxDescriptors(ETH_HandleTypeDef *heth);
 
 HAL_StatusTypeDef HAL_ETH_Transmit(ETH_HandleTypeDef *heth, ETH_TxPacketConfig *pTxConfig, uint32_t Timeout);
 HAL_StatusTypeDef HAL_ETH_Transmit_IT(ETH_HandleTypeDef *heth, ETH_TxPacketConfig *pTxConfig);
@@ -1619,6 +1631,7 @@ void              HAL_ETH_MACErrorCallback(ETH_HandleTypeDef *heth);
 void              HAL_ETH_PMTCallback(ETH_HandleTypeDef *heth);
 void              HAL_ETH_EEECallback(ETH_HandleTypeDef *heth);
 void              HAL_ETH_WakeUpCallback(ETH_HandleTypeDef *heth);
+void              HAL_ETH_PTPTimestampCallback(ETH_HandleTypeDef *heth, uint32_t tsStatus);
 /**
   * @}
   */
@@ -1642,6 +1655,7 @@ HAL_StatusTypeDef HAL_ETH_GetMACFilterConfig(ETH_HandleTypeDef *heth, ETH_MACFil
 HAL_StatusTypeDef HAL_ETH_SetMACFilterConfig(ETH_HandleTypeDef *heth, ETH_MACFilterConfigTypeDef *pFilterConfig);
 HAL_StatusTypeDef HAL_ETH_SetHashTable(ETH_HandleTypeDef *heth, uint32_t *pHashTable);
 HAL_StatusTypeDef HAL_ETH_SetSourceMACAddrMatch(ETH_HandleTypeDef *heth, uint32_t AddrNbr, uint8_t *pMACAddr);
+HAL_StatusTypeDef HAL_ETH_SetDestMACAddrMatch(ETH_HandleTypeDef *heth, uint32_t AddrNbr, const uint8_t *pMACAddr);
 
 /* MAC Power Down APIs    *****************************************************/
 void              HAL_ETH_EnterPowerDownMode(ETH_HandleTypeDef *heth, ETH_PowerDownConfigTypeDef *pPowerDownConfig);
@@ -1698,17 +1712,37 @@ typedef enum {
     ETH_PTP_PPS_16384Hz
 } ETH_PPS_FreqEnum;
 
-void ETH_EnablePTPTimeStamping(ETH_HandleTypeDef *heth); // Enable PTP timestamping (currently every frame received gets timestamped)
+// Receive timestamp filters. Only the selected frames get a timestamp context
+// descriptor, others occupy a single descriptor and are delivered with a zero timestamp.
+typedef enum {
+    ETH_PTP_RX_TS_ALL, // every received frame
+    ETH_PTP_RX_TS_PTP, // PTP messages except Announce, Management and Signaling
+    ETH_PTP_RX_TS_EVENT_E2E, // event messages of the end-to-end delay mechanism (Sync, Delay_Req)
+    ETH_PTP_RX_TS_EVENT_P2P // event messages of the peer-to-peer delay mechanism (Sync, Pdelay_Req, Pdelay_Resp)
+} ETH_PTPRxTsFilter;
+
+#define ETH_PTP_RX_TS_UDP_IPV4 (1 << 0) // PTP over UDP/IPv4
+#define ETH_PTP_RX_TS_L2 (1 << 1) // PTP over IEEE 802.3 (Ethernet)
+
+void ETH_SetPTPRxTimestampFilter(ETH_HandleTypeDef *heth, ETH_PTPRxTsFilter filter, uint32_t transports); // Select received frames to timestamp (transports: ETH_PTP_RX_TS_UDP_IPV4 | ETH_PTP_RX_TS_L2, also needed by the one-step timestamp correction on transmit)
+void ETH_GetPTPRxTimestampFilter(ETH_HandleTypeDef *heth, ETH_PTPRxTsFilter *pFilter, uint32_t *pTransports); // Get receive timestamp filter
+void ETH_EnablePTPTimeStamping(ETH_HandleTypeDef *heth); // Enable PTP timestamping (received frames are timestamped according to the filter, default: PTP messages but Announce, Management and Signaling over UDP/IPv4 and 802.3)
 void ETH_DisablePTPTimeStamping(ETH_HandleTypeDef *heth); // Disable PTP timestamping
 void ETH_InitPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec); // Initialize PTP clock time
-void ETH_GetPTPTime(ETH_HandleTypeDef *heth, uint32_t * sec, uint32_t * nsec); // Get PTP-time
+void ETH_GetPTPTime(ETH_HandleTypeDef *heth, uint32_t * sec, uint32_t * nsec); // Get PTP-time (consistent across second rollovers)
 void ETH_EnablePTPFineCorr(ETH_HandleTypeDef *heth, bool enFineCorr); // Enable fine correction method
-void ETH_UpdatePTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec, bool add_substract); // Update PTP time forward or backward by a given value
-void ETH_SetPTPAddend(ETH_HandleTypeDef *heth, uint32_t addend); // Set PTP addend
-uint32_t ETH_GetPTPAddend(ETH_HandleTypeDef *heth); // Get PTP addend
+void ETH_UpdatePTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec, bool add_substract); // Update PTP time forward or backward by a given value (same as ETH_StepPTPTime())
+void ETH_StepPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec, bool add_substract); // Step PTP time forward or backward, never waits, callable from interrupt context
+void ETH_SetPTPAddend(ETH_HandleTypeDef *heth, uint32_t addend); // Set PTP addend, never waits, callable from interrupt context
+uint32_t ETH_GetPTPAddend(ETH_HandleTypeDef *heth); // Get PTP addend (cached)
+bool ETH_IsPTPClockUpdatePending(ETH_HandleTypeDef *heth); // Check if an addend update or a time step is waiting for the PTP block
+uint32_t ETH_GetPTPStepCount(ETH_HandleTypeDef *heth); // Get the number of time steps handed over to the PTP block (detects steps cheaply)
+void ETH_PTPClockTick(); // Complete pending addend updates and time steps, call periodically (e.g. from the tick interrupt)
 void ETH_SetPTPPPSFreq(ETH_HandleTypeDef *heth, uint32_t freqCode); // Set PPS output frequency
 void ETH_StartPTPPPSPulseTrain(ETH_HandleTypeDef *heth, uint32_t high_len, uint32_t period); // Start PPS pulse train
 void ETH_StopPTPPPSPulseTrain(ETH_HandleTypeDef *heth); // Stop PPS pulse train
+bool ETH_SetPTPTargetTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec); // Program target time, returns false if the target time registers are busy (a pulse train start uses them as well)
+void ETH_EnablePTPTargetTimeInterrupt(ETH_HandleTypeDef *heth, bool en); // Enable/disable interrupt on reaching the target time
 void ETH_SetPTPSubsecondIncrement(ETH_HandleTypeDef *heth, uint8_t increment); // Set PTP clock subsecond increment. Time quantum is 0.467 ns.
 uint32_t ETH_GetPTPSubsecondIncrement(ETH_HandleTypeDef *heth); // Get PTP clock subsecond increment
 
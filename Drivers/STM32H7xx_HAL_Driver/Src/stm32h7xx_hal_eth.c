@@ -1050,9 +1050,12 @@ uint8_t HAL_ETH_IsRxDataAvailable(ETH_HandleTypeDef *heth) {
 		return 0;
 	}
 
-	/* Check if descriptor is not owned by DMA */
+	/* Check if descriptor is not owned by DMA (released descriptors
+	 waiting for rebuild are not owned either, they must be skipped) */
 	while ((READ_BIT(dmarxdesc->DESC3, ETH_DMARXNDESCWBF_OWN)
-			== (uint32_t) RESET) && (descscancnt < (uint32_t) ETH_RX_DESC_CNT)) {
+			== (uint32_t) RESET)
+			&& (descscancnt
+					< ((uint32_t) ETH_RX_DESC_CNT - dmarxdesclist->ReleasedDescNbr))) {
 		descscancnt++;
 
 		/* Check if last descriptor */
@@ -1065,6 +1068,11 @@ uint8_t HAL_ETH_IsRxDataAvailable(ETH_HandleTypeDef *heth) {
 				WRITE_REG(firstappdescidx, descidx);
 			}
 
+			/* A timestamp is delivered in a context descriptor following the last descriptor,
+			 frames not matching the timestamp filter come without one */
+			uint32_t tsavail = (READ_BIT(dmarxdesc->DESC3, ETH_DMARXNDESCWBF_RS1V) != (uint32_t) RESET)
+					&& (READ_BIT(dmarxdesc->DESC1, ETH_DMARXNDESCWBF_TSA) != (uint32_t) RESET);
+
 			/* Increment current rx descriptor index */
 			INCR_RX_DESC_INDEX(descidx, 1U);
 
@@ -1081,6 +1089,9 @@ uint8_t HAL_ETH_IsRxDataAvailable(ETH_HandleTypeDef *heth) {
 					/* Increment current rx descriptor index */
 					INCR_RX_DESC_INDEX(descidx, 1U);
 				}
+			} else if (tsavail) {
+				/* Context descriptor is not written back yet, the Packet is fetched on the next call */
+				return 0;
 			}
 			/* Fill information to Rx descriptors list */
 			dmarxdesclist->CurRxDesc = descidx;
@@ -1237,7 +1248,14 @@ HAL_StatusTypeDef HAL_ETH_GetRxDataBuffer(ETH_HandleTypeDef *heth,
 		if (dmarxctxdesc->DESC3 & ETH_DMARXNDESCWBF_CTXT) {
 			RxBuffer->ts_sec = dmarxctxdesc->DESC1;
 			RxBuffer->ts_nsec = dmarxctxdesc->DESC0;
+		} else {
+			RxBuffer->ts_sec = 0;
+			RxBuffer->ts_nsec = 0;
 		}
+	} else {
+		/* Packet has not been timestamped */
+		RxBuffer->ts_sec = 0;
+		RxBuffer->ts_nsec = 0;
 	}
 
 	/* data is in only one buffer */
@@ -1426,13 +1444,107 @@ HAL_StatusTypeDef HAL_ETH_BuildRxDescriptors(ETH_HandleTypeDef *heth) {
 	return HAL_OK;
 }
 
+/**
+ * @brief  This function releases the Rx descriptors of the last received Packet
+ *         without giving them back to the DMA. Released descriptors are
+ *         collected and rebuilt in one pass by HAL_ETH_RebuildReleasedRxDescriptors(),
+ *         which makes it possible to process a batch of Packets with a single
+ *         tail pointer update.
+ * @note   Buffers may be reassigned to released descriptors by HAL_ETH_DescAssignMemory()
+ *         before they are rebuilt.
+ * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
+ *         the configuration information for ETHERNET module
+ * @retval HAL status.
+ */
+HAL_StatusTypeDef HAL_ETH_ReleaseRxDescriptors(ETH_HandleTypeDef *heth) {
+	ETH_RxDescListTypeDef *dmarxdesclist = &heth->RxDescList;
+	uint32_t totalappdescnbr = dmarxdesclist->AppDescNbr;
+
+	if (dmarxdesclist->AppDescNbr == 0U) {
+		/* No Rx descriptors to release */
+		return HAL_ERROR;
+	}
+
+	if (dmarxdesclist->AppContextDesc != 0U) {
+		/* A context descriptor is available */
+		totalappdescnbr += 1U;
+	}
+
+	/* Packets are processed in order, released descriptors form a contiguous range */
+	if (dmarxdesclist->ReleasedDescNbr == 0U) {
+		WRITE_REG(dmarxdesclist->FirstReleasedDesc,
+				dmarxdesclist->FirstAppDesc);
+	}
+	dmarxdesclist->ReleasedDescNbr += totalappdescnbr;
+
+	/* reset the Application desc number */
+	WRITE_REG(dmarxdesclist->AppDescNbr, 0);
+
+	/*  reset the application context descriptor */
+	WRITE_REG(heth->RxDescList.AppContextDesc, 0);
+
+	return HAL_OK;
+}
+
+/**
+ * @brief  This function gives back all Rx descriptors released by
+ *         HAL_ETH_ReleaseRxDescriptors() to the DMA and updates the
+ *         tail pointer once.
+ * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
+ *         the configuration information for ETHERNET module
+ * @retval HAL status.
+ */
+HAL_StatusTypeDef HAL_ETH_RebuildReleasedRxDescriptors(ETH_HandleTypeDef *heth) {
+	ETH_RxDescListTypeDef *dmarxdesclist = &heth->RxDescList;
+	uint32_t descindex = dmarxdesclist->FirstReleasedDesc;
+	__IO ETH_DMADescTypeDef *dmarxdesc =
+			(ETH_DMADescTypeDef*) dmarxdesclist->RxDesc[descindex];
+	uint32_t descscan;
+
+	if (dmarxdesclist->ReleasedDescNbr == 0U) {
+		/* No Rx descriptors to build */
+		return HAL_ERROR;
+	}
+
+	for (descscan = 0; descscan < dmarxdesclist->ReleasedDescNbr; descscan++) {
+		WRITE_REG(dmarxdesc->DESC0, dmarxdesc->BackupAddr0);
+		WRITE_REG(dmarxdesc->DESC3, ETH_DMARXNDESCRF_BUF1V);
+
+		if (READ_REG(dmarxdesc->BackupAddr1) != 0U) {
+			WRITE_REG(dmarxdesc->DESC2, dmarxdesc->BackupAddr1);
+			SET_BIT(dmarxdesc->DESC3, ETH_DMARXNDESCRF_BUF2V);
+		}
+
+		SET_BIT(dmarxdesc->DESC3, ETH_DMARXNDESCRF_OWN);
+
+		if (dmarxdesclist->ItMode != 0U) {
+			SET_BIT(dmarxdesc->DESC3, ETH_DMARXNDESCRF_IOC);
+		}
+
+		if (descscan < (dmarxdesclist->ReleasedDescNbr - 1U)) {
+			/* Increment rx descriptor index */
+			INCR_RX_DESC_INDEX(descindex, 1U);
+			/* Get descriptor address */
+			dmarxdesc = (ETH_DMADescTypeDef*) dmarxdesclist->RxDesc[descindex];
+		}
+	}
+
+	/* Set the Tail pointer address to the last rebuilt rx descriptor */
+	WRITE_REG(heth->Instance->DMACRDTPR, (uint32_t )dmarxdesc);
+
+	/* reset the released desc number */
+	WRITE_REG(dmarxdesclist->ReleasedDescNbr, 0);
+
+	return HAL_OK;
+}
+
 /**
  * @brief  This function handles ETH interrupt request.
  * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
  *         the configuration information for ETHERNET module
  * @retval HAL status
  */
-void HAL_ETH_IRQHandler(ETH_HandleTypeDef *heth) {
+__ITCM_FUNC void HAL_ETH_IRQHandler(ETH_HandleTypeDef *heth) {
 	/* Packet received */
 	if (__HAL_ETH_DMA_GET_IT(heth, ETH_DMACSR_RI)) {
 		if (__HAL_ETH_DMA_GET_IT_SOURCE(heth, ETH_DMACIER_RIE)) {
@@ -1555,6 +1667,15 @@ void HAL_ETH_IRQHandler(ETH_HandleTypeDef *heth) {
 		heth->MACLPIEvent = (uint32_t) (0x0U);
 	}
 
+	/* ETH PTP timestamp IT (target time reached, auxiliary snapshot) */
+	if (__HAL_ETH_MAC_GET_IT(heth, ETH_MACISR_TSIS) && (heth->Instance->MACIER & ETH_MACIER_TSIE)) {
+		/* Get timestamp status, reading clears the pending bits */
+		uint32_t tsStatus = READ_REG(heth->Instance->MACTSSR);
+
+		/* Ethernet PTP timestamp callback */
+		HAL_ETH_PTPTimestampCallback(heth, tsStatus);
+	}
+
 #if defined(DUAL_CORE)
   if (HAL_GetCurrentCPUID() == CM7_CPUID)
   {
@@ -1689,6 +1810,22 @@ __weak void HAL_ETH_EEECallback(ETH_HandleTypeDef *heth) {
 	 */
 }
 
+/**
+ * @brief  ETH PTP timestamp IT callback (target time reached, auxiliary snapshot)
+ * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
+ *         the configuration information for ETHERNET module
+ * @param  tsStatus: content of the timestamp status register (MACTSSR)
+ * @retval None
+ */
+__weak void HAL_ETH_PTPTimestampCallback(ETH_HandleTypeDef *heth, uint32_t tsStatus) {
+	/* Prevent unused argument(s) compilation warning */
+	UNUSED(heth);
+	UNUSED(tsStatus);
+	/* NOTE : This function Should not be modified, when the callback is needed,
+	 the HAL_ETH_PTPTimestampCallback could be implemented in the user file
+	 */
+}
+
 /**
  * @brief  ETH WAKEUP interrupt callback
  * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
@@ -2206,6 +2343,53 @@ HAL_StatusTypeDef HAL_ETH_SetSourceMACAddrMatch(ETH_HandleTypeDef *heth,
 	return HAL_OK;
 }
 
+/**
+ * @brief  Set a destination MAC Address to be matched by the perfect filter
+ *         (e.g. a multicast address the MAC should accept).
+ * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
+ *         the configuration information for ETHERNET module
+ * @param  AddrNbr: The MAC address to configure
+ *          This parameter must be a value of the following:
+ *            ETH_MAC_ADDRESS1
+ *            ETH_MAC_ADDRESS2
+ *            ETH_MAC_ADDRESS3
+ * @param  pMACAddr: Pointer to MAC address buffer data (6 bytes),
+ *         NULL disables the address
+ * @retval HAL status
+ */
+HAL_StatusTypeDef HAL_ETH_SetDestMACAddrMatch(ETH_HandleTypeDef *heth,
+		uint32_t AddrNbr, const uint8_t *pMACAddr) {
+	uint32_t macaddrhr, macaddrlr;
+
+	if ((AddrNbr == ETH_MAC_ADDRESS0) || (AddrNbr > ETH_MAC_ADDRESS3)) {
+		return HAL_ERROR;
+	}
+
+	/* Get mac addr high reg offset */
+	macaddrhr = ((uint32_t) &(heth->Instance->MACA0HR) + AddrNbr);
+	/* Get mac addr low reg offset */
+	macaddrlr = ((uint32_t) &(heth->Instance->MACA0LR) + AddrNbr);
+
+	if (pMACAddr == NULL) {
+		/* Disable address */
+		(*(__IO uint32_t*) macaddrhr) = 0;
+		return HAL_OK;
+	}
+
+	/* Set MAC addr bits 32 to 47 */
+	(*(__IO uint32_t*) macaddrhr) = (((uint32_t) (pMACAddr[5]) << 8)
+			| (uint32_t) pMACAddr[4]);
+	/* Set MAC addr bits 0 to 31 */
+	(*(__IO uint32_t*) macaddrlr) = (((uint32_t) (pMACAddr[3]) << 24)
+			| ((uint32_t) (pMACAddr[2]) << 16) | ((uint32_t) (pMACAddr[1]) << 8)
+			| (uint32_t) pMACAddr[0]);
+
+	/* Enable address as destination address (SA bit cleared) */
+	(*(__IO uint32_t*) macaddrhr) |= ETH_MACAHR_AE;
+
+	return HAL_OK;
+}
+
 /**
  * @brief  Set the ETH Hash Table Value.
  * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
@@ -2707,6 +2891,8 @@ static void ETH_DMARxDescListInit(ETH_HandleTypeDef *heth) {
 	WRITE_REG(heth->RxDescList.AppDescNbr, 0);
 	WRITE_REG(heth->RxDescList.ItMode, 0);
 	WRITE_REG(heth->RxDescList.AppContextDesc, 0);
+	WRITE_REG(heth->RxDescList.FirstReleasedDesc, 0);
+	WRITE_REG(heth->RxDescList.ReleasedDescNbr, 0);
 
 	/* Set Receive Descriptor Ring Length */
 	WRITE_REG(heth->Instance->DMACRDRLR, ((uint32_t)(ETH_RX_DESC_CNT - 1)));
@@ -2750,6 +2936,16 @@ static uint32_t ETH_Prepare_Tx_Descriptors(ETH_HandleTypeDef *heth,
 	/***************************************************************************/
 	/*****************    Context descriptor configuration (Optional) **********/
 	/***************************************************************************/
+	/* If one-step timestamp correction is enabled for this packet */
+	if (READ_BIT(pTxConfig->Attributes, ETH_TX_PACKETS_FEATURES_OSTC) != 0U) {
+		/* Set reference timestamp */
+		WRITE_REG(dmatxdesc->DESC0, pTxConfig->OneStepTsNsec);
+		WRITE_REG(dmatxdesc->DESC1, pTxConfig->OneStepTsSec);
+		WRITE_REG(dmatxdesc->DESC2, 0x0U);
+		/* Enable correction, the timestamp fields are valid */
+		WRITE_REG(dmatxdesc->DESC3, ETH_DMATXCDESC_OSTC | ETH_DMATXCDESC_TCMSSV);
+	}
+
 	/* If VLAN tag is enabled for this packet */
 	if (READ_BIT(pTxConfig->Attributes, ETH_TX_PACKETS_FEATURES_VLANTAG)
 			!= 0U) {
@@ -2792,6 +2988,8 @@ static uint32_t ETH_Prepare_Tx_Descriptors(ETH_HandleTypeDef *heth,
 
 	if ((READ_BIT(pTxConfig->Attributes, ETH_TX_PACKETS_FEATURES_VLANTAG) != 0U)
 			|| (READ_BIT(pTxConfig->Attributes, ETH_TX_PACKETS_FEATURES_TSO)
+					!= 0U)
+			|| (READ_BIT(pTxConfig->Attributes, ETH_TX_PACKETS_FEATURES_OSTC)
 					!= 0U)) {
 		/* Set as context descriptor */
 		SET_BIT(dmatxdesc->DESC3, ETH_DMATXCDESC_CTXT);
@@ -3025,11 +3223,67 @@ static void ETH_InitCallbacksToDefault(ETH_HandleTypeDef *heth)
 #define ETH_PTP_FLAG_TSSSR ((uint32_t)(1 << 9)) // subsecond rollover control (1 = rollover on 10^9-1 nsec)
 #define ETH_PTP_FLAG_TSE ((uint32_t)(1 << 0)) // global timestamp enable flag
 
+// receive timestamp filter, applied by ETH_EnablePTPTimeStamping() as well,
+// the default serves both delay mechanisms (the event filters drop the other one's messages)
+static ETH_PTPRxTsFilter sRxTsFilter = ETH_PTP_RX_TS_PTP;
+static uint32_t sRxTsTransports = ETH_PTP_RX_TS_UDP_IPV4 | ETH_PTP_RX_TS_L2;
+
+#define ETH_PTP_RX_TS_FILTER_MASK (ETH_MACTSCR_TSENALL | ETH_MACTSCR_TSVER2ENA | ETH_MACTSCR_TSIPENA | ETH_MACTSCR_TSIPV4ENA | ETH_MACTSCR_TSIPV6ENA \
+		| ETH_MACTSCR_TSEVNTENA | ETH_MACTSCR_TSMSTRENA | ETH_MACTSCR_SNAPTYPSEL)
+
+// get filter bits of the timestamp control register
+static uint32_t ETH_PTPRxTsFilterBits(ETH_PTPRxTsFilter filter, uint32_t transports) {
+	uint32_t bits = ETH_MACTSCR_TSVER2ENA; // PTPv2 messages
+
+	switch (filter) {
+	case ETH_PTP_RX_TS_ALL:
+		bits |= ETH_MACTSCR_TSENALL;
+		break;
+	case ETH_PTP_RX_TS_PTP: // all but Announce, Management and Signaling
+		bits |= (0b01 << ETH_MACTSCR_SNAPTYPSEL_Pos);
+		break;
+	case ETH_PTP_RX_TS_EVENT_E2E: // Sync, Delay_Req
+		bits |= (0b10 << ETH_MACTSCR_SNAPTYPSEL_Pos);
+		break;
+	case ETH_PTP_RX_TS_EVENT_P2P: // Sync, Pdelay_Req, Pdelay_Resp
+		bits |= (0b01 << ETH_MACTSCR_SNAPTYPSEL_Pos) | ETH_MACTSCR_TSEVNTENA;
+		break;
+	}
+
+	// PTP messages are recognized on these transports (timestamping and one-step correction)
+	if (transports & ETH_PTP_RX_TS_UDP_IPV4) {
+		bits |= ETH_MACTSCR_TSIPV4ENA;
+	}
+	if (transports & ETH_PTP_RX_TS_L2) {
+		bits |= ETH_MACTSCR_TSIPENA;
+	}
+
+	return bits;
+}
+
+void ETH_SetPTPRxTimestampFilter(ETH_HandleTypeDef *heth, ETH_PTPRxTsFilter filter, uint32_t transports) {
+	sRxTsFilter = filter;
+	sRxTsTransports = transports;
+
+	__IO uint32_t tmpreg = (heth->Instance)->MACTSCR;
+
+	tmpreg &= ~ETH_PTP_RX_TS_FILTER_MASK;
+	tmpreg |= ETH_PTPRxTsFilterBits(filter, transports);
+
+	(heth->Instance)->MACTSCR = tmpreg;
+}
+
+void ETH_GetPTPRxTimestampFilter(ETH_HandleTypeDef *heth, ETH_PTPRxTsFilter *pFilter, uint32_t *pTransports) {
+	*pFilter = sRxTsFilter;
+	*pTransports = sRxTsTransports;
+}
+
 void ETH_EnablePTPTimeStamping(ETH_HandleTypeDef *heth) {
 	__IO uint32_t tmpreg = (heth->Instance)->MACTSCR;
 
-	tmpreg |= ETH_MACTSCR_TSENALL | ETH_MACTSCR_TSCTRLSSR | ETH_MACTSCR_TSENA; // turn on relevant flags
-	tmpreg &= ~ETH_MACTSCR_TSIPV4ENA; // turn on relevant flags
+	tmpreg &= ~ETH_PTP_RX_TS_FILTER_MASK;
+	tmpreg |= ETH_PTPRxTsFilterBits(sRxTsFilter, sRxTsTransports); // select frames to timestamp
+	tmpreg |= ETH_MACTSCR_TSCTRLSSR | ETH_MACTSCR_TSENA; // turn on relevant flags
 
 	(heth->Instance)->MACTSCR = tmpreg;
 }
@@ -3062,9 +3316,18 @@ void ETH_InitPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec) {
 	(heth->Instance)->MACTSCR = tmpreg;
 }
 
-void ETH_GetPTPTime(ETH_HandleTypeDef *heth, uint32_t * sec, uint32_t * nsec) {
-    (*sec) = (heth->Instance)->MACSTSR;
-    (*nsec) = (heth->Instance)->MACSTNR & ETH_MACSTNR_TSSS;
+__ITCM_FUNC void ETH_GetPTPTime(ETH_HandleTypeDef *heth, uint32_t * sec, uint32_t * nsec) {
+    // the seconds are read again to detect a rollover between the two registers
+    uint32_t s1 = (heth->Instance)->MACSTSR;
+    uint32_t ns = (heth->Instance)->MACSTNR & ETH_MACSTNR_TSSS;
+    uint32_t s2 = (heth->Instance)->MACSTSR;
+
+    if (s1 != s2) { // rollover occurred, the nanoseconds belong to either second
+        ns = (heth->Instance)->MACSTNR & ETH_MACSTNR_TSSS;
+    }
+
+    (*sec) = s2;
+    (*nsec) = ns;
 }
 
 
@@ -3085,8 +3348,39 @@ void ETH_EnablePTPFineCorr(ETH_HandleTypeDef *heth, bool enFineCorr) {
 
 #define ETH_PTP_FLAG_TSSTU ((uint32_t)(1 << 3)) // flag initiating time update
 
-void ETH_UpdatePTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec,
-		bool add_substract) { // true = add
+// Clock control: time steps and addend updates never wait for the PTP block.
+// If the previous update has not been taken over yet, the new one is stored
+// and completed by the next clock control call or by ETH_PTPClockTick(). A new
+// addend replaces the stored one, a new time step is added to the stored one.
+static struct {
+	ETH_HandleTypeDef *heth; // handle of the controlled interface
+	uint32_t addend; // current addend (cached, the register is not read back)
+	bool addendValid; // the cached addend is valid
+	bool addendPending; // addend update is waiting for TSADDREG to clear
+	int64_t stepNs; // time step waiting for TSUPDT and TSINIT to clear, steps requested meanwhile are added up [ns]
+	bool stepPending; // time step is pending
+	volatile uint32_t stepCnt; // number of time steps handed over to the PTP block
+} sPTPClk;
+
+// enter critical section, clock control is callable from interrupt context
+static inline uint32_t ETH_PTPClockLock() {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	return primask;
+}
+
+// leave critical section
+static inline void ETH_PTPClockUnlock(uint32_t primask) {
+	__set_PRIMASK(primask);
+}
+
+// fill the time update registers with a relative time step
+static void ETH_PTPWriteStep(ETH_HandleTypeDef *heth, int64_t stepNs) {
+	bool add_substract = stepNs >= 0;
+	uint64_t magnitude = add_substract ? stepNs : -stepNs;
+	uint32_t sec = magnitude / 1000000000;
+	uint32_t nsec = magnitude % 1000000000;
+
 	if (add_substract) {
 		nsec &= ~((uint32_t) (1 << 31));
 	} else {
@@ -3094,46 +3388,89 @@ void ETH_UpdatePTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec,
 		nsec |= (1 << 31);
 	}
 
-	// fill registers with time components
 	(heth->Instance)->MACSTSUR = sec;
 	(heth->Instance)->MACSTNUR = nsec;
+}
 
-	// wait for TSUPDT and TSINIT to clear
-	while ((heth->Instance)->MACTSCR & (ETH_MACTSCR_TSUPDT | ETH_MACTSCR_TSINIT)) {
-		__NOP();
+// hand over pending updates to the PTP block if it is ready to take them (call in critical section)
+static void ETH_PTPClockComplete(ETH_HandleTypeDef *heth) {
+	uint32_t tscr = (heth->Instance)->MACTSCR;
+
+	if (sPTPClk.addendPending && !(tscr & ETH_MACTSCR_TSADDREG)) {
+		(heth->Instance)->MACTSAR = sPTPClk.addend; // set addend
+		tscr |= ETH_MACTSCR_TSADDREG; // update PTP block internal register
+		(heth->Instance)->MACTSCR = tscr;
+		sPTPClk.addendPending = false;
 	}
 
-	// perform time update
-	__IO uint32_t tmpreg = (heth->Instance)->MACTSCR;
+	if (sPTPClk.stepPending && !(tscr & (ETH_MACTSCR_TSUPDT | ETH_MACTSCR_TSINIT))) {
+		ETH_PTPWriteStep(heth, sPTPClk.stepNs);
+		tscr |= ETH_MACTSCR_TSUPDT; // perform time update
+		(heth->Instance)->MACTSCR = tscr;
+		sPTPClk.stepPending = false;
+		sPTPClk.stepCnt++;
+	}
+}
+
+void ETH_StepPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec,
+		bool add_substract) { // true = add
+	int64_t stepNs = ((int64_t) sec * 1000000000) + nsec;
+	if (!add_substract) {
+		stepNs = -stepNs;
+	}
 
-	tmpreg |= ETH_MACTSCR_TSUPDT;
+	uint32_t primask = ETH_PTPClockLock();
+	sPTPClk.heth = heth;
+	if (!sPTPClk.stepPending) {
+		sPTPClk.stepNs = 0;
+	}
+	sPTPClk.stepNs += stepNs; // steps are relative, a pending one is combined with the new one
+	sPTPClk.stepPending = true;
+	ETH_PTPClockComplete(heth);
+	ETH_PTPClockUnlock(primask);
+}
 
-	(heth->Instance)->MACTSCR = tmpreg;
+void ETH_UpdatePTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec,
+		bool add_substract) { // true = add
+	ETH_StepPTPTime(heth, sec, nsec, add_substract);
 }
 
 #define ETH_PTP_FLAG_TSARU ((uint32_t)(1 << 5)) // flag initiating addend register update
 
 void ETH_SetPTPAddend(ETH_HandleTypeDef *heth, uint32_t addend) {
-	size_t i = 0;
-	for (i = 0; i < 8; i++) {
-		(heth->Instance)->MACTSAR = addend; // set addend
+	uint32_t primask = ETH_PTPClockLock();
+	sPTPClk.heth = heth;
+	sPTPClk.addend = addend; // a pending value is overridden, the latest one wins
+	sPTPClk.addendValid = true;
+	sPTPClk.addendPending = true;
+	ETH_PTPClockComplete(heth);
+	ETH_PTPClockUnlock(primask);
+}
 
-		// wait for TSADDREG to clear
-		while ((heth->Instance)->MACTSCR & (ETH_MACTSCR_TSADDREG)) {
-			__NOP();
-		}
+uint32_t ETH_GetPTPAddend(ETH_HandleTypeDef *heth) {
+	if (!sPTPClk.addendValid) { // nothing written since reset
+		sPTPClk.addend = (heth->Instance)->MACTSAR;
+		sPTPClk.addendValid = true;
+	}
+	return sPTPClk.addend;
+}
 
-		// update PTP block internal register
-		__IO uint32_t tmpreg = (heth->Instance)->MACTSCR;
+bool ETH_IsPTPClockUpdatePending(ETH_HandleTypeDef *heth) {
+	return sPTPClk.addendPending || sPTPClk.stepPending;
+}
 
-		tmpreg |= ETH_MACTSCR_TSADDREG;
+uint32_t ETH_GetPTPStepCount(ETH_HandleTypeDef *heth) {
+	return sPTPClk.stepCnt;
+}
 
-		(heth->Instance)->MACTSCR = tmpreg;
+void ETH_PTPClockTick() {
+	if (!(sPTPClk.addendPending || sPTPClk.stepPending)) {
+		return;
 	}
-}
 
-uint32_t ETH_GetPTPAddend(ETH_HandleTypeDef *heth) {
-    return (heth->Instance)->MACTSAR;
+	uint32_t primask = ETH_PTPClockLock();
+	ETH_PTPClockComplete(sPTPClk.heth);
+	ETH_PTPClockUnlock(primask);
 }
 
 void ETH_SetPTPSubsecondIncrement(ETH_HandleTypeDef *heth, uint8_t increment) {
@@ -3145,12 +3482,19 @@ uint32_t ETH_GetPTPSubsecondIncrement(ETH_HandleTypeDef *heth) {
 }
 
 #define ETH_PTP_PPS_NO_INTERRUPT (0b11 << 5)
+#define ETH_PTP_PPS_INTERRUPT_ONLY (0b00 << 5)
 #define ETH_PTP_PPS_OUTPUT_MODE_SELECT (1 << 4)
 
 void ETH_SetPTPPPSFreq(ETH_HandleTypeDef *heth, uint32_t freqCode) {
 	__IO uint32_t tmpreg = (heth->Instance)->MACPPSCR;
 
-	tmpreg = ETH_PTP_PPS_NO_INTERRUPT | (freqCode & 0x0F);
+	// the fixed frequency output does not use the target time,
+	// keep target time interrupts working if they are enabled
+	if ((heth->Instance)->MACIER & ETH_MACIER_TSIE) {
+		tmpreg = ETH_PTP_PPS_INTERRUPT_ONLY | (freqCode & 0x0F);
+	} else {
+		tmpreg = ETH_PTP_PPS_NO_INTERRUPT | (freqCode & 0x0F);
+	}
 
 	(heth->Instance)->MACPPSCR = tmpreg;
 }
@@ -3195,6 +3539,34 @@ void ETH_StopPTPPPSPulseTrain(ETH_HandleTypeDef *heth) {
     (heth->Instance)->MACPPSCR |= ETH_PTP_PPS_PULSE_TRAIN_STOP_IMM;
 }
 
+#define ETH_PTP_TARGET_TIME_BUSY_TIMEOUT (1000) // maximal number of polls of the target time busy flag
+
+__ITCM_FUNC bool ETH_SetPTPTargetTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec) {
+	// target time registers must not be written while the previous value is being taken over
+	uint32_t polls = 0;
+	while ((heth->Instance)->MACPPSTTNR & ETH_MACPPSTTNR_TRGTBUSY0) {
+		if (++polls >= ETH_PTP_TARGET_TIME_BUSY_TIMEOUT) {
+			return false;
+		}
+	}
+
+	(heth->Instance)->MACPPSTTSR = sec;
+	(heth->Instance)->MACPPSTTNR = nsec & ETH_MACPPSTTNR_TTSL0;
+
+	return true;
+}
+
+void ETH_EnablePTPTargetTimeInterrupt(ETH_HandleTypeDef *heth, bool en) {
+	if (en) {
+		// target time generates the interrupt only, PPS output is not affected
+		MODIFY_REG((heth->Instance)->MACPPSCR, ETH_MACPPSCR_TRGTMODSEL0, ETH_PTP_PPS_INTERRUPT_ONLY);
+		(void) (heth->Instance)->MACTSSR; // clear stale status flags
+		__HAL_ETH_MAC_ENABLE_IT(heth, ETH_MACIER_TSIE);
+	} else {
+		__HAL_ETH_MAC_DISABLE_IT(heth, ETH_MACIER_TSIE);
+	}
+}
+
 void ETH_AuxTimestampCh(ETH_HandleTypeDef *heth, uint8_t ch, bool en) {
 	__IO uint32_t tmpreg = (heth->Instance)->MACACR;
 
@@ -24,10 +24,53 @@
 #include "lwip/err.h"
 #include "lwip/netif.h"
 #include "cmsis_os.h"
+#include "ptp_classifier.h"
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Destination MAC addresses of PTP over IEEE 802.3 */
+#define ETHIF_PTP_L2_DEFAULT_ADDR      { 0x01, 0x1B, 0x19, 0x00, 0x00, 0x00 } /* all messages except peer delay */
+#define ETHIF_PTP_L2_PEER_DELAY_ADDR   { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x0E } /* peer delay messages */
 
 /* Exported types ------------------------------------------------------------*/
 /* Structure that include link thread parameters */
+/* Interface drop counters, used for sizing the descriptor rings and the Rx buffers */
+typedef struct
+{
+  uint32_t rxNoBuffer;          /* Rx frames dropped because no spare Rx buffer was available */
+  uint32_t rxDescUnavailable;   /* Rx DMA ran out of descriptors (RBU events) */
+  uint32_t rxFifoOverflow;      /* Rx frames lost to MTL Rx FIFO overflow */
+  uint32_t rxMissed;            /* Rx frames missed by the MTL */
+  uint32_t rxStackBusy;         /* Rx frames dropped because the tcpip thread's mailbox was full */
+  uint32_t txRingFull;          /* Tx frames dropped because the Tx ring stayed full */
+  uint32_t rxFreeBuff;          /* current number of spare Rx buffers */
+  uint32_t rxFreeBuffMin;       /* lowest number of spare Rx buffers seen */
+  uint32_t rxFrames;            /* Rx frames passed up */
+  uint32_t rxTimestamped;       /* Rx frames carrying a hardware timestamp (see the timestamp filter) */
+  uint32_t txOneStepSync;       /* Syncs sent as one-step ones */
+  uint32_t txFollowUpSuppressed; /* Follow_Ups of one-step Syncs not sent */
+} EthIfStats;
+
+/* Early Rx hook for PTP frames, called from the interface thread, must not block.
+   Returns true if the frame has been consumed (the hook takes over the pbuf). */
+typedef bool (*EthIfPtpRxHook)(struct pbuf * p, const PtpFrameInfo * pInfo);
+
+/* Frame tap, called for every received frame (interface thread) and for every frame
+   queued for transmission (caller of low_level_output()), must not block.
+   Returns a nonzero record handle if a transmitted frame has been captured, the
+   handle is passed to the Tx done callback along with the transmit timestamp. */
+typedef uint32_t (*EthIfTapFrameCb)(struct pbuf * p, bool tx, uint32_t sec, uint32_t nsec);
+/* Tx done callback of the frame tap, called from the interface thread */
+typedef void (*EthIfTapTxDoneCb)(uint32_t hRec, bool tsValid, uint32_t sec, uint32_t nsec);
+
 /* Exported functions ------------------------------------------------------- */
 err_t ethernetif_init(struct netif *netif);      
 void ethernet_link_thread( void const * argument );
+void ethernetif_get_stats(EthIfStats * pStats);
+void ethernetif_set_ptp_rx_hook(EthIfPtpRxHook hook);
+err_t ethernetif_l2_output(struct pbuf * p, const uint8_t * pDstAddr);
+void ethernetif_set_ptp_l2_filters(bool enable);
+void ethernetif_set_tap(EthIfTapFrameCb frameCb, EthIfTapTxDoneCb txDoneCb);
+void ethernetif_set_ptp_one_step(bool enable);
+bool ethernetif_get_ptp_one_step(void);
 #endif
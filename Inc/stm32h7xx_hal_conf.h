@@ -159,8 +159,18 @@
 #define  USE_SD_TRANSCEIVER           1U               /*!< use uSD Transceiver */
    
 /* ########################### Ethernet Configuration ######################### */
-#define ETH_TX_DESC_CNT         4  /* number of Ethernet Tx DMA descriptors */
-#define ETH_RX_DESC_CNT         4  /* number of Ethernet Rx DMA descriptors */
+/* Ring depths and Rx buffer count can be overridden from the build flags (-D...).
+   Rx buffers not attached to a descriptor are lent to lwIP as zero-copy pbufs,
+   so ETH_RX_BUFFER_CNT - ETH_RX_DESC_CNT frames can be held by the stack at once. */
+#ifndef ETH_TX_DESC_CNT
+#define ETH_TX_DESC_CNT         8  /* number of Ethernet Tx DMA descriptors */
+#endif
+#ifndef ETH_RX_DESC_CNT
+#define ETH_RX_DESC_CNT         12 /* number of Ethernet Rx DMA descriptors */
+#endif
+#ifndef ETH_RX_BUFFER_CNT
+#define ETH_RX_BUFFER_CNT       (ETH_RX_DESC_CNT + 12) /* number of Ethernet Rx buffers */
+#endif
    
 #define UNIQUE_DEV_ID_BASE ((const uint8_t *)0x1FF1E800)
 
@@ -179,6 +189,19 @@
 //#define ETH_MAC_ADDR5    ((uint8_t)0x00)
 
 
+/* ######################## Critical path placement ######################### */
+/* Define USE_ITCM_CRITICAL_PATH (e.g. from the build flags) to run the Ethernet
+   interrupt path and the PTP clock readout from ITCM and to serve the vector
+   table from RAM: these do not stall while flash bank 1 is programmed or erased.
+   The persistent storage lives on bank 2, this is only needed if bank 1 gets
+   written by something else. */
+#ifdef USE_ITCM_CRITICAL_PATH
+#define __ITCM_FUNC   __attribute__((section(".itcm_text"), noinline))
+#else
+#define __ITCM_FUNC
+#endif
+
+
 /* ########################## Assert Selection ############################## */
 /**
   * @brief Uncomment the line below to expanse the "assert_param" macro in the 
@@ -6,16 +6,43 @@
 
 #include <stm32h7xx_hal.h>
 #include <sys/stat.h>
+#include <stdbool.h>
+
+#include <FreeRTOS.h>
+#include <task.h>
 
 typedef int(*StreamOutputFunction)(char*,int);
+typedef int(*StreamInputFunction)(char*,int);
 
 void RetargetInit(UART_HandleTypeDef *huart);
 void RetargetSetOutput(StreamOutputFunction sof);
 StreamOutputFunction RetargetGetOutput();
 void RetargetSetFallbackOutput(StreamOutputFunction sof);
+void RetargetSetInput(StreamInputFunction sif); // read stdin through this function instead of polling the UART
+
+// Per-task redirection: the output of a redirected task goes to its own output
+// function, the output of every other task is left untouched. Writes to an
+// output function used by this task alone are not locked against the rest of
+// the output, so it may wait (e.g. for a slow peer) without holding it up.
+#define RETARGET_REDIRECT_CNT (4) // number of tasks that can be redirected at the same time
+
+bool RetargetRedirectTask(TaskHandle_t th, StreamOutputFunction sof, bool shared); // redirect the output of a task (NULL: remove), shared: sof is used by other tasks as well, returns false if the table is full
 
 UART_HandleTypeDef* getPrintfUART();
 
+// Output stream: pieces written between opening and closing the stream are
+// passed on to the active output function without copying and without being
+// interleaved with other output, "\n" is translated to "\r\n" on the fly.
+typedef struct {
+	StreamOutputFunction sof; // output function the stream is bound to
+	char prev; // last character written (a "\r\n" may span two writes)
+	bool locked; // the shared output is held by the stream
+} RetargetStream;
+
+void RetargetStreamOpen(RetargetStream *pStream); // lock the output (unless the task has an output function of its own) and bind the stream to the active output function
+int RetargetStreamWrite(RetargetStream *pStream, const char *ptr, int len); // write a piece of text
+void RetargetStreamClose(RetargetStream *pStream); // release the output
+
 int _isatty(int fd);
 int _write(int fd, char* ptr, int len);
 int _close(int fd);
@@ -27,6 +27,14 @@ static UART_HandleTypeDef *gHuart;
 static SemaphoreHandle_t sTxSem;
 
 static StreamOutputFunction sOutputFunc = NULL, sFallbackOutputFunc = NULL;
+static StreamInputFunction sInputFunc = NULL;
+
+// tasks with their own output function
+static struct {
+	TaskHandle_t th; // redirected task (NULL: unused entry)
+	StreamOutputFunction sof; // output function of the task
+	bool shared; // the output function is used by other tasks as well
+} sRedirects[RETARGET_REDIRECT_CNT];
 
 void RetargetInit(UART_HandleTypeDef *huart) {
 	gHuart = huart;
@@ -78,6 +86,51 @@ void RetargetSetFallbackOutput(StreamOutputFunction sof) {
 	RETARGET_TX_MTX_UNLOCK();
 }
 
+void RetargetSetInput(StreamInputFunction sif) {
+	sInputFunc = sif;
+}
+
+bool RetargetRedirectTask(TaskHandle_t th, StreamOutputFunction sof, bool shared) {
+	bool ok = (sof == NULL);
+
+	RETARGET_TX_MTX_LOCK();
+
+	for (uint32_t i = 0; i < RETARGET_REDIRECT_CNT; i++) {
+		if (sRedirects[i].th == th) {
+			sRedirects[i].th = NULL; // replaced or removed
+		}
+	}
+
+	for (uint32_t i = 0; (i < RETARGET_REDIRECT_CNT) && !ok; i++) {
+		if (sRedirects[i].th == NULL) {
+			sRedirects[i].sof = sof;
+			sRedirects[i].shared = shared;
+			sRedirects[i].th = th;
+			ok = true;
+		}
+	}
+
+	RETARGET_TX_MTX_UNLOCK();
+
+	return ok;
+}
+
+// get the output function of the calling context and whether it has to be locked (call with the lock held)
+static StreamOutputFunction retarget_resolve_output(bool *pShared) {
+	if (__get_IPSR() == 0) {
+		TaskHandle_t th = xTaskGetCurrentTaskHandle();
+		for (uint32_t i = 0; i < RETARGET_REDIRECT_CNT; i++) {
+			if ((sRedirects[i].th != NULL) && (sRedirects[i].th == th)) {
+				*pShared = sRedirects[i].shared;
+				return sRedirects[i].sof;
+			}
+		}
+	}
+
+	*pShared = true;
+	return (sOutputFunc != NULL) ? sOutputFunc : sFallbackOutputFunc;
+}
+
 UART_HandleTypeDef* getPrintfUART() {
 	return gHuart;
 }
@@ -90,43 +143,70 @@ int _isatty(int fd) {
 	return 0;
 }
 
-#define RETARGET_PRINTF_WRITE_BUF_SIZE (4095)
-static char sWriteBuf[RETARGET_PRINTF_WRITE_BUF_SIZE + 1];
+// pass a piece of text to the output function
+static inline void retarget_stream_emit(RetargetStream *pStream, const char *ptr, int len) {
+	if ((len > 0) && (pStream->sof != NULL)) {
+		pStream->sof((char*) ptr, len);
+	}
+}
 
-int _write(int fd, char *ptr, int len) {
+void RetargetStreamOpen(RetargetStream *pStream) {
 	RETARGET_TX_MTX_LOCK();
 
-	int retval = 0;
+	bool shared;
+	pStream->sof = retarget_resolve_output(&shared);
+	pStream->prev = '\0';
+	pStream->locked = shared;
 
-	if (fd == STDOUT_FILENO || fd == STDERR_FILENO) {
-		// replace "\n" with "\r\n"
-		size_t i_src = 0, i_dst = 0;
-		char c, c_prev = '\0';
-		while (i_src < len) {
-			c = ptr[i_src++];
-
-			if ((c == '\n') && (c_prev != '\r')) {
-				sWriteBuf[i_dst++] = '\r';
-				sWriteBuf[i_dst++] = '\n';
-			} else {
-				sWriteBuf[i_dst++] = c;
-			}
+	// an output function of the task's own is not locked, it may wait without holding up the others
+	if (!shared) {
+		RETARGET_TX_MTX_UNLOCK();
+	}
+}
 
-			c_prev = ptr[i_src];
+int RetargetStreamWrite(RetargetStream *pStream, const char *ptr, int len) {
+	// replace "\n" with "\r\n": the text is passed on in place, in pieces between the inserted characters
+	const char *end = ptr + len;
+	const char *seg = ptr; // start of the pending piece
+	const char *iter = ptr;
+	const char *nl;
+	while ((nl = memchr(iter, '\n', end - iter)) != NULL) {
+		char prev = (nl > ptr) ? nl[-1] : pStream->prev;
+		if (prev != '\r') {
+			retarget_stream_emit(pStream, seg, nl - seg);
+			retarget_stream_emit(pStream, "\r\n", 2);
+			seg = nl + 1;
 		}
+		iter = nl + 1;
+	}
+	retarget_stream_emit(pStream, seg, end - seg);
 
-		if (sOutputFunc != NULL) {
-			retval = sOutputFunc(sWriteBuf, i_dst);
-		} else {
-			retval = sFallbackOutputFunc(sWriteBuf, i_dst);
-		}
+	if (len > 0) {
+		pStream->prev = end[-1];
+	}
 
-	} else {
+	return len;
+}
+
+void RetargetStreamClose(RetargetStream *pStream) {
+	pStream->sof = NULL;
+
+	if (pStream->locked) {
+		pStream->locked = false;
+		RETARGET_TX_MTX_UNLOCK();
+	}
+}
+
+int _write(int fd, char *ptr, int len) {
+	if (fd != STDOUT_FILENO && fd != STDERR_FILENO) {
 		errno = EBADF;
-		retval = -1;
+		return -1;
 	}
 
-	RETARGET_TX_MTX_UNLOCK();
+	RetargetStream stream;
+	RetargetStreamOpen(&stream);
+	int retval = RetargetStreamWrite(&stream, ptr, len);
+	RetargetStreamClose(&stream);
 
 	return retval;
 }
@@ -152,6 +232,10 @@ int _read(int fd, char *ptr, int len) {
 	HAL_StatusTypeDef hstatus;
 
 	if (fd == STDIN_FILENO) {
+		if (sInputFunc != NULL) {
+			return sInputFunc(ptr, len);
+		}
+
 		hstatus = HAL_UART_Receive(gHuart, (uint8_t*) ptr, 1, HAL_MAX_DELAY);
 
 		if (hstatus == HAL_OK) {
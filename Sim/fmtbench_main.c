@@ -0,0 +1,37 @@
+/*
+ * fmtbench_main.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+// Host-side run of the formatting benchmark (fmt_bench.c): embfmt against
+// the C library's snprintf.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fmt_bench.h"
+
+#define DEFAULT_ROUNDS (1000000)
+
+// monotonic time in nanoseconds (wraps around, only differences are used)
+static uint32_t host_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t) (ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void host_print(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+int main(int argc, char **argv) {
+    uint32_t rounds = (argc > 1) ? strtoul(argv[1], NULL, 0) : DEFAULT_ROUNDS;
+    fmt_bench_run(host_time_ns, "ns", rounds, host_print);
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * ptp_classifier_test.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+// Test of the PTP frame classifier (ptp_classifier.c) on built frames: PTP
+// over UDP/IPv4 on both ports and over IEEE 802.3, with and without a VLAN
+// tag, IPv4 options, fragments, foreign traffic and malformed frames. Every
+// frame is also classified at all of its truncated lengths, from a buffer of
+// exactly that size, so out-of-bounds reads fail the test (it is built with
+// AddressSanitizer).
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ptp_classifier.c"
+
+#define MAX_FRAME_LEN (1518)
+#define PTP_MSG_LEN (44) // length of a Sync message
+
+// frame under construction
+typedef struct {
+    uint8_t data[MAX_FRAME_LEN];
+    uint32_t len;
+} Frame;
+
+// parameters of a built frame
+typedef struct {
+    bool vlan; // insert a VLAN tag
+    bool l2; // PTP over IEEE 802.3 instead of UDP/IPv4
+    uint16_t etherType; // EtherType of non-PTP frames (0: IPv4)
+    uint8_t ihl; // IPv4 header length [32-bit words] (0: 5)
+    uint8_t version; // IP version (0: 4)
+    uint8_t proto; // IPv4 protocol (0: UDP)
+    uint16_t fragment; // flags and fragment offset field
+    uint16_t dstPort; // UDP destination port
+    int16_t udpLenAdj; // adjustment of the UDP length field
+    uint16_t msgLen; // length of the PTP message
+    uint16_t msgLenField; // messageLength field of the PTP header (0: msgLen)
+    uint16_t padding; // bytes appended after the message
+} FrameParams;
+
+static uint32_t sFailed = 0, sChecked = 0;
+
+static void put_be16(uint8_t *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+// build a frame according to the parameters
+static void build_frame(Frame *pF, const FrameParams *pP) {
+    uint8_t *p = pF->data;
+    memset(pF, 0, sizeof(Frame));
+
+    // destination and source address
+    static const uint8_t addrs[12] = { 0x01, 0x00, 0x5E, 0x00, 0x01, 0x81, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    memcpy(p, addrs, sizeof(addrs));
+    p += sizeof(addrs);
+
+    if (pP->vlan) {
+        put_be16(p, PTP_CLS_ETHERTYPE_VLAN);
+        put_be16(p + 2, 0x2005); // PCP 1, VID 5
+        p += 4;
+    }
+
+    uint16_t etherType = pP->l2 ? PTP_CLS_ETHERTYPE_PTP : (pP->etherType ? pP->etherType : PTP_CLS_ETHERTYPE_IPV4);
+    put_be16(p, etherType);
+    p += 2;
+
+    if (!pP->l2) {
+        uint32_t ihl = pP->ihl ? pP->ihl : 5;
+        uint32_t ipLen = ihl * 4 + 8 + pP->msgLen;
+        p[0] = ((pP->version ? pP->version : 4) << 4) | ihl;
+        put_be16(p + 2, ipLen);
+        put_be16(p + 6, pP->fragment);
+        p[8] = 1; // TTL
+        p[9] = pP->proto ? pP->proto : 17;
+        if (ihl > 5) {
+            memset(p + 20, 0x01, ihl * 4 - 20); // NOP options
+        }
+        p += ihl * 4;
+
+        put_be16(p, pP->dstPort);
+        put_be16(p + 2, pP->dstPort);
+        put_be16(p + 4, 8 + pP->msgLen + pP->udpLenAdj);
+        p += 8;
+    }
+
+    // PTP header: messageType, versionPTP, messageLength
+    p[0] = 0x00;
+    p[1] = 0x02;
+    put_be16(p + 2, pP->msgLenField ? pP->msgLenField : pP->msgLen);
+    p += pP->msgLen + pP->padding;
+
+    pF->len = p - pF->data;
+}
+
+// classify the first len bytes of the frame from a buffer of exactly that size
+static PtpFrameClass classify(const Frame *pF, uint32_t len, PtpFrameInfo *pInfo) {
+    uint8_t *pBuf = malloc(len ? len : 1);
+    memcpy(pBuf, pF->data, len);
+    PtpFrameClass cls = ptp_classify_frame(pBuf, len, pInfo);
+    free(pBuf);
+    return cls;
+}
+
+static void check(const char *name, const Frame *pF, uint32_t len, PtpFrameClass expCls, uint16_t expOffset, uint16_t expLen) {
+    PtpFrameInfo info;
+    PtpFrameClass cls = classify(pF, len, &info);
+    sChecked++;
+
+    if (expCls == PTP_FRAME_NONE) {
+        expOffset = 0;
+        expLen = 0;
+    }
+
+    if ((cls != expCls) || (info.cls != expCls) || (info.payloadOffset != expOffset) || (info.payloadLen != expLen)) {
+        printf("FAIL: %s (length %u): class %d, offset %u, length %u, expected %d, %u, %u\n", name, len, cls, info.payloadOffset, info.payloadLen, expCls, expOffset, expLen);
+        sFailed++;
+    }
+}
+
+// check a frame at its full length and at all of its truncated lengths
+static void check_frame(const char *name, const FrameParams *pP, PtpFrameClass expCls, uint16_t expOffset, uint16_t expLen) {
+    Frame f;
+    build_frame(&f, pP);
+
+    check(name, &f, f.len, expCls, expOffset, expLen);
+
+    for (uint32_t len = 0; len < f.len; len++) {
+        PtpFrameClass cls = PTP_FRAME_NONE;
+        uint16_t msgLen = 0;
+
+        // an IEEE 802.3 frame stays valid while the PTP header fits, the
+        // message is trimmed to the frame, a UDP datagram must be complete
+        // (only the padding may be cut)
+        if ((expCls == PTP_FRAME_L2) && (len >= expOffset + PTP_CLS_MIN_MSG_LEN)) {
+            cls = PTP_FRAME_L2;
+            msgLen = (len - expOffset < expLen) ? (len - expOffset) : expLen;
+        } else if ((expCls != PTP_FRAME_L2) && (len >= expOffset + expLen)) {
+            cls = expCls;
+            msgLen = expLen;
+        }
+
+        check(name, &f, len, cls, expOffset, msgLen);
+    }
+}
+
+int main() {
+    PtpFrameInfo info;
+
+    // PTP over UDP/IPv4
+    check_frame("UDP event", &(FrameParams ) { .dstPort = 319, .msgLen = PTP_MSG_LEN }, PTP_FRAME_UDP_EVENT, 42, PTP_MSG_LEN);
+    check_frame("UDP general", &(FrameParams ) { .dstPort = 320, .msgLen = PTP_MSG_LEN }, PTP_FRAME_UDP_GENERAL, 42, PTP_MSG_LEN);
+    check_frame("UDP padded", &(FrameParams ) { .dstPort = 319, .msgLen = PTP_MSG_LEN, .padding = 6 }, PTP_FRAME_UDP_EVENT, 42, PTP_MSG_LEN);
+    check_frame("UDP VLAN", &(FrameParams ) { .vlan = true, .dstPort = 319, .msgLen = PTP_MSG_LEN }, PTP_FRAME_UDP_EVENT, 46, PTP_MSG_LEN);
+    check_frame("UDP IHL 6", &(FrameParams ) { .ihl = 6, .dstPort = 320, .msgLen = PTP_MSG_LEN }, PTP_FRAME_UDP_GENERAL, 46, PTP_MSG_LEN);
+    check_frame("UDP IHL 15 VLAN", &(FrameParams ) { .vlan = true, .ihl = 15, .dstPort = 319, .msgLen = PTP_MSG_LEN }, PTP_FRAME_UDP_EVENT, 86, PTP_MSG_LEN);
+    check_frame("UDP minimal message", &(FrameParams ) { .dstPort = 319, .msgLen = PTP_CLS_MIN_MSG_LEN }, PTP_FRAME_UDP_EVENT, 42, PTP_CLS_MIN_MSG_LEN);
+
+    // not PTP or malformed UDP/IPv4
+    check_frame("UDP other port", &(FrameParams ) { .dstPort = 123, .msgLen = PTP_MSG_LEN }, PTP_FRAME_NONE, 0, 0);
+    check_frame("IPv4 more fragments", &(FrameParams ) { .dstPort = 319, .fragment = 0x2000, .msgLen = PTP_MSG_LEN }, PTP_FRAME_NONE, 0, 0);
+    check_frame("IPv4 fragment offset", &(FrameParams ) { .dstPort = 319, .fragment = 0x0010, .msgLen = PTP_MSG_LEN }, PTP_FRAME_NONE, 0, 0);
+    check_frame("IPv4 don't fragment", &(FrameParams ) { .dstPort = 319, .fragment = 0x4000, .msgLen = PTP_MSG_LEN }, PTP_FRAME_UDP_EVENT, 42, PTP_MSG_LEN);
+    check_frame("IPv4 IHL 4", &(FrameParams ) { .ihl = 4, .dstPort = 319, .msgLen = PTP_MSG_LEN }, PTP_FRAME_NONE, 0, 0);
+    check_frame("IPv6 version", &(FrameParams ) { .version = 6, .dstPort = 319, .msgLen = PTP_MSG_LEN }, PTP_FRAME_NONE, 0, 0);
+    check_frame("IPv4 TCP", &(FrameParams ) { .proto = 6, .dstPort = 319, .msgLen = PTP_MSG_LEN }, PTP_FRAME_NONE, 0, 0);
+    check_frame("UDP length short", &(FrameParams ) { .dstPort = 319, .msgLen = PTP_MSG_LEN, .udpLenAdj = -(PTP_MSG_LEN + 1) }, PTP_FRAME_NONE, 0, 0);
+    check_frame("UDP length long", &(FrameParams ) { .dstPort = 319, .msgLen = PTP_MSG_LEN, .udpLenAdj = 1 }, PTP_FRAME_NONE, 0, 0);
+    check_frame("UDP message short", &(FrameParams ) { .dstPort = 319, .msgLen = PTP_CLS_MIN_MSG_LEN - 1 }, PTP_FRAME_NONE, 0, 0);
+    check_frame("ARP", &(FrameParams ) { .etherType = 0x0806, .msgLen = PTP_MSG_LEN }, PTP_FRAME_NONE, 0, 0);
+
+    // PTP over IEEE 802.3
+    check_frame("L2", &(FrameParams ) { .l2 = true, .msgLen = PTP_MSG_LEN }, PTP_FRAME_L2, 14, PTP_MSG_LEN);
+    check_frame("L2 VLAN", &(FrameParams ) { .l2 = true, .vlan = true, .msgLen = PTP_MSG_LEN }, PTP_FRAME_L2, 18, PTP_MSG_LEN);
+    check_frame("L2 padded", &(FrameParams ) { .l2 = true, .msgLen = PTP_MSG_LEN, .padding = 2 }, PTP_FRAME_L2, 14, PTP_MSG_LEN);
+    check_frame("L2 message short", &(FrameParams ) { .l2 = true, .msgLen = PTP_CLS_MIN_MSG_LEN - 1 }, PTP_FRAME_NONE, 0, 0);
+
+    // an invalid messageLength leaves the whole payload to the PTP stack
+    check_frame("L2 messageLength short", &(FrameParams ) { .l2 = true, .msgLen = PTP_MSG_LEN, .msgLenField = PTP_CLS_MIN_MSG_LEN - 1 }, PTP_FRAME_L2, 14, PTP_MSG_LEN);
+    check_frame("L2 messageLength long", &(FrameParams ) { .l2 = true, .msgLen = PTP_MSG_LEN, .msgLenField = PTP_MSG_LEN + 10 }, PTP_FRAME_L2, 14, PTP_MSG_LEN);
+
+    // no frame at all
+    sChecked++;
+    if (ptp_classify_frame(NULL, 64, &info) != PTP_FRAME_NONE) {
+        printf("FAIL: NULL frame\n");
+        sFailed++;
+    }
+
+    printf("ptp_classifier: %u checks, %u failed\n", sChecked, sFailed);
+    return (sFailed == 0) ? 0 : 1;
+}
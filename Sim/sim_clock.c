@@ -0,0 +1,132 @@
+/*
+ * sim_clock.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "sim_clock.h"
+
+#include <math.h>
+
+#define NSEC_PER_SEC (1000000000LL)
+#define SIM_DEFAULT_SUBSEC_INC (10) // 100 MHz effective update rate
+#define SIM_MAX_STEP (1E-03) // maximal integration step [s]
+
+static struct {
+    SimOscParams osc; // oscillator parameters
+    double trueTime; // true time [s]
+    double wander; // current random walk component of the frequency error [ppm]
+    double cycleFrac; // fractional reference clock cycles not accounted yet
+    uint64_t acc; // addend accumulator (lower 32 bits are used)
+    int64_t timeNs; // PTP time [ns]
+    uint32_t addend; // addend register
+    uint8_t subsecInc; // subsecond increment register [ns]
+    uint64_t rng; // random number generator state
+} sClk;
+
+// xorshift64* generator, uniform in (0,1)
+static double rand_uniform() {
+    sClk.rng ^= sClk.rng >> 12;
+    sClk.rng ^= sClk.rng << 25;
+    sClk.rng ^= sClk.rng >> 27;
+    return ((double) ((sClk.rng * 0x2545F4914F6CDD1DULL) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+// standard normal random number (Box-Muller)
+static double rand_normal() {
+    double u1 = rand_uniform(), u2 = rand_uniform();
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+void sim_clock_init(const SimOscParams *pParams) {
+    sClk.osc = *pParams;
+    if (sClk.osc.nominalFreq <= 0) {
+        sClk.osc.nominalFreq = SIM_OSC_DEFAULT_FREQ;
+    }
+    sClk.trueTime = 0;
+    sClk.wander = 0;
+    sClk.cycleFrac = 0;
+    sClk.acc = 0;
+    sClk.timeNs = 0;
+    sClk.subsecInc = SIM_DEFAULT_SUBSEC_INC;
+    sClk.addend = sim_clock_nominal_addend();
+    sClk.rng = ((uint64_t) pParams->seed << 1) | 1; // must not be zero
+}
+
+uint32_t sim_clock_nominal_addend() {
+    // overflow rate must equal 1E+09 / subsecInc
+    double ratio = (NSEC_PER_SEC / (double) sClk.subsecInc) / sClk.osc.nominalFreq;
+    return (uint32_t) fmin(ratio * 4294967296.0, 4294967295.0);
+}
+
+double sim_clock_freq_err_ppm() {
+    return sClk.osc.freqErrPpm + sClk.wander;
+}
+
+// advance by a single integration step
+static void advance_step(double dt) {
+    // random walk of the frequency error
+    if (sClk.osc.wanderPpm > 0) {
+        sClk.wander += sClk.osc.wanderPpm * sqrt(dt) * rand_normal();
+    }
+
+    // reference clock cycles elapsed
+    double cycles = dt * sClk.osc.nominalFreq * (1.0 + sim_clock_freq_err_ppm() * 1E-06) + sClk.cycleFrac;
+    uint64_t wholeCycles = (uint64_t) cycles;
+    sClk.cycleFrac = cycles - (double) wholeCycles;
+
+    // accumulator overflows
+    uint64_t acc = sClk.acc + wholeCycles * (uint64_t) sClk.addend;
+    sClk.timeNs += (int64_t) (acc >> 32) * sClk.subsecInc;
+    sClk.acc = acc & 0xFFFFFFFFULL;
+
+    sClk.trueTime += dt;
+}
+
+void sim_clock_advance(double dt) {
+    while (dt > SIM_MAX_STEP) {
+        advance_step(SIM_MAX_STEP);
+        dt -= SIM_MAX_STEP;
+    }
+    if (dt > 0) {
+        advance_step(dt);
+    }
+}
+
+double sim_clock_true_time() {
+    return sClk.trueTime;
+}
+
+void sim_clock_init_time(uint32_t sec, uint32_t nsec) {
+    sClk.timeNs = (int64_t) sec * NSEC_PER_SEC + nsec;
+}
+
+void sim_clock_get_time(uint32_t *pSec, uint32_t *pNsec) {
+    *pSec = (uint32_t) (sClk.timeNs / NSEC_PER_SEC);
+    *pNsec = (uint32_t) (sClk.timeNs % NSEC_PER_SEC);
+}
+
+int64_t sim_clock_get_time_ns() {
+    return sClk.timeNs;
+}
+
+void sim_clock_update_time(uint32_t sec, uint32_t nsec, bool add) {
+    int64_t delta = (int64_t) sec * NSEC_PER_SEC + nsec;
+    sClk.timeNs += add ? delta : -delta;
+}
+
+void sim_clock_set_addend(uint32_t addend) {
+    sClk.addend = addend;
+}
+
+uint32_t sim_clock_get_addend() {
+    return sClk.addend;
+}
+
+void sim_clock_set_subsec_inc(uint8_t inc) {
+    sClk.subsecInc = inc;
+}
+
+uint8_t sim_clock_get_subsec_inc() {
+    return sClk.subsecInc;
+}
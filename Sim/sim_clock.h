@@ -0,0 +1,43 @@
+/*
+ * sim_clock.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef SIM_CLOCK_H_
+#define SIM_CLOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Model of the Ethernet MAC's PTP hardware clock (fine correction mode with
+// digital subsecond rollover): on every cycle of the PTP reference clock the
+// addend is added to a 32-bit accumulator, each accumulator overflow advances
+// the time by the subsecond increment.
+
+// oscillator model parameters
+typedef struct {
+    double nominalFreq; // nominal frequency of the PTP reference clock [Hz]
+    double freqErrPpm; // constant frequency error of the oscillator [ppm]
+    double wanderPpm; // frequency random walk, standard deviation per sqrt(second) [ppm]
+    uint32_t seed; // seed of the random number generator (deterministic runs)
+} SimOscParams;
+
+#define SIM_OSC_DEFAULT_FREQ (200E+06) // HCLK drives the PTP block on the target
+
+void sim_clock_init(const SimOscParams *pParams); // initialize the clock model (time zero, nominal addend)
+void sim_clock_advance(double dt); // advance the true time by dt seconds
+double sim_clock_true_time(); // get the true (reference) time in seconds
+double sim_clock_freq_err_ppm(); // get the current frequency error of the oscillator
+
+void sim_clock_init_time(uint32_t sec, uint32_t nsec); // initialize the PTP time
+void sim_clock_get_time(uint32_t *pSec, uint32_t *pNsec); // read the PTP time
+int64_t sim_clock_get_time_ns(); // read the PTP time in nanoseconds
+void sim_clock_update_time(uint32_t sec, uint32_t nsec, bool add); // step the PTP time forward or backward
+void sim_clock_set_addend(uint32_t addend); // set the addend
+uint32_t sim_clock_get_addend(); // get the addend
+void sim_clock_set_subsec_inc(uint8_t inc); // set the subsecond increment [ns]
+uint8_t sim_clock_get_subsec_inc(); // get the subsecond increment [ns]
+uint32_t sim_clock_nominal_addend(); // addend yielding nominal rate with an ideal oscillator
+
+#endif /* SIM_CLOCK_H_ */
@@ -0,0 +1,71 @@
+/*
+ * sim_eth.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "sim_eth.h"
+#include "sim_clock.h"
+
+ETH_HandleTypeDef EthHandle;
+
+static bool sTsEnabled = false;
+static uint32_t sStepCnt = 0;
+
+void ETH_EnablePTPTimeStamping(ETH_HandleTypeDef *heth) {
+    sTsEnabled = true;
+}
+
+void ETH_DisablePTPTimeStamping(ETH_HandleTypeDef *heth) {
+    sTsEnabled = false;
+}
+
+void ETH_InitPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec) {
+    sim_clock_init_time(sec, nsec);
+}
+
+void ETH_GetPTPTime(ETH_HandleTypeDef *heth, uint32_t *sec, uint32_t *nsec) {
+    sim_clock_get_time(sec, nsec);
+}
+
+void ETH_EnablePTPFineCorr(ETH_HandleTypeDef *heth, bool enFineCorr) {
+    // only the fine correction method is modelled
+}
+
+void ETH_UpdatePTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec, bool add_substract) {
+    ETH_StepPTPTime(heth, sec, nsec, add_substract);
+}
+
+void ETH_StepPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec, bool add_substract) {
+    sim_clock_update_time(sec, nsec, add_substract);
+    sStepCnt++;
+}
+
+void ETH_SetPTPAddend(ETH_HandleTypeDef *heth, uint32_t addend) {
+    sim_clock_set_addend(addend);
+}
+
+uint32_t ETH_GetPTPAddend(ETH_HandleTypeDef *heth) {
+    return sim_clock_get_addend();
+}
+
+uint32_t ETH_GetPTPStepCount(ETH_HandleTypeDef *heth) {
+    return sStepCnt;
+}
+
+// the simulated PTP block takes over updates immediately
+
+bool ETH_IsPTPClockUpdatePending(ETH_HandleTypeDef *heth) {
+    return false;
+}
+
+void ETH_PTPClockTick() {
+}
+
+void ETH_SetPTPSubsecondIncrement(ETH_HandleTypeDef *heth, uint8_t increment) {
+    sim_clock_set_subsec_inc(increment);
+}
+
+uint32_t ETH_GetPTPSubsecondIncrement(ETH_HandleTypeDef *heth) {
+    return sim_clock_get_subsec_inc();
+}
@@ -0,0 +1,37 @@
+/*
+ * sim_eth.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef SIM_ETH_H_
+#define SIM_ETH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Stand-in for the PTP clock API of the Ethernet HAL driver
+// (stm32h7xx_hal_eth.h), backed by the simulated clock in sim_clock.c.
+
+typedef struct {
+    uint32_t dummy;
+} ETH_HandleTypeDef;
+
+void ETH_EnablePTPTimeStamping(ETH_HandleTypeDef *heth); // Enable PTP timestamping
+void ETH_DisablePTPTimeStamping(ETH_HandleTypeDef *heth); // Disable PTP timestamping
+void ETH_InitPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec); // Initialize PTP clock time
+void ETH_GetPTPTime(ETH_HandleTypeDef *heth, uint32_t *sec, uint32_t *nsec); // Get PTP-time
+void ETH_EnablePTPFineCorr(ETH_HandleTypeDef *heth, bool enFineCorr); // Enable fine correction method
+void ETH_UpdatePTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec, bool add_substract); // Update PTP time forward or backward by a given value
+void ETH_StepPTPTime(ETH_HandleTypeDef *heth, uint32_t sec, uint32_t nsec, bool add_substract); // Step PTP time forward or backward
+void ETH_SetPTPAddend(ETH_HandleTypeDef *heth, uint32_t addend); // Set PTP addend
+uint32_t ETH_GetPTPAddend(ETH_HandleTypeDef *heth); // Get PTP addend
+uint32_t ETH_GetPTPStepCount(ETH_HandleTypeDef *heth); // Get the number of time steps performed
+bool ETH_IsPTPClockUpdatePending(ETH_HandleTypeDef *heth); // Check if an update is waiting for the PTP block
+void ETH_PTPClockTick(); // Complete pending updates
+void ETH_SetPTPSubsecondIncrement(ETH_HandleTypeDef *heth, uint8_t increment); // Set PTP clock subsecond increment
+uint32_t ETH_GetPTPSubsecondIncrement(ETH_HandleTypeDef *heth); // Get PTP clock subsecond increment
+
+extern ETH_HandleTypeDef EthHandle; // the simulated interface
+
+#endif /* SIM_ETH_H_ */
@@ -0,0 +1,184 @@
+/*
+ * sim_main.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+// Servo convergence benchmark: a slave clock driven by a drifting oscillator
+// is disciplined to an ideal master through the HAL's PTP clock API. The
+// servo is a PI loop of this file, not the one of flexPTP, and the API is the
+// stand-in of sim_eth.c, not the HAL driver.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim_clock.h"
+#include "sim_eth.h"
+
+#define NSEC_PER_SEC (1000000000LL)
+#define MASTER_EPOCH_SEC (1000) // master time at the start, leaves room for negative initial offsets [s]
+
+static struct {
+    SimOscParams osc; // slave oscillator
+    double syncInterval; // interval of the Sync messages [s]
+    uint32_t syncCnt; // number of Sync messages to simulate
+    double tsNoise; // standard deviation of the timestamping noise [ns]
+    double initOffset; // initial time offset of the slave [ns]
+    double kp, ki; // servo gains
+    double threshold; // offset threshold of convergence [ns]
+    double stepThreshold; // offset above which the clock is stepped [ns]
+    int verbose; // print every sample
+} sCfg = {
+        .osc = { .nominalFreq = SIM_OSC_DEFAULT_FREQ, .freqErrPpm = 25.0, .wanderPpm = 0.001, .seed = 1 },
+        .syncInterval = 1.0,
+        .syncCnt = 600,
+        .tsNoise = 20.0,
+        .initOffset = 1.5E+06,
+        .kp = 0.5,
+        .ki = 0.1,
+        .threshold = 100.0,
+        .stepThreshold = 1.0E+06,
+        .verbose = 0
+};
+
+// xorshift32 generator for the measurement noise, independent from the oscillator
+static uint32_t sNoiseRng = 0x9E3779B9;
+
+static double noise_normal() {
+    double u[2];
+    for (int i = 0; i < 2; i++) {
+        sNoiseRng ^= sNoiseRng << 13;
+        sNoiseRng ^= sNoiseRng >> 17;
+        sNoiseRng ^= sNoiseRng << 5;
+        u[i] = (sNoiseRng + 0.5) / 4294967296.0;
+    }
+    return sqrt(-2.0 * log(u[0])) * cos(2.0 * M_PI * u[1]);
+}
+
+static void usage(const char *pName) {
+    fprintf(stderr, "Usage: %s [-p freq_err_ppm] [-w wander_ppm] [-s seed] [-n sync_cnt] [-i sync_interval_s]\n"
+            "          [-t ts_noise_ns] [-o init_offset_ns] [-P kp] [-I ki] [-T threshold_ns] [-v]\n", pName);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:w:s:n:i:t:o:P:I:T:vh")) != -1) {
+        switch (opt) {
+        case 'p':
+            sCfg.osc.freqErrPpm = atof(optarg);
+            break;
+        case 'w':
+            sCfg.osc.wanderPpm = atof(optarg);
+            break;
+        case 's':
+            sCfg.osc.seed = strtoul(optarg, NULL, 0);
+            sNoiseRng ^= sCfg.osc.seed * 2654435761U;
+            break;
+        case 'n':
+            sCfg.syncCnt = strtoul(optarg, NULL, 0);
+            break;
+        case 'i':
+            sCfg.syncInterval = atof(optarg);
+            break;
+        case 't':
+            sCfg.tsNoise = atof(optarg);
+            break;
+        case 'o':
+            sCfg.initOffset = atof(optarg);
+            break;
+        case 'P':
+            sCfg.kp = atof(optarg);
+            break;
+        case 'I':
+            sCfg.ki = atof(optarg);
+            break;
+        case 'T':
+            sCfg.threshold = atof(optarg);
+            break;
+        case 'v':
+            sCfg.verbose = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((sCfg.syncCnt == 0) || (sCfg.syncInterval <= 0) || (sCfg.initOffset <= -MASTER_EPOCH_SEC * NSEC_PER_SEC)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // initialize the simulated MAC
+    sim_clock_init(&sCfg.osc);
+    ETH_EnablePTPTimeStamping(&EthHandle);
+    ETH_EnablePTPFineCorr(&EthHandle, true);
+    int64_t initTime = MASTER_EPOCH_SEC * NSEC_PER_SEC + (int64_t) sCfg.initOffset; // the slave is off by the initial offset (either sign)
+    ETH_InitPTPTime(&EthHandle, (uint32_t) (initTime / NSEC_PER_SEC), (uint32_t) (initTime % NSEC_PER_SEC));
+    uint32_t addendNominal = ETH_GetPTPAddend(&EthHandle);
+
+    double integ = 0; // integrator of the servo [ppb]
+    double lastOutOfRange = 0; // last time the offset exceeded the threshold
+    double sqSum = 0, absMax = 0; // steady state statistics (second half of the run)
+    uint32_t ssCnt = 0;
+
+    if (sCfg.verbose) {
+        printf("t_s,offset_ns,corr_ppb,osc_err_ppm\n");
+    }
+
+    clock_t cpuStart = clock();
+
+    for (uint32_t i = 0; i < sCfg.syncCnt; i++) {
+        sim_clock_advance(sCfg.syncInterval);
+
+        // measured offset: slave time - master (true) time + timestamping noise
+        double t = sim_clock_true_time();
+        uint32_t sec, nsec;
+        ETH_GetPTPTime(&EthHandle, &sec, &nsec);
+        double offset = (double) ((int64_t) sec * NSEC_PER_SEC + nsec) - (t + MASTER_EPOCH_SEC) * NSEC_PER_SEC + sCfg.tsNoise * noise_normal();
+
+        double corr = 0; // frequency correction [ppb]
+        if (fabs(offset) > sCfg.stepThreshold) {
+            // step the clock
+            int64_t step = (int64_t) llround(fabs(offset));
+            ETH_UpdatePTPTime(&EthHandle, (uint32_t) (step / NSEC_PER_SEC), (uint32_t) (step % NSEC_PER_SEC), offset < 0);
+        } else {
+            // PI servo on the frequency
+            double rate = offset / sCfg.syncInterval; // [ppb]
+            integ += sCfg.ki * rate;
+            corr = sCfg.kp * rate + integ;
+            ETH_SetPTPAddend(&EthHandle, (uint32_t) llround(addendNominal * (1.0 - corr * 1E-09)));
+        }
+
+        if (fabs(offset) > sCfg.threshold) {
+            lastOutOfRange = t;
+        }
+
+        if (i >= sCfg.syncCnt / 2) {
+            sqSum += offset * offset;
+            absMax = fmax(absMax, fabs(offset));
+            ssCnt++;
+        }
+
+        if (sCfg.verbose) {
+            printf("%.3f,%.1f,%.1f,%.4f\n", t, offset, corr, sim_clock_freq_err_ppm());
+        }
+    }
+
+    double cpuTime = (double) (clock() - cpuStart) / CLOCKS_PER_SEC;
+    double simTime = sim_clock_true_time();
+
+    fprintf(stderr, "Simulated time: %.1f s, CPU time: %.3f s (%.1f us per simulated second)\n", simTime, cpuTime, cpuTime * 1E+06 / simTime);
+    if (lastOutOfRange < simTime) {
+        fprintf(stderr, "Converged within %.0f ns after %.1f s\n", sCfg.threshold, lastOutOfRange + sCfg.syncInterval);
+    } else {
+        fprintf(stderr, "Not converged within %.0f ns\n", sCfg.threshold);
+    }
+    fprintf(stderr, "Steady state offset: RMS %.1f ns, max. %.1f ns\n", sqrt(sqSum / ssCnt), absMax);
+
+    return (lastOutOfRange < simTime) ? 0 : 2;
+}
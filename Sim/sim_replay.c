@@ -0,0 +1,255 @@
+/*
+ * sim_replay.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "sim_replay.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pcap_tap.h"
+
+#define PCAPNG_BLOCK_SHB (0x0A0D0D0A) // section header block
+#define PCAPNG_BLOCK_IDB (0x00000001) // interface description block
+#define PCAPNG_BLOCK_PB (0x00000002) // packet block (obsolete)
+#define PCAPNG_BLOCK_EPB (0x00000006) // enhanced packet block
+#define PCAPNG_BOM (0x1A2B3C4D) // byte order magic
+#define PCAPNG_OPT_END (0) // end of options
+#define PCAPNG_OPT_IF_TSRESOL (9) // timestamp resolution option of the IDB
+#define PCAPNG_MAX_IF (16) // maximal number of interfaces handled
+
+#define MAX_FRAME_LEN (65536)
+#define NSEC_PER_SEC (1000000000ULL)
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+// replay state
+typedef struct {
+    FILE *pF; // capture file
+    bool swap; // byte order of the file differs from the host
+    double speed; // replay speed
+    bool started; // first frame has been replayed
+    double capStart; // capture time of the first frame [s]
+    struct timespec wallStart; // wall time of the first frame
+    SimReplayFrameCb cb; // frame callback
+    void *pArg; // callback argument
+    long cnt; // frames replayed
+} ReplayState;
+
+static uint32_t swap32(ReplayState *pS, uint32_t x) {
+    return pS->swap ? __builtin_bswap32(x) : x;
+}
+
+static uint16_t swap16(ReplayState *pS, uint16_t x) {
+    return pS->swap ? __builtin_bswap16(x) : x;
+}
+
+// wait until the capture time of the frame is due, then pass the frame to the callback
+static int replay_frame(ReplayState *pS, const uint8_t *pFrame, uint32_t len, uint32_t origLen, uint32_t sec, uint32_t nsec) {
+    double capTime = sec + nsec * 1E-09;
+
+    if (!pS->started) {
+        pS->started = true;
+        pS->capStart = capTime;
+        clock_gettime(CLOCK_MONOTONIC, &pS->wallStart);
+    } else if (pS->speed > 0) {
+        double due = (capTime - pS->capStart) / pS->speed;
+        if (due > 0) {
+            struct timespec ts = pS->wallStart;
+            ts.tv_sec += (time_t) due;
+            ts.tv_nsec += (long) ((due - (time_t) due) * 1E+09);
+            if (ts.tv_nsec >= (long) NSEC_PER_SEC) {
+                ts.tv_sec++;
+                ts.tv_nsec -= NSEC_PER_SEC;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+            }
+        }
+    }
+
+    pS->cnt++;
+    return pS->cb(pFrame, len, origLen, sec, nsec, pS->pArg);
+}
+
+// replay a classic pcap file, the file header has already been read
+static int replay_pcap(ReplayState *pS, const PcapFileHeader *pHdr, uint8_t *pBuf) {
+    bool nsecRes = swap32(pS, pHdr->magic) == PCAP_MAGIC_NSEC;
+    PcapRecordHeader rec;
+
+    while (fread(&rec, sizeof(rec), 1, pS->pF) == 1) {
+        uint32_t inclLen = swap32(pS, rec.inclLen);
+        if ((inclLen > MAX_FRAME_LEN) || (fread(pBuf, 1, inclLen, pS->pF) != inclLen)) {
+            fprintf(stderr, "Truncated or corrupt pcap record!\n");
+            return -1;
+        }
+
+        uint32_t frac = swap32(pS, rec.tsFrac);
+        if (replay_frame(pS, pBuf, inclLen, swap32(pS, rec.origLen), swap32(pS, rec.tsSec), nsecRes ? frac : frac * 1000)) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// get the timestamp resolution (units per second) from the options of an IDB
+static uint64_t pcapng_if_resolution(ReplayState *pS, const uint8_t *pOpt, uint32_t len) {
+    uint64_t units = 1000000; // default: microseconds
+
+    while (len >= 4) {
+        uint16_t code, optLen;
+        memcpy(&code, pOpt, 2);
+        memcpy(&optLen, pOpt + 2, 2);
+        code = swap16(pS, code);
+        optLen = swap16(pS, optLen);
+
+        if ((code == PCAPNG_OPT_END) || (4 + (uint32_t) optLen > len)) {
+            break;
+        }
+
+        if ((code == PCAPNG_OPT_IF_TSRESOL) && (optLen >= 1)) {
+            uint8_t res = pOpt[4];
+            uint8_t exp = res & 0x7F;
+            if (exp <= ((res & 0x80) ? 63 : 19)) { // larger ones do not fit into 64 bits, the default is kept
+                units = 1;
+                for (uint8_t i = 0; i < exp; i++) {
+                    units *= (res & 0x80) ? 2 : 10;
+                }
+            } else {
+                fprintf(stderr, "Invalid timestamp resolution 0x%02X, microseconds assumed!\n", res);
+            }
+        }
+
+        uint32_t step = 4 + ((optLen + 3) & ~3);
+        pOpt += step;
+        len -= MIN(step, len);
+    }
+
+    return units;
+}
+
+// replay a pcapng file, the first block type has already been read
+static int replay_pcapng(ReplayState *pS, uint8_t *pBuf) {
+    uint64_t pIfUnits[PCAPNG_MAX_IF]; // timestamp resolution of the interfaces
+    uint32_t ifCnt = 0;
+    uint32_t type = PCAPNG_BLOCK_SHB;
+    bool first = true;
+
+    do {
+        uint32_t blockLen;
+        if (!first && (fread(&type, 4, 1, pS->pF) != 1)) {
+            break; // end of file
+        }
+        if (fread(&blockLen, 4, 1, pS->pF) != 1) {
+            return -1;
+        }
+
+        // byte order is determined by each section header
+        if (type == PCAPNG_BLOCK_SHB) {
+            uint32_t bom;
+            if (fread(&bom, 4, 1, pS->pF) != 1) {
+                return -1;
+            }
+            pS->swap = (bom != PCAPNG_BOM);
+            ifCnt = 0;
+            blockLen = swap32(pS, blockLen);
+            if ((blockLen < 16) || (blockLen > MAX_FRAME_LEN) || (fread(pBuf, 1, blockLen - 12, pS->pF) != blockLen - 12)) {
+                return -1;
+            }
+            first = false;
+            continue;
+        }
+
+        type = swap32(pS, type);
+        blockLen = swap32(pS, blockLen);
+        uint32_t bodyLen = blockLen - 12;
+        if ((blockLen < 12) || (blockLen > MAX_FRAME_LEN) || (fread(pBuf, 1, bodyLen + 4, pS->pF) != bodyLen + 4)) {
+            fprintf(stderr, "Truncated or corrupt pcapng block!\n");
+            return -1;
+        }
+
+        uint32_t w[5];
+        switch (type) {
+        case PCAPNG_BLOCK_IDB:
+            if ((ifCnt < PCAPNG_MAX_IF) && (bodyLen >= 8)) {
+                pIfUnits[ifCnt++] = pcapng_if_resolution(pS, pBuf + 8, bodyLen - 8);
+            }
+            break;
+        case PCAPNG_BLOCK_EPB:
+        case PCAPNG_BLOCK_PB: {
+            if (bodyLen < 20) {
+                return -1;
+            }
+            memcpy(w, pBuf, sizeof(w));
+            uint32_t ifId;
+            if (type == PCAPNG_BLOCK_EPB) {
+                ifId = swap32(pS, w[0]);
+            } else { // 16-bit interface ID followed by the drop counter
+                uint16_t id16;
+                memcpy(&id16, pBuf, 2);
+                ifId = swap16(pS, id16);
+            }
+            uint64_t ts = (((uint64_t) swap32(pS, w[1])) << 32) | swap32(pS, w[2]);
+            uint32_t capLen = swap32(pS, w[3]);
+            uint32_t origLen = swap32(pS, w[4]);
+            if (capLen > bodyLen - 20) {
+                return -1;
+            }
+
+            uint64_t units = (ifId < ifCnt) ? pIfUnits[ifId] : 1000000;
+            uint32_t sec = (uint32_t) (ts / units);
+            uint32_t nsec = (uint32_t) (((ts % units) * (long double) NSEC_PER_SEC) / units);
+
+            if (replay_frame(pS, pBuf + 20, capLen, origLen, sec, nsec)) {
+                return 0;
+            }
+            break;
+        }
+        default: // other blocks are skipped
+            break;
+        }
+    } while (true);
+
+    return 0;
+}
+
+long sim_replay_file(const char *pFileName, double speed, SimReplayFrameCb cb, void *pArg) {
+    ReplayState s = { 0 };
+    s.speed = speed;
+    s.cb = cb;
+    s.pArg = pArg;
+
+    s.pF = fopen(pFileName, "rb");
+    if (s.pF == NULL) {
+        perror(pFileName);
+        return -1;
+    }
+
+    uint8_t *pBuf = malloc(MAX_FRAME_LEN + 4);
+    int ret = -1;
+
+    PcapFileHeader hdr;
+    if (fread(&hdr.magic, 4, 1, s.pF) == 1) {
+        if (hdr.magic == PCAPNG_BLOCK_SHB) {
+            ret = replay_pcapng(&s, pBuf);
+        } else if ((hdr.magic == PCAP_MAGIC_NSEC) || (hdr.magic == PCAP_MAGIC_USEC) || (__builtin_bswap32(hdr.magic) == PCAP_MAGIC_NSEC)
+                || (__builtin_bswap32(hdr.magic) == PCAP_MAGIC_USEC)) {
+            s.swap = (hdr.magic != PCAP_MAGIC_NSEC) && (hdr.magic != PCAP_MAGIC_USEC);
+            if (fread(((uint8_t*) &hdr) + 4, sizeof(hdr) - 4, 1, s.pF) == 1) {
+                ret = replay_pcap(&s, &hdr, pBuf);
+            }
+        } else {
+            fprintf(stderr, "%s: unknown file format!\n", pFileName);
+        }
+    }
+
+    free(pBuf);
+    fclose(s.pF);
+
+    return (ret == 0) ? s.cnt : -1;
+}
@@ -0,0 +1,22 @@
+/*
+ * sim_replay.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef SIM_REPLAY_H_
+#define SIM_REPLAY_H_
+
+#include <stdint.h>
+
+// Replays pcap (microsecond or nanosecond) and pcapng captures frame by frame,
+// frames are passed verbatim along with their capture timestamps.
+
+// frame callback, return nonzero to stop the replay
+typedef int (*SimReplayFrameCb)(const uint8_t *pFrame, uint32_t len, uint32_t origLen, uint32_t sec, uint32_t nsec, void *pArg);
+
+// replay a capture file; speed: 1.0 = original pace, 2.0 = twice as fast, 0 = as fast as possible
+// returns the number of frames replayed or -1 on error
+long sim_replay_file(const char *pFileName, double speed, SimReplayFrameCb cb, void *pArg);
+
+#endif /* SIM_REPLAY_H_ */
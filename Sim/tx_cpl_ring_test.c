@@ -0,0 +1,197 @@
+/*
+ * tx_cpl_ring_test.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+// Test of the Tx completion ring (tx_cpl_ring.c): a simulated DMA releases
+// the descriptors of queued frames, the Tx complete ISR collects them and the
+// interface thread dispatches the records and queues new frames as the
+// descriptors become free. The ISR preempts the thread at every barrier of
+// the ring, at every dispatched record and before every dispatch call. The
+// number of ISR steps run at the first preemption points are enumerated
+// exhaustively, the rest is pseudo-random. Every frame must be dispatched
+// exactly once, in order, with its own descriptor count and timestamp.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// preemption point of the consumer at each barrier of the ring
+static void preempt();
+#define TX_CPL_BARRIER() preempt()
+
+#include "tx_cpl_ring.c"
+
+#define DESC_CNT (8) // number of descriptors and ring records
+#define FRAME_CNT (40) // frames per run
+#define ENUM_POINTS (10) // preemption points enumerated exhaustively
+#define ENUM_BITS (2) // bits of ISR steps at an enumerated preemption point (0..3 steps)
+
+static struct {
+    TxCompletion recs[DESC_CNT];
+    TxCplRing ring;
+    void *pDescPBuf[DESC_CNT]; // frame stored at the last descriptor of each frame
+    uint32_t queued, collected, dispatched; // free-running descriptor counters
+    uint32_t collectIdx; // next descriptor to collect
+    uint32_t nextQueue; // next frame to queue
+    uint32_t nextExpected; // next frame expected at dispatch
+    bool inIsr; // the ISR is running (cannot be preempted)
+    uint32_t schedule; // ISR steps at the enumerated preemption points
+    uint32_t point; // index of the next preemption point
+    uint32_t rnd; // state of the pseudo-random schedule
+    uint32_t maxLevel; // highest ring level seen
+    uint32_t errors; // number of failures
+} s;
+
+static uint32_t sFailedRuns = 0; // number of failed runs, only the first ones are reported
+
+// number of descriptors of a frame
+static uint32_t frame_desc_cnt(uint32_t id) {
+    return 1 + (id * 7 + 3) % 3;
+}
+
+static void fail(const char *msg, uint32_t id) {
+    if ((s.errors++ == 0) && (sFailedRuns < 10)) {
+        printf("FAIL: %s (frame %u, schedule 0x%05X, point %u)\n", msg, id, s.schedule, s.point);
+    }
+}
+
+// Tx complete ISR: the DMA releases one descriptor, it is collected at once
+static void isr_step() {
+    if (s.collected == s.queued) {
+        return;
+    }
+
+    s.inIsr = true;
+
+    uint32_t idx = s.collectIdx;
+    void *p = s.pDescPBuf[idx];
+    TxCompletion *pCpl = tx_cpl_ring_collect(&s.ring, p != NULL);
+    if ((pCpl != NULL) != (p != NULL)) {
+        fail("record not returned at the last descriptor", 0);
+    }
+    if (pCpl != NULL) {
+        uint32_t id = (uint32_t) (uintptr_t) p - 1;
+        s.pDescPBuf[idx] = NULL;
+        pCpl->p = p;
+        pCpl->tsValid = id & 1;
+        pCpl->sec = id;
+        pCpl->nsec = id * 1000 + 7;
+        pCpl->tapRec = id + 100;
+        tx_cpl_ring_publish(&s.ring);
+
+        uint32_t level = tx_cpl_ring_level(&s.ring);
+        if (level > s.maxLevel) {
+            s.maxLevel = level;
+        }
+        if (level > DESC_CNT) {
+            fail("ring overflow", id);
+        }
+    }
+
+    s.collectIdx = (s.collectIdx + 1) % DESC_CNT;
+    s.collected++;
+
+    s.inIsr = false;
+}
+
+// the ISR fires a scheduled number of times
+static void preempt() {
+    if (s.inIsr) {
+        return;
+    }
+
+    uint32_t steps;
+    if (s.point < ENUM_POINTS) {
+        steps = (s.schedule >> (s.point * ENUM_BITS)) & ((1 << ENUM_BITS) - 1);
+    } else {
+        s.rnd = s.rnd * 1103515245 + 12345;
+        steps = (s.rnd >> 16) % 4;
+    }
+    s.point++;
+
+    for (uint32_t i = 0; i < steps; i++) {
+        isr_step();
+    }
+}
+
+// interface thread: check a dispatched record
+static void dispatch_cb(const TxCompletion *pCpl, void *pArg) {
+    uint32_t id = (uint32_t) (uintptr_t) pCpl->p - 1;
+
+    if (id != s.nextExpected) {
+        fail((id < s.nextExpected) ? "duplicated or reordered record" : "lost record", id);
+    } else if ((pCpl->descCnt != frame_desc_cnt(id)) || (pCpl->tsValid != (id & 1)) || (pCpl->sec != id) || (pCpl->nsec != id * 1000 + 7) || (pCpl->tapRec != id + 100)) {
+        fail("corrupted record", id);
+    }
+    s.nextExpected = id + 1;
+
+    preempt();
+}
+
+// queue frames while their descriptors fit
+static void queue_frames() {
+    while (s.nextQueue < FRAME_CNT) {
+        uint32_t descCnt = frame_desc_cnt(s.nextQueue);
+        if ((s.queued - s.dispatched) + descCnt > DESC_CNT) {
+            break;
+        }
+
+        // the frame is stored at its last descriptor
+        s.pDescPBuf[(s.queued + descCnt - 1) % DESC_CNT] = (void *) (uintptr_t) (s.nextQueue + 1);
+        s.queued += descCnt;
+        s.nextQueue++;
+    }
+}
+
+static void run(uint32_t schedule) {
+    memset(&s, 0, sizeof(s));
+    tx_cpl_ring_init(&s.ring, s.recs, DESC_CNT);
+    s.schedule = schedule;
+    s.rnd = schedule * 2654435761u + 1;
+
+    while (s.nextExpected < FRAME_CNT) {
+        uint32_t before = s.nextExpected;
+
+        queue_frames();
+        preempt();
+        s.dispatched += tx_cpl_ring_dispatch(&s.ring, dispatch_cb, NULL);
+
+        // the thread would block until the next Tx complete interrupt
+        if (s.nextExpected == before) {
+            if (s.collected == s.queued) {
+                fail("stalled", s.nextExpected);
+                return;
+            }
+            isr_step();
+        }
+
+        if (s.errors > 0) {
+            return;
+        }
+    }
+
+    if ((s.dispatched != s.queued) || (tx_cpl_ring_level(&s.ring) != 0) || (s.ring.descCnt != 0)) {
+        fail("descriptors not returned", s.nextExpected);
+    }
+}
+
+int main() {
+    uint32_t scheduleCnt = 1u << (ENUM_POINTS * ENUM_BITS);
+    uint32_t maxLevel = 0;
+
+    for (uint32_t schedule = 0; schedule < scheduleCnt; schedule++) {
+        run(schedule);
+        if (s.errors > 0) {
+            sFailedRuns++;
+        }
+        if (s.maxLevel > maxLevel) {
+            maxLevel = s.maxLevel;
+        }
+    }
+
+    printf("tx_cpl_ring: %u schedules, %u failed, highest level %u/%u\n", scheduleCnt, sFailedRuns, maxLevel, DESC_CNT);
+    return (sFailedRuns == 0) ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+/*
+ * console_uart.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "console_uart.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "cli.h"
+#include "utils.h"
+#include "property_map.h"
+
+// DMA streams and requests of the console (USART3)
+#define CONSOLE_UART_DMA_RX_STREAM (DMA1_Stream0)
+#define CONSOLE_UART_DMA_RX_IRQN (DMA1_Stream0_IRQn)
+#define CONSOLE_UART_DMA_RX_REQUEST (DMA_REQUEST_USART3_RX)
+#define CONSOLE_UART_DMA_TX_STREAM (DMA1_Stream1)
+#define CONSOLE_UART_DMA_TX_IRQN (DMA1_Stream1_IRQn)
+#define CONSOLE_UART_DMA_TX_REQUEST (DMA_REQUEST_USART3_TX)
+#define CONSOLE_UART_IRQN (USART3_IRQn)
+
+#define CACHE_LINE_SIZE (32)
+
+static UART_HandleTypeDef *spUart; // the console UART
+static DMA_HandleTypeDef sDmaTx, sDmaRx; // DMA streams
+
+// transmit ring, the head is advanced by the writer, the tail by the completion interrupt
+static struct {
+    uint8_t pBuf[CONSOLE_UART_TX_BUF_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+    volatile uint32_t head, tail; // free-running write and read indices
+    volatile uint32_t dmaLen; // length of the transfer in progress (0: idle)
+    SemaphoreHandle_t roomSem; // signals room in the ring
+} sTx;
+
+// receive buffer, the head is advanced by the receive events
+static struct {
+    uint8_t pBuf[CONSOLE_UART_RX_BUF_SIZE] __attribute__((aligned(CACHE_LINE_SIZE)));
+    volatile uint32_t head; // free-running count of bytes received
+    uint32_t tail; // free-running count of bytes read
+    volatile uint32_t origin; // value of the head when the reception was (re)started at the beginning of the buffer
+    volatile bool resync; // the reception was restarted, unread data must be dropped
+    uint16_t dmaPos; // DMA position at the last receive event
+    volatile TaskHandle_t reader; // task waiting for data
+} sRx;
+
+static ConsoleUartStats sStats; // statistics
+
+// ------------------------
+
+// write back the cached contents of a buffer (if the data cache is on)
+static void cache_clean(void *ptr, uint32_t len) {
+    if (SCB->CCR & SCB_CCR_DC_Msk) {
+        uint32_t addr = ((uint32_t) ptr) & ~(CACHE_LINE_SIZE - 1);
+        SCB_CleanDCache_by_Addr((uint32_t *) addr, len + (((uint32_t) ptr) - addr));
+    }
+}
+
+// drop the cached contents of a buffer (if the data cache is on)
+static void cache_invalidate(void *ptr, uint32_t len) {
+    if (SCB->CCR & SCB_CCR_DC_Msk) {
+        SCB_InvalidateDCache_by_Addr((uint32_t *) ptr, len);
+    }
+}
+
+// start transmitting the filled part of the ring, if no transfer is in progress (call with the UART interrupts masked)
+static void console_uart_tx_start() {
+    uint32_t tail = sTx.tail;
+    uint32_t pending = sTx.head - tail;
+    if ((sTx.dmaLen != 0) || (pending == 0)) {
+        return;
+    }
+
+    // a transfer ends at the end of the ring at latest
+    uint32_t pos = tail % CONSOLE_UART_TX_BUF_SIZE;
+    uint32_t len = MIN(pending, CONSOLE_UART_TX_BUF_SIZE - pos);
+
+    cache_clean(sTx.pBuf + pos, len);
+    sTx.dmaLen = len;
+    if (HAL_UART_Transmit_DMA(spUart, sTx.pBuf + pos, len) != HAL_OK) {
+        sTx.dmaLen = 0; // retried on the next write
+    }
+}
+
+// check if the caller can wait for room
+static bool console_uart_can_wait() {
+    return (__get_IPSR() == 0) && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+}
+
+int console_uart_write(char *ptr, int len) {
+    int written = 0;
+
+    while (written < len) {
+        // copy as much as fits
+        uint32_t room = CONSOLE_UART_TX_BUF_SIZE - (sTx.head - sTx.tail);
+        uint32_t n = MIN((uint32_t) (len - written), room);
+        uint32_t pos = sTx.head % CONSOLE_UART_TX_BUF_SIZE;
+        uint32_t first = MIN(n, CONSOLE_UART_TX_BUF_SIZE - pos);
+        memcpy(sTx.pBuf + pos, ptr + written, first);
+        memcpy(sTx.pBuf, ptr + written + first, n - first);
+        __DMB();
+        sTx.head += n;
+        written += n;
+
+        UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR(); // usable from interrupts as well
+        console_uart_tx_start();
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+
+        if (written == len) {
+            break;
+        }
+
+        // the ring is full
+        if (console_uart_can_wait()) {
+            sStats.txWaits++;
+            if (xSemaphoreTake(sTx.roomSem, pdMS_TO_TICKS(CONSOLE_UART_TX_TIMEOUT_MS)) == pdTRUE) {
+                continue;
+            }
+        }
+
+        sStats.txDropped += len - written;
+        break;
+    }
+
+    sStats.txBytes += written;
+
+    return len;
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    if (huart != spUart) {
+        return;
+    }
+
+    sTx.tail += sTx.dmaLen;
+    sTx.dmaLen = 0;
+    console_uart_tx_start();
+
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(sTx.roomSem, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+// ------------------------
+
+int console_uart_read(char *ptr, int len) {
+    sRx.reader = xTaskGetCurrentTaskHandle(); // received data wakes this task up
+
+    uint32_t head, origin;
+    while (true) {
+        taskENTER_CRITICAL();
+        if (sRx.resync) { // data before the restart is gone
+            sRx.tail = sRx.origin;
+            sRx.resync = false;
+        }
+        head = sRx.head;
+        origin = sRx.origin;
+        taskEXIT_CRITICAL();
+
+        if (head != sRx.tail) {
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+
+    // the DMA overwrote the data not read in time
+    uint32_t avail = head - sRx.tail;
+    if (avail > CONSOLE_UART_RX_BUF_SIZE) {
+        sStats.rxOverflow += avail - CONSOLE_UART_RX_BUF_SIZE;
+        sRx.tail = head - CONSOLE_UART_RX_BUF_SIZE;
+        avail = CONSOLE_UART_RX_BUF_SIZE;
+    }
+
+    cache_invalidate(sRx.pBuf, CONSOLE_UART_RX_BUF_SIZE);
+
+    uint32_t n = MIN((uint32_t) len, avail);
+    uint32_t pos = (sRx.tail - origin) % CONSOLE_UART_RX_BUF_SIZE;
+    uint32_t first = MIN(n, CONSOLE_UART_RX_BUF_SIZE - pos);
+    memcpy(ptr, sRx.pBuf + pos, first);
+    memcpy(ptr + first, sRx.pBuf, n - first);
+    sRx.tail += n;
+
+    return n;
+}
+
+// start the circular reception
+static void console_uart_rx_start() {
+    sRx.dmaPos = 0;
+    sRx.origin = sRx.head;
+    HAL_UARTEx_ReceiveToIdle_DMA(spUart, sRx.pBuf, CONSOLE_UART_RX_BUF_SIZE);
+}
+
+// idle line, half and full transfer events, size is the DMA position in the buffer
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t size) {
+    if (huart != spUart) {
+        return;
+    }
+
+    // the events come at least every half buffer, the position is unambiguous
+    uint32_t n = (size >= sRx.dmaPos) ? (size - sRx.dmaPos) : (size + CONSOLE_UART_RX_BUF_SIZE - sRx.dmaPos);
+    sRx.dmaPos = size % CONSOLE_UART_RX_BUF_SIZE;
+    if (n == 0) {
+        return;
+    }
+
+    sRx.head += n;
+    sStats.rxBytes += n;
+
+    if (sRx.reader != NULL) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(sRx.reader, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+    if (huart != spUart) {
+        return;
+    }
+
+    sStats.rxErrors++;
+
+    // errors (overruns included, overrun detection is left enabled) abort the DMA reception, restart it at the beginning of the buffer
+    if (huart->RxState == HAL_UART_STATE_READY) {
+        sRx.resync = true;
+        console_uart_rx_start();
+    }
+}
+
+// ------------------------
+
+void console_uart_irq_handler() {
+    HAL_UART_IRQHandler(spUart);
+}
+
+void console_uart_dma_tx_irq_handler() {
+    HAL_DMA_IRQHandler(&sDmaTx);
+}
+
+void console_uart_dma_rx_irq_handler() {
+    HAL_DMA_IRQHandler(&sDmaRx);
+}
+
+void console_uart_get_stats(ConsoleUartStats *pStats) {
+    taskENTER_CRITICAL();
+    *pStats = sStats;
+    taskEXIT_CRITICAL();
+}
+
+// print console statistics
+static int CB_uart(const CliToken_Type *ppArgs, uint8_t argc) {
+    if (argc > 0) {
+        if (!strcmp(ppArgs[0], "clear")) {
+            taskENTER_CRITICAL();
+            memset(&sStats, 0, sizeof(sStats));
+            taskEXIT_CRITICAL();
+            return 0;
+        }
+        return -1;
+    }
+
+    ConsoleUartStats stats;
+    console_uart_get_stats(&stats);
+
+    MSG("Tx bytes: %u, waits for room: %u, dropped: %u\n", stats.txBytes, stats.txWaits, stats.txDropped);
+    MSG("Rx bytes: %u, lost (buffer overflow): %u, line errors: %u\n", stats.rxBytes, stats.rxOverflow, stats.rxErrors);
+
+    return 0;
+}
+
+// initialize a DMA stream of the console
+static void console_uart_dma_init(DMA_HandleTypeDef *hdma, DMA_Stream_TypeDef *stream, uint32_t request, uint32_t direction, uint32_t mode) {
+    hdma->Instance = stream;
+    hdma->Init.Request = request;
+    hdma->Init.Direction = direction;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma->Init.Mode = mode;
+    hdma->Init.Priority = DMA_PRIORITY_LOW;
+    hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    HAL_DMA_Init(hdma);
+}
+
+void console_uart_init(UART_HandleTypeDef *huart) {
+    spUart = huart;
+
+    memset(&sStats, 0, sizeof(sStats));
+    sTx.head = sTx.tail = sTx.dmaLen = 0;
+    sTx.roomSem = xSemaphoreCreateBinary();
+    sRx.head = sRx.tail = 0;
+    sRx.resync = false;
+    sRx.reader = NULL;
+
+    // DMA streams
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    console_uart_dma_init(&sDmaTx, CONSOLE_UART_DMA_TX_STREAM, CONSOLE_UART_DMA_TX_REQUEST, DMA_MEMORY_TO_PERIPH, DMA_NORMAL);
+    __HAL_LINKDMA(huart, hdmatx, sDmaTx);
+    console_uart_dma_init(&sDmaRx, CONSOLE_UART_DMA_RX_STREAM, CONSOLE_UART_DMA_RX_REQUEST, DMA_PERIPH_TO_MEMORY, DMA_CIRCULAR);
+    __HAL_LINKDMA(huart, hdmarx, sDmaRx);
+
+    // interrupts
+    HAL_NVIC_SetPriority(CONSOLE_UART_DMA_TX_IRQN, CONSOLE_UART_IRQ_PRIO, 0);
+    HAL_NVIC_EnableIRQ(CONSOLE_UART_DMA_TX_IRQN);
+    HAL_NVIC_SetPriority(CONSOLE_UART_DMA_RX_IRQN, CONSOLE_UART_IRQ_PRIO, 0);
+    HAL_NVIC_EnableIRQ(CONSOLE_UART_DMA_RX_IRQN);
+    HAL_NVIC_SetPriority(CONSOLE_UART_IRQN, CONSOLE_UART_IRQ_PRIO, 0);
+    HAL_NVIC_EnableIRQ(CONSOLE_UART_IRQN);
+
+    console_uart_rx_start();
+
+    // published for telemetry
+    pm_add("uart.txDropped", PMT_UINT32, &sStats.txDropped, 1);
+    pm_add("uart.rxErrors", PMT_UINT32, &sStats.rxErrors, 1);
+
+    cli_register_command("uart [clear] \t\t\tPrint/clear console UART statistics", 1, 0, CB_uart);
+}
@@ -0,0 +1,46 @@
+/*
+ * console_uart.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef CONSOLE_UART_H_
+#define CONSOLE_UART_H_
+
+#include <stdint.h>
+
+#include "stm32h7xx_hal.h"
+
+// DMA driven console UART. Transmission: writers copy into a ring, the DMA
+// sends the filled part (up to the end of the ring) in a single transfer and
+// the next part is started from the completion interrupt. Writers only wait
+// if the ring is full. Reception: the DMA fills a circular buffer
+// continuously, the reader is woken by a task notification on idle line,
+// half and full transfer events, so no character is lost between reads.
+
+#define CONSOLE_UART_TX_BUF_SIZE (4096) // size of the transmit ring
+#define CONSOLE_UART_RX_BUF_SIZE (512) // size of the circular receive buffer (multiple of 32)
+#define CONSOLE_UART_TX_TIMEOUT_MS (1000) // writers waiting for room longer than this drop the rest of their data [ms]
+#define CONSOLE_UART_IRQ_PRIO (10) // priority of the UART and DMA interrupts
+
+// console statistics
+typedef struct {
+    uint32_t txBytes; // bytes queued for transmission
+    uint32_t txWaits; // number of times a writer had to wait for room
+    uint32_t txDropped; // bytes dropped (no room and the writer could not wait)
+    uint32_t rxBytes; // bytes received
+    uint32_t rxOverflow; // bytes lost, the reader fell behind by more than the buffer size
+    uint32_t rxErrors; // number of line errors (overrun, framing, noise)
+} ConsoleUartStats;
+
+void console_uart_init(UART_HandleTypeDef *huart); // set up the DMA streams and start reception (call after HAL_UART_Init())
+int console_uart_write(char *ptr, int len); // queue data for transmission (retarget output function), callers must be serialized
+int console_uart_read(char *ptr, int len); // read at least one byte, blocks until data is available (retarget input function)
+void console_uart_get_stats(ConsoleUartStats *pStats); // get statistics
+
+// interrupt handlers
+void console_uart_irq_handler(); // UART interrupt
+void console_uart_dma_tx_irq_handler(); // DMA interrupt of the transmit stream
+void console_uart_dma_rx_irq_handler(); // DMA interrupt of the receive stream
+
+#endif /* CONSOLE_UART_H_ */
@@ -0,0 +1,247 @@
+/*
+ * dlog.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "dlog.h"
+
+#include <string.h>
+
+#include <retarget.h>
+
+#include "cli.h"
+#include "utils.h"
+#include "ptp_clock.h"
+#include "property_map.h"
+
+// ----- TASK PROPERTIES -----
+static TaskHandle_t sTH; // task handle
+static uint8_t sPrio = 1; // priority
+static uint16_t sStkSize = 512; // stack size
+static void task_dlog(void *pParam); // task routine function
+// ---------------------------
+
+// Records are stored in a ring of words, they never wrap around the end of the
+// ring (a padding record fills the gap instead). Producers reserve room by
+// advancing the head with compare-and-swap, fill in the record and publish it
+// by writing its header last. The log task clears the consumed records, so a
+// header reads as zero until it gets published.
+
+#define DLOG_RING_MASK (DLOG_RING_WORDS - 1)
+
+#define DLOG_REC_VALID (1UL << 31) // the record is complete
+#define DLOG_REC_PAD (1UL << 30) // padding record (no content)
+#define DLOG_REC_LEN_MASK (0xFFFF) // length of the record [words], including the header
+
+// record layout
+enum {
+    DLOG_REC_HDR, // header
+    DLOG_REC_FORMAT, // compiled format (EmbFmtCompiled *)
+    DLOG_REC_SEC, // timestamp
+    DLOG_REC_NSEC,
+    DLOG_REC_ARGS // captured arguments
+};
+
+static uint32_t sRing[DLOG_RING_WORDS]; // the ring
+static uint32_t sHead; // free-running reservation index (producers)
+static uint32_t sTail; // free-running read index (log task)
+static DlogStats sStats; // statistics
+
+static TaskHandle_t sDeferTasks[DLOG_DEFER_TASK_CNT]; // tasks whose MSG() calls are deferred
+
+// reserve room for a record, returns false if the ring is full
+static bool dlog_reserve(uint32_t len, uint32_t *pPos) {
+    uint32_t head = __atomic_load_n(&sHead, __ATOMIC_RELAXED);
+    uint32_t pad, newHead;
+    do {
+        uint32_t pos = head & DLOG_RING_MASK;
+        pad = ((pos + len) > DLOG_RING_WORDS) ? (DLOG_RING_WORDS - pos) : 0;
+        newHead = head + pad + len;
+        if ((newHead - __atomic_load_n(&sTail, __ATOMIC_ACQUIRE)) > DLOG_RING_WORDS) {
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&sHead, &head, newHead, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if (pad > 0) { // publish the padding right away
+        __atomic_store_n(&sRing[head & DLOG_RING_MASK], DLOG_REC_VALID | DLOG_REC_PAD | pad, __ATOMIC_RELEASE);
+    }
+
+    uint32_t level = newHead - __atomic_load_n(&sTail, __ATOMIC_RELAXED);
+    if (level > sStats.maxLevel) { // a concurrent update may get lost, it's only a statistic
+        sStats.maxLevel = level;
+    }
+
+    *pPos = (head + pad) & DLOG_RING_MASK;
+    return true;
+}
+
+bool dlog_vcached(EmbFmtCompiled *pCache, const char *pcFormat, va_list args) {
+    uint32_t sec, nsec;
+    ptp_clock_now_fast(&sec, &nsec);
+
+    // the format is compiled on the first call
+    uint32_t pArgs[DLOG_MAX_ARG_WORDS];
+    int argCnt = -1;
+    if (embfmt_cache_lookup(pCache, (char *) pcFormat) == 0) {
+        argCnt = embfmt_capture(pCache, pArgs, DLOG_MAX_ARG_WORDS, args);
+    }
+    if (argCnt < 0) {
+        __atomic_fetch_add(&sStats.failed, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    uint32_t len = DLOG_REC_ARGS + argCnt;
+    uint32_t pos;
+    if (!dlog_reserve(len, &pos)) {
+        __atomic_fetch_add(&sStats.dropped, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    uint32_t *pRec = sRing + pos;
+    pRec[DLOG_REC_FORMAT] = (uint32_t) pCache;
+    pRec[DLOG_REC_SEC] = sec;
+    pRec[DLOG_REC_NSEC] = nsec;
+    memcpy(pRec + DLOG_REC_ARGS, pArgs, argCnt * sizeof(uint32_t));
+    __atomic_store_n(&pRec[DLOG_REC_HDR], DLOG_REC_VALID | len, __ATOMIC_RELEASE);
+
+    __atomic_fetch_add(&sStats.logged, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool dlog_cached(EmbFmtCompiled *pCache, const char *pcFormat, ...) {
+    va_list args;
+    va_start(args, pcFormat);
+    bool stored = dlog_vcached(pCache, pcFormat, args);
+    va_end(args);
+    return stored;
+}
+
+// ------------------------
+
+// pass the rendered pieces on to the output
+static void dlog_sink(void *pArg, const char *pChunk, unsigned long int len) {
+    RetargetStreamWrite((RetargetStream *) pArg, pChunk, (int) len);
+}
+
+// print a record prefixed by its timestamp
+static void dlog_render(const uint32_t *pRec, uint32_t len) {
+    char stamp[24];
+    uint32_t stampLen = SNPRINTF(stamp, sizeof(stamp) - 1, "[%.6T] ", pRec[DLOG_REC_SEC], pRec[DLOG_REC_NSEC]);
+
+    RetargetStream stream;
+    RetargetStreamOpen(&stream);
+    RetargetStreamWrite(&stream, stamp, stampLen);
+    embfmt_render_captured_sink(dlog_sink, &stream, (const EmbFmtCompiled *) pRec[DLOG_REC_FORMAT], pRec + DLOG_REC_ARGS, len - DLOG_REC_ARGS);
+    RetargetStreamClose(&stream);
+}
+
+// print and release the published records
+static void dlog_flush() {
+    while (true) {
+        uint32_t *pRec = sRing + (sTail & DLOG_RING_MASK);
+        uint32_t hdr = __atomic_load_n(&pRec[DLOG_REC_HDR], __ATOMIC_ACQUIRE);
+        if (!(hdr & DLOG_REC_VALID)) {
+            break; // empty or the record is still being filled in
+        }
+
+        uint32_t len = hdr & DLOG_REC_LEN_MASK;
+        if (!(hdr & DLOG_REC_PAD)) {
+            dlog_render(pRec, len);
+        }
+
+        memset(pRec, 0, len * sizeof(uint32_t));
+        __atomic_store_n(&sTail, sTail + len, __ATOMIC_RELEASE);
+    }
+}
+
+static void task_dlog(void *pParam) {
+    while (true) {
+        dlog_flush();
+        vTaskDelay(pdMS_TO_TICKS(DLOG_FLUSH_PERIOD_MS));
+    }
+}
+
+// ------------------------
+
+bool dlog_defer_task(TaskHandle_t th) {
+    bool ok = false;
+
+    taskENTER_CRITICAL();
+    for (uint32_t i = 0; i < DLOG_DEFER_TASK_CNT; i++) {
+        if (sDeferTasks[i] == NULL || sDeferTasks[i] == th) {
+            sDeferTasks[i] = th;
+            ok = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return ok;
+}
+
+void dlog_undefer_task(TaskHandle_t th) {
+    taskENTER_CRITICAL();
+    for (uint32_t i = 0; i < DLOG_DEFER_TASK_CNT; i++) {
+        if (sDeferTasks[i] == th) {
+            sDeferTasks[i] = NULL;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+bool dlog_is_deferred_context() {
+    if (__get_IPSR() != 0) { // interrupts never wait for the output
+        return true;
+    }
+
+    TaskHandle_t th = xTaskGetCurrentTaskHandle();
+    for (uint32_t i = 0; i < DLOG_DEFER_TASK_CNT; i++) {
+        if ((sDeferTasks[i] != NULL) && (sDeferTasks[i] == th)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void dlog_get_stats(DlogStats *pStats) {
+    taskENTER_CRITICAL();
+    *pStats = sStats;
+    taskEXIT_CRITICAL();
+}
+
+// print logging statistics
+static int CB_dlog(const CliToken_Type *ppArgs, uint8_t argc) {
+    if (argc > 0) {
+        if (!strcmp(ppArgs[0], "clear")) {
+            taskENTER_CRITICAL();
+            memset(&sStats, 0, sizeof(sStats));
+            taskEXIT_CRITICAL();
+            return 0;
+        }
+        return -1;
+    }
+
+    DlogStats stats;
+    dlog_get_stats(&stats);
+    uint32_t level = __atomic_load_n(&sHead, __ATOMIC_RELAXED) - __atomic_load_n(&sTail, __ATOMIC_RELAXED);
+
+    MSG("Records logged: %u, dropped (ring full): %u, failed: %u\n", stats.logged, stats.dropped, stats.failed);
+    MSG("Ring level [words]: %u/%u (max. %u)\n", level, DLOG_RING_WORDS, stats.maxLevel);
+
+    return 0;
+}
+
+void dlog_init() {
+    BaseType_t result = xTaskCreate(task_dlog, "dlog", sStkSize, NULL, sPrio, &sTH);
+    if (result != pdPASS) { // error handling
+        MSG("Failed to create task! (errcode: %ld)\n", result);
+    }
+
+    // published for telemetry
+    pm_add("dlog.logged", PMT_UINT32, &sStats.logged, 1);
+    pm_add("dlog.dropped", PMT_UINT32, &sStats.dropped, 1);
+
+    cli_register_command("dlog [clear] \t\t\tPrint/clear deferred logging statistics", 1, 0, CB_dlog);
+}
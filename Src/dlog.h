@@ -0,0 +1,53 @@
+/*
+ * dlog.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef DLOG_H_
+#define DLOG_H_
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "embfmt/embformat.h"
+
+// Deferred logging. LOG() only stores the compiled format (compiled on the
+// first use at the call site), a PTP timestamp and the raw argument words into
+// a lock-free ring, it never blocks and can be called from any task or
+// interrupt. The log task renders the records through embfmt to the active
+// output in the background. String arguments are copied into the record
+// (truncated if longer than the room left in the record).
+//
+// MSG() calls made from interrupts and from the tasks registered by
+// dlog_defer_task() are passed to the deferred log as well.
+
+#define DLOG_RING_WORDS (2048) // size of the ring [words], power of 2
+#define DLOG_MAX_ARG_WORDS (32) // room for the arguments of a single record [words]
+#define DLOG_DEFER_TASK_CNT (4) // number of tasks whose MSG() calls can be deferred
+#define DLOG_FLUSH_PERIOD_MS (5) // the log task looks for new records with this period [ms]
+
+// logging statistics
+typedef struct {
+    uint32_t logged; // number of records stored
+    uint32_t dropped; // number of records dropped, the ring was full
+    uint32_t failed; // number of records dropped, the format could not be compiled or the arguments did not fit
+    uint32_t maxLevel; // highest fill level of the ring [words]
+} DlogStats;
+
+void dlog_init(); // create the log task and register CLI command
+bool dlog_vcached(EmbFmtCompiled *pCache, const char *pcFormat, va_list args); // store a log record, returns false if it got dropped
+bool dlog_cached(EmbFmtCompiled *pCache, const char *pcFormat, ...); // store a log record, returns false if it got dropped
+bool dlog_defer_task(TaskHandle_t th); // defer the MSG() calls of a task, returns false if the task table is full
+void dlog_undefer_task(TaskHandle_t th); // print the MSG() calls of a task directly again
+bool dlog_is_deferred_context(); // check if MSG() calls of the current context are deferred
+void dlog_get_stats(DlogStats *pStats); // get logging statistics
+
+// formats are compiled on the first use at each call site
+#define LOG(...) ({ static EmbFmtCompiled logCache_; dlog_cached(&logCache_, __VA_ARGS__); })
+
+#endif /* DLOG_H_ */
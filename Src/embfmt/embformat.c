@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
@@ -24,11 +25,18 @@ typedef enum {
 
 // format type
 typedef enum {
-	UNKNOWN = -1, LITERAL_PERCENT, SIGNED_INTEGER, UNSIGNED_INTEGER, DOUBLE, DOUBLE_EXPONENTIAL, UNSIGNED_HEXADECIMAL_INT, UNSIGNED_HEXADECIMAL_INT_UPPERCASE, STRING, CHARACTER
+	UNKNOWN = -1, LITERAL_PERCENT, SIGNED_INTEGER, UNSIGNED_INTEGER, DOUBLE, DOUBLE_EXPONENTIAL, UNSIGNED_HEXADECIMAL_INT, UNSIGNED_HEXADECIMAL_INT_UPPERCASE, STRING, CHARACTER, TIMESTAMP
 } FmtType;
 
+// argument source: a va_list or captured argument words
+typedef struct {
+	va_list va; // arguments passed in a va_list
+	const uint32_t *words; // captured arguments (NULL if the va_list is used)
+	const uint32_t *words_end; // end of the captured arguments
+} FmtArgs;
+
 struct _FmtWord;
-typedef int (*printfn)(va_list *va, struct _FmtWord *fmt, char *outbuf, size_t free_space);
+typedef int (*printfn)(FmtArgs *args, struct _FmtWord *fmt, char *outbuf, size_t free_space);
 
 // pair of type and designator character
 typedef struct {
@@ -42,6 +50,7 @@ typedef struct _FmtWord {
 	FmtFlags flags;
 	int width;
 	int precision;
+	bool precision_given;
 	FmtLength length;
 	FmtType type;
 	FmtTypeDesignatorPair *pTypeDes;
@@ -49,6 +58,53 @@ typedef struct _FmtWord {
 
 // ---------------------------------------------
 
+// fetch a 32-bit argument
+static uint32_t arg_u32(FmtArgs *args) {
+	if (args->words == NULL) {
+		return va_arg(args->va, unsigned int);
+	}
+	return (args->words < args->words_end) ? *(args->words++) : 0;
+}
+
+// fetch a 64-bit argument
+static uint64_t arg_u64(FmtArgs *args) {
+	if (args->words == NULL) {
+		return va_arg(args->va, uint64_t);
+	}
+	uint64_t lo = arg_u32(args);
+	return lo | (((uint64_t) arg_u32(args)) << 32);
+}
+
+// fetch a double argument
+static double arg_double(FmtArgs *args) {
+	if (args->words == NULL) {
+		return va_arg(args->va, double);
+	}
+	uint64_t u = arg_u64(args);
+	double d;
+	memcpy(&d, &u, sizeof(double));
+	return d;
+}
+
+// fetch a string argument (captured strings are stored in place: number of words, characters including the '\0')
+static char* arg_str(FmtArgs *args) {
+	if (args->words == NULL) {
+		return va_arg(args->va, char*);
+	}
+	uint32_t word_cnt = arg_u32(args);
+	if (word_cnt == 0) {
+		return ""; // did not fit when captured
+	} else if (word_cnt > (uint32_t) (args->words_end - args->words)) {
+		args->words = args->words_end; // corrupted
+		return "";
+	}
+	char *str = (char*) args->words;
+	args->words += word_cnt;
+	return str;
+}
+
+// ---------------------------------------------
+
 // copy a maximum of n characters AND insert '\0' into dst as the n+1-th character
 static int string_copy(char *dst, const char *src, size_t n) {
 	size_t i;
@@ -71,16 +127,16 @@ static size_t string_length(char *str) {
 	return len;
 }
 
-// calculate power
-static uint64_t power(uint64_t a, unsigned long int n) {
-	if (n == 0) {
-		return 1;
-	}
-	uint64_t a_orig = a;
-	for (unsigned long int i = 0; i < n - 1; i++) {
-		a *= a_orig;
-	}
-	return a;
+// powers of ten fitting into 64 bits
+static const uint64_t sPow10[] = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+		1000000000000ULL, 10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+		10000000000000000000ULL };
+
+#define MAX_POW10_EXPONENT ((int)(sizeof(sPow10) / sizeof(sPow10[0])) - 1)
+
+// get 10^n (saturated at the largest power fitting into 64 bits)
+static uint64_t power_of_ten(int n) {
+	return sPow10[MIN(MAX(n, 0), MAX_POW10_EXPONENT)];
 }
 
 // round to closest base^1 value
@@ -95,126 +151,150 @@ static uint64_t round_to_base(uint64_t a, uint64_t base) {
 
 // ---------------------------------------------
 
-// insert leading characters
-// str: inout string
-// n_str: length of the input string (NOT buflen, stringlen)
-// c: character to be used for filling
-// n_insert: number of character to insert
-static void insert_leading_characters(char *str, size_t n_str, char c, size_t n_insert) {
-	size_t len = string_length(str);
-	for (size_t i = 0; i < len; i++) {
-		str[len - 1 + n_insert - i] = str[len - i - 1];
-	}
-	for (size_t i = 0; i < n_insert; i++) {
-		str[i] = c;
+static int pfn_literal_percent(FmtArgs *args, FmtWord *fmt, char *outbuf, size_t free_space) {
+	if (free_space >= 1) {
+		outbuf[0] = '%';
+		outbuf[1] = '\0';
 	}
-	str[len + n_insert] = '\0';
+	return 1;
 }
 
-// get exponent in the scientific form of the input number (i. e. get the highest decimal place)
-// l: input number
-// base: base
-// gntpd: greatest non-zero ten-power divisor
-// return: exponent, if l != 0, -1 if l == 0
-static int scientific_form_exponent(uint64_t l, unsigned int base, uint64_t *gntpd) {
-	int e = -1;
-	*gntpd = 1;
-	while (l != 0) {
-		l /= base;
-		*gntpd *= base;
-		e++;
+#define INT_PRINT_OUTBUF_SIZE (47)
+
+static const char sHexDigitsLower[] = "0123456789abcdef";
+static const char sHexDigitsUpper[] = "0123456789ABCDEF";
+
+// two-digit decimal strings of 0..99: one division yields two digits
+static const char sDigitPairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+		"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+
+#define NSEC_PER_SEC (1000000000UL) // also the largest power of ten fitting into 32 bits
+
+// convert a 32-bit number to decimal, the digits are written backwards ending before end
+// (division by a constant compiles to a multiplication, no library call is involved)
+// return: pointer to the first digit
+static char *u32_to_dec(uint32_t u, char *end) {
+	while (u >= 100) {
+		uint32_t q = u / 100;
+		uint32_t r = u - q * 100;
+		end -= 2;
+		end[0] = sDigitPairs[2 * r];
+		end[1] = sDigitPairs[2 * r + 1];
+		u = q;
 	}
-	if (*gntpd > 1) {
-		(*gntpd) /= base;
+	if (u >= 10) {
+		end -= 2;
+		end[0] = sDigitPairs[2 * u];
+		end[1] = sDigitPairs[2 * u + 1];
+	} else {
+		end--;
+		*end = (char) ('0' + u);
 	}
-	return MAX(e, 0);
+	return end;
 }
 
-static int pfn_literal_percent(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space) {
-	if (free_space >= 1) {
-		outbuf[0] = '%';
-		outbuf[1] = '\0';
+// convert a 32-bit number to decimal of exactly n digits (with leading zeros), ending before end
+// return: pointer to the first digit
+static char *u32_to_dec_fixed(uint32_t u, char *end, int n) {
+	char *start = end - n;
+	char *first = u32_to_dec(u, end);
+	while (first > start) {
+		first--;
+		*first = '0';
 	}
-	return 1;
+	return start;
 }
 
-#define INT_PRINT_OUTBUF_SIZE (47)
+// convert a 64-bit number to decimal, ending before end
+// (a 64-bit division is a library call on 32-bit targets, at most two of them are issued per number)
+// return: pointer to the first digit
+static char *u64_to_dec(uint64_t u, char *end) {
+	while ((u >> 32) != 0) {
+		uint64_t q = u / NSEC_PER_SEC;
+		end = u32_to_dec_fixed((uint32_t) (u - q * NSEC_PER_SEC), end, 9);
+		u = q;
+	}
+	return u32_to_dec((uint32_t) u, end);
+}
 
-static char sNumChars[] = "0123456789abcdefABCDEF";
+// convert a number to hexadecimal, ending before end
+// return: pointer to the first digit
+static char *u64_to_hex(uint64_t u, char *end, bool uppercase) {
+	const char *digits = uppercase ? sHexDigitsUpper : sHexDigitsLower;
+	do {
+		end--;
+		*end = digits[u & 0xF];
+		u >>= 4;
+	} while (u != 0);
+	return end;
+}
 
 static int print_number(uint64_t u, bool negative, FmtWord *fmt, char *outbuf, size_t free_space) {
 	// output buffer fitting the full long int range
 	char outstrbuf[INT_PRINT_OUTBUF_SIZE + 1];
-	outstrbuf[0] = '\0';
 	char *outstr = outstrbuf;
 
+	// convert number to string (backwards, into the end of a digit buffer)
+	char digitbuf[24];
+	char *digits_end = digitbuf + sizeof(digitbuf);
+	char *digits_start;
+	if (fmt->type == UNSIGNED_HEXADECIMAL_INT || fmt->type == UNSIGNED_HEXADECIMAL_INT_UPPERCASE) {
+		digits_start = u64_to_hex(u, digits_end, fmt->type == UNSIGNED_HEXADECIMAL_INT_UPPERCASE);
+	} else if ((u >> 32) == 0) {
+		digits_start = u32_to_dec((uint32_t) u, digits_end);
+	} else {
+		digits_start = u64_to_dec(u, digits_end);
+	}
+	int digits = digits_end - digits_start;
+
 	// separate sign, process only non-negative numbers
-	bool sign_prepended = false;
+	char sign = '\0';
 	if (negative) {
-		*outstr = '-';
-		outstr++;
-		sign_prepended = true;
+		sign = '-';
 	} else if (fmt->flags & FLAG_PREPEND_PLUS_SIGN) {
-		*outstr = '+';
-		outstr++;
-		sign_prepended = true;
+		sign = '+';
 	}
+	bool sign_prepended = (sign != '\0');
 
-	// base of the numeral system
-	int base = 10; // for safety...
-	if (fmt->type == UNSIGNED_INTEGER || fmt->type == SIGNED_INTEGER) {
-		base = 10;
-	} else if (fmt->type == UNSIGNED_HEXADECIMAL_INT || fmt->type == UNSIGNED_HEXADECIMAL_INT_UPPERCASE) {
-		base = 16;
+	// get padding if requested
+	int pad_n = 0;
+	char pad_c = ' ';
+	if (fmt->width != -1 && (fmt->flags & FLAG_LEADING_ZEROS || fmt->flags & FLAG_LEADING_SPACES)) {
+		pad_n = MAX(fmt->width - digits - sign_prepended, 0);
+		pad_n = MIN(pad_n, INT_PRINT_OUTBUF_SIZE - digits - sign_prepended); // clip to the buffer
+		pad_c = (fmt->flags & FLAG_LEADING_ZEROS) ? '0' : ' ';
 	}
 
-	// get number of digits the number consists of
-	uint64_t gntpd;
-	int digits = scientific_form_exponent(u, base, &gntpd) + 1;
-
-	// convert int to string
-	while (gntpd > 0) {
-		uint64_t place_value = (u / gntpd); // integer division!
-		u -= place_value * gntpd; // substract value corresponding to the place
-
-		if (fmt->type == UNSIGNED_HEXADECIMAL_INT_UPPERCASE && place_value > 9) {
-			place_value += 6;
-		}
-		*outstr = sNumChars[place_value]; // print place value string
-
-		gntpd /= base; // divide by the base (advance to lower place)
-		outstr++; // advance in the string
-		*outstr = '\0'; // move the terminating zero
+	// assemble: pad differently based on padding character: -00000nnn or _____-nnn
+	if (sign_prepended && pad_c == '0') {
+		*outstr++ = sign;
 	}
-
-	// pad with zeros if requested
-	if (fmt->width != -1 && (fmt->flags & FLAG_LEADING_ZEROS || fmt->flags & FLAG_LEADING_SPACES)) {
-		int pad_n = MAX(fmt->width - digits - sign_prepended, 0);
-		if (pad_n > 0) {
-			// pad differently based on padding character
-			if (fmt->flags & FLAG_LEADING_ZEROS) { // -00000nnn
-				insert_leading_characters(outstrbuf + sign_prepended, INT_PRINT_OUTBUF_SIZE - sign_prepended, '0', pad_n); // insert leading characters
-			} else if (fmt->flags & FLAG_LEADING_SPACES) { // _____-nnn
-				insert_leading_characters(outstrbuf, INT_PRINT_OUTBUF_SIZE, ' ', pad_n); // insert leading characters
-			}
-			outstr += pad_n; // advance pointer to the end of the string
-		}
+	for (int i = 0; i < pad_n; i++) {
+		*outstr++ = pad_c;
 	}
+	if (sign_prepended && pad_c != '0') {
+		*outstr++ = sign;
+	}
+	for (char *iter = digits_start; iter < digits_end; iter++) {
+		*outstr++ = *iter;
+	}
+	*outstr = '\0';
 
 	// copy string to output
 	int copy_len = string_copy(outbuf, outstrbuf, free_space);
 	return copy_len;
 }
 
-static int pfn_integer(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space) {
+static int pfn_integer(FmtArgs *args, FmtWord *fmt, char *outbuf, size_t free_space) {
 	uint64_t u = 0;
 	bool negative = false;
 	if (fmt->type == SIGNED_INTEGER) { // for signed integers
 		int64_t si;
 		if (fmt->length == LEN_NORMAL) { // ...without length specifiers
-			si = va_arg((*va), int);
+			si = (int) arg_u32(args);
 		} else { // ...with length specifiers
-			si = va_arg((*va), int64_t);
+			si = (int64_t) arg_u64(args);
 		}
 
 		// absolute value
@@ -226,10 +306,10 @@ static int pfn_integer(va_list *va, FmtWord *fmt, char *outbuf, size_t free_spac
 		}
 	} else if (fmt->type == UNSIGNED_INTEGER || fmt->type == UNSIGNED_HEXADECIMAL_INT || fmt->type == UNSIGNED_HEXADECIMAL_INT_UPPERCASE) { // for UNsigned integers
 		if (fmt->length == LEN_NORMAL) { // ...without length specifiers
-			unsigned int d = va_arg((*va), unsigned int);
+			unsigned int d = arg_u32(args);
 			u = d;
 		} else { // ...with length specifiers
-			u = va_arg((*va), uint64_t);
+			u = arg_u64(args);
 		}
 	}
 
@@ -240,9 +320,9 @@ static int pfn_integer(va_list *va, FmtWord *fmt, char *outbuf, size_t free_spac
 
 #define DECIMAL_POINT ('.')
 
-static int pfn_double(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space) {
+static int pfn_double(FmtArgs *args, FmtWord *fmt, char *outbuf, size_t free_space) {
 	// get passed double variable
-	double d = va_arg((*va), double);
+	double d = arg_double(args);
 	bool negative = d < 0;
 	if (negative) {
 		d *= -1;
@@ -299,7 +379,7 @@ static int pfn_double(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space
         }
 
         // extract fractional part as integer
-		d_frac *= (double) power(10, fmt->precision - leading_zeros_printed + 1); // get one more digit
+		d_frac *= (double) power_of_ten(fmt->precision - leading_zeros_printed + 1); // get one more digit
 		uint64_t frac_part = (uint64_t) d_frac;
 		frac_part = round_to_base(frac_part, 10) / 10; // remove last zero digit (result of rounding)
 
@@ -333,9 +413,52 @@ static int pfn_double(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space
 	return sum_copy_len;
 }
 
+#define TIMESTAMP_FRAC_DIGITS (9)
+
+// print a PTP timestamp as seconds.nanoseconds using integer arithmetics only
+// %T: (uint32_t sec, uint32_t nsec), %lT: (int64_t sec, int32_t nsec), negative if any of the two parts is negative
+// flags and width apply to the seconds, precision selects the number of fractional digits (default: 9, truncated)
+static int pfn_timestamp(FmtArgs *args, FmtWord *fmt, char *outbuf, size_t free_space) {
+	uint64_t sec;
+	uint32_t nsec;
+	bool negative = false;
+	if (fmt->length == LEN_NORMAL) {
+		sec = arg_u32(args);
+		nsec = arg_u32(args);
+	} else {
+		int64_t ssec = (int64_t) arg_u64(args);
+		int32_t snsec = (int) arg_u32(args);
+		negative = (ssec < 0) || (snsec < 0);
+		sec = (ssec < 0) ? -ssec : ssec;
+		nsec = (snsec < 0) ? -snsec : snsec;
+	}
+
+	// normalize
+	if (nsec >= NSEC_PER_SEC) {
+		sec += nsec / NSEC_PER_SEC;
+		nsec %= NSEC_PER_SEC;
+	}
+
+	// integer part
+	char buf[INT_PRINT_OUTBUF_SIZE + TIMESTAMP_FRAC_DIGITS + 2];
+	FmtWord int_fmt = { .flags = fmt->flags, .type = UNSIGNED_INTEGER, .width = fmt->width };
+	int len = print_number(sec, negative, &int_fmt, buf, INT_PRINT_OUTBUF_SIZE);
+
+	// fractional part
+	int frac_digits = fmt->precision_given ? MIN(MAX(fmt->precision, 0), TIMESTAMP_FRAC_DIGITS) : TIMESTAMP_FRAC_DIGITS;
+	if (frac_digits > 0) {
+		buf[len] = DECIMAL_POINT;
+		u32_to_dec_fixed(nsec, buf + len + 1 + TIMESTAMP_FRAC_DIGITS, TIMESTAMP_FRAC_DIGITS);
+		len += 1 + frac_digits;
+	}
+	buf[len] = '\0';
+
+	return string_copy(outbuf, buf, free_space);
+}
+
 // print character
-static int pfn_char(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space) {
-	int c = va_arg((*va), int);
+static int pfn_char(FmtArgs *args, FmtWord *fmt, char *outbuf, size_t free_space) {
+	int c = (int) arg_u32(args);
 	if (free_space >= 1) {
 		outbuf[0] = (char) c;
 		outbuf[1] = '\0';
@@ -344,15 +467,15 @@ static int pfn_char(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space)
 }
 
 // print string
-static int pfn_string(va_list *va, FmtWord *fmt, char *outbuf, size_t free_space) {
-	char *str = va_arg((*va), char*);
+static int pfn_string(FmtArgs *args, FmtWord *fmt, char *outbuf, size_t free_space) {
+	char *str = arg_str(args);
 	return string_copy(outbuf, str, free_space);
 }
 
 // format swting assignment table
 static FmtTypeDesignatorPair sTypeDesAssignment[] = { { '%', LITERAL_PERCENT, pfn_literal_percent }, { 'd', SIGNED_INTEGER, pfn_integer }, { 'i', SIGNED_INTEGER, pfn_integer }, { 'u',
 		UNSIGNED_INTEGER, pfn_integer }, { 'f', DOUBLE, pfn_double }, { 'e', DOUBLE_EXPONENTIAL, pfn_double }, { 'x', UNSIGNED_HEXADECIMAL_INT, pfn_integer }, { 'X',
-		UNSIGNED_HEXADECIMAL_INT_UPPERCASE, pfn_integer }, { 's', STRING, pfn_string }, { 'c', CHARACTER, pfn_char }, { '\0', UNKNOWN } // termination
+		UNSIGNED_HEXADECIMAL_INT_UPPERCASE, pfn_integer }, { 's', STRING, pfn_string }, { 'c', CHARACTER, pfn_char }, { 'T', TIMESTAMP, pfn_timestamp }, { '\0', UNKNOWN } // termination
 };
 
 // ------------------------------------------------------------
@@ -376,23 +499,6 @@ static char* fetch_number(char *str, int *num) {
 	return end;
 }
 
-// get number of arguments from the format string
-static int get_number_of_arguments_by_format_string(char *format_str) {
-	char *iter = format_str;
-	int cnt = 0;
-	while (*iter != '\0') {
-		if (*iter == FORMAT_DELIMITER) {
-			if (*(iter + 1) == '%') { // filter out '%%' literals
-				iter++;
-			} else {
-				cnt++;
-			}
-		}
-		iter++;
-	}
-	return cnt;
-}
-
 // seek for format delimiter ('%')
 static char* seek_delimiter(char *str) {
 	// iterate over characters until either '%' is found or end of string is reached
@@ -511,9 +617,11 @@ static int process_format_word(char *str, FmtWord *word, int *rewind) {
 
 	// 3.: look for precision
 	word->precision = DEFAULT_PRINT_PRECISION; // default double precision
+	word->precision_given = false;
 	if (*str == '.') {
 		str++;
 		str = fetch_number(str, &(word->precision));
+		word->precision_given = true;
 	}
 
 	// 4.: look for length
@@ -537,55 +645,407 @@ static int process_format_word(char *str, FmtWord *word, int *rewind) {
 
 #define MAX_FORMAT_WORD_LEN (15)
 
+// parse the next piece of the format string: literal text and the conversion following it
+// text: unprocessed format string
+// op: output descriptor
+// return: pointer to the unprocessed text OR NULL if no conversion was found (op holds the trailing text)
+static char* parse_op(char *text, EmbFmtOp *op) {
+	char word_str[MAX_FORMAT_WORD_LEN + 1];
+	char *word_begin;
+	char *unproc_text_next = (*text != '\0') ? fetch_format_word(text, word_str, &word_begin, MAX_FORMAT_WORD_LEN) : NULL;
+
+	op->literal = text;
+	op->conv = EMBFMT_CONV_NONE;
+
+	if (unproc_text_next == NULL) {
+		op->literal_len = string_length(text);
+		return NULL;
+	}
+
+	// text preceding the '%'
+	op->literal_len = (word_begin - 1) - text;
+
+	// the conversion
+	FmtWord word;
+	int rewind;
+	process_format_word(word_str, &word, &rewind);
+	if (word.type != UNKNOWN) {
+		op->conv = word.pTypeDes - sTypeDesAssignment;
+		op->flags = word.flags;
+		op->width = word.width;
+		op->precision = word.precision;
+		op->length = word.length;
+		op->precision_given = word.precision_given;
+	}
+
+	// some characters may have been considered wrongly as being part of the format word
+	return unproc_text_next - rewind;
+}
+
+// render a descriptor
+// return: number of characters printed
+static long int render_op(const EmbFmtOp *op, FmtArgs *args, char *str, long int free_space) {
+	// print preceding text
+	long int copy_len = MIN((long int) op->literal_len, free_space);
+	for (long int i = 0; i < copy_len; i++) {
+		str[i] = op->literal[i];
+	}
+	str[copy_len] = '\0';
+	free_space -= copy_len;
+	str += copy_len;
+
+	// print data
+	if (op->conv != EMBFMT_CONV_NONE) {
+		FmtWord word = { .flags = op->flags, .width = op->width, .precision = op->precision, .precision_given = op->precision_given, .length = op->length };
+		word.pTypeDes = sTypeDesAssignment + op->conv;
+		word.type = word.pTypeDes->type;
+		copy_len += word.pTypeDes->fn(args, &word, str, free_space);
+	}
+
+	return copy_len;
+}
+
 unsigned long int vembfmt(char *str, unsigned long int len, char *format, va_list args) {
 	// process format string
 	long int free_space = len;
 	char *unproc_text = format;
-	char *unproc_text_next = NULL;
-	char word_str[MAX_FORMAT_WORD_LEN + 1];
-	char *word_begin;
 	size_t sum_copy_len = 0;
-	while ((*unproc_text) && (unproc_text_next = fetch_format_word(unproc_text, word_str, &word_begin, MAX_FORMAT_WORD_LEN)) && free_space > 0) {
-		// print preceding text
-		word_begin--;
-		int copy_len = MIN((word_begin - unproc_text), free_space);
-		string_copy(str, unproc_text, copy_len);
+
+	// va_list may be an array type (e.g. on x86-64), taking the address of the
+	// parameter would not yield a va_list pointer, work on a local copy
+	FmtArgs fa = { .words = NULL };
+	va_copy(fa.va, args);
+
+	EmbFmtOp op;
+	while (((unproc_text = parse_op(unproc_text, &op)) != NULL) && free_space > 0) {
+		long int copy_len = render_op(&op, &fa, str, free_space);
 		free_space -= copy_len;
 		str += copy_len;
 		sum_copy_len += copy_len;
+	}
 
-		// print data
-		FmtWord word;
-		int rewind;
-		process_format_word(word_str, &word, &rewind);
-		if (word.type != UNKNOWN) {
-			int copy_len = word.pTypeDes->fn(&args, &word, str, free_space); // variable with the same name!
-			free_space -= copy_len;
-			str += copy_len;
-			sum_copy_len += copy_len;
-		}
+	// also copy last part of the string not containing any formatting sequences
+	// (op holds the trailing text, or the piece that did not fit)
+	sum_copy_len += string_copy(str, op.literal, MAX(free_space, 0));
+
+	va_end(fa.va);
+
+	return sum_copy_len;
+}
+
+unsigned long int embfmt(char *str, unsigned long int len, char *format, ...) {
+	va_list args;
+	va_start(args, format);
+
+	unsigned long int copy_len = vembfmt(str, len, format, args);
+
+	va_end(args);
+	return copy_len;
+}
 
-		// advance pointer in unprocessed text
-		unproc_text = unproc_text_next - rewind;
+// ------------------------------------------------------------
+
+static EmbFmtOp sOpArena[EMBFMT_OP_ARENA_LEN]; // descriptor storage
+static uint32_t sOpArenaUsed = 0; // number of descriptors allocated
+
+int embfmt_compile(EmbFmtCompiled *cf, char *format) {
+	// count the descriptors
+	EmbFmtOp op;
+	uint32_t op_cnt = 1; // the trailing text
+	for (char *iter = format; (iter = parse_op(iter, &op)) != NULL;) {
+		op_cnt++;
 	}
 
-	// also copy last part of the string not containing any formatting sequences
-	if (unproc_text != NULL) {
-		sum_copy_len += string_copy(str, unproc_text, free_space);
+	// allocate
+	uint32_t first = __atomic_fetch_add(&sOpArenaUsed, op_cnt, __ATOMIC_RELAXED);
+	if (first + op_cnt > EMBFMT_OP_ARENA_LEN) {
+		return -1; // the arena is not given back, later (shorter) formats won't fit either
 	}
 
+	// fill in
+	EmbFmtOp *ops = sOpArena + first;
+	char *iter = format;
+	for (uint32_t i = 0; i < op_cnt; i++) {
+		iter = parse_op(iter, ops + i);
+	}
+
+	cf->format = format;
+	cf->ops = ops;
+	cf->op_cnt = op_cnt;
+
+	return 0;
+}
+
+unsigned long int vembfmt_compiled(char *str, unsigned long int len, const EmbFmtCompiled *cf, va_list args) {
+	long int free_space = len;
+	size_t sum_copy_len = 0;
+
+	FmtArgs fa = { .words = NULL };
+	va_copy(fa.va, args);
+
+	// same semantics as of vembfmt()
+	const EmbFmtOp *op = cf->ops;
+	const EmbFmtOp *last = cf->ops + cf->op_cnt - 1;
+	for (; op < last && free_space > 0; op++) {
+		long int copy_len = render_op(op, &fa, str, free_space);
+		free_space -= copy_len;
+		str += copy_len;
+		sum_copy_len += copy_len;
+	}
+
+	long int copy_len = MIN((long int) op->literal_len, MAX(free_space, 0));
+	for (long int i = 0; i < copy_len; i++) {
+		str[i] = op->literal[i];
+	}
+	str[copy_len] = '\0';
+	sum_copy_len += copy_len;
+
+	va_end(fa.va);
+
 	return sum_copy_len;
 }
 
-unsigned long int embfmt(char *str, unsigned long int len, char *format, ...) {
-	// get number of expected arguments and initiate va_list usage
-	int argc = get_number_of_arguments_by_format_string(format);
+unsigned long int embfmt_compiled(char *str, unsigned long int len, const EmbFmtCompiled *cf, ...) {
+	va_list args;
+	va_start(args, cf);
+
+	unsigned long int copy_len = vembfmt_compiled(str, len, cf, args);
+
+	va_end(args);
+	return copy_len;
+}
+
+// states of a cache
+enum {
+	CACHE_EMPTY = 0, CACHE_COMPILING, CACHE_READY, CACHE_FAILED
+};
+
+int embfmt_cache_lookup(EmbFmtCompiled *cache, char *format) {
+	// the first caller compiles, concurrent callers fall back to parsing meanwhile
+	uint8_t state = __atomic_load_n(&cache->state, __ATOMIC_ACQUIRE);
+	if (state == CACHE_EMPTY) {
+		uint8_t expected = CACHE_EMPTY;
+		if (__atomic_compare_exchange_n(&cache->state, &expected, CACHE_COMPILING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			state = (embfmt_compile(cache, format) == 0) ? CACHE_READY : CACHE_FAILED;
+			__atomic_store_n(&cache->state, state, __ATOMIC_RELEASE);
+		}
+	}
 
+	return (state == CACHE_READY && cache->format == format) ? 0 : -1;
+}
+
+unsigned long int vembfmt_cached(EmbFmtCompiled *cache, char *str, unsigned long int len, char *format, va_list args) {
+	if (embfmt_cache_lookup(cache, format) == 0) {
+		return vembfmt_compiled(str, len, cache, args);
+	} else {
+		return vembfmt(str, len, format, args);
+	}
+}
+
+unsigned long int embfmt_cached(EmbFmtCompiled *cache, char *str, unsigned long int len, char *format, ...) {
 	va_list args;
 	va_start(args, format);
 
-	unsigned long int copy_len = vembfmt(str, len, format, args);
+	unsigned long int copy_len = vembfmt_cached(cache, str, len, format, args);
 
 	va_end(args);
 	return copy_len;
 }
+
+// ------------------------------------------------------------
+
+// render a descriptor into a sink
+// return: number of characters passed
+static unsigned long int render_op_sink(const EmbFmtOp *op, FmtArgs *args, EmbFmtSink sink, void *arg) {
+	unsigned long int sum_len = op->literal_len;
+
+	// pass preceding text in place
+	if (op->literal_len > 0) {
+		sink(arg, op->literal, op->literal_len);
+	}
+
+	if (op->conv == EMBFMT_CONV_NONE) {
+		return sum_len;
+	}
+
+	FmtWord word = { .flags = op->flags, .width = op->width, .precision = op->precision, .precision_given = op->precision_given, .length = op->length };
+	word.pTypeDes = sTypeDesAssignment + op->conv;
+	word.type = word.pTypeDes->type;
+
+	unsigned long int conv_len;
+	if (word.type == STRING) { // strings are passed in place as well
+		const char *str = arg_str(args);
+		conv_len = string_length((char*) str);
+		if (conv_len > 0) {
+			sink(arg, str, conv_len);
+		}
+	} else {
+		char buf[EMBFMT_SINK_CONV_BUF_LEN + 1];
+		int print_len = word.pTypeDes->fn(args, &word, buf, EMBFMT_SINK_CONV_BUF_LEN);
+		conv_len = MIN((unsigned long int) print_len, EMBFMT_SINK_CONV_BUF_LEN);
+		sink(arg, buf, conv_len);
+	}
+
+	return sum_len + conv_len;
+}
+
+unsigned long int vembfmt_sink(EmbFmtSink sink, void *arg, char *format, va_list args) {
+	FmtArgs fa = { .words = NULL };
+	va_copy(fa.va, args);
+
+	unsigned long int sum_len = 0;
+	char *unproc_text = format;
+	EmbFmtOp op;
+	do {
+		unproc_text = parse_op(unproc_text, &op);
+		sum_len += render_op_sink(&op, &fa, sink, arg); // the last descriptor holds the trailing text
+	} while (unproc_text != NULL);
+
+	va_end(fa.va);
+
+	return sum_len;
+}
+
+unsigned long int vembfmt_compiled_sink(EmbFmtSink sink, void *arg, const EmbFmtCompiled *cf, va_list args) {
+	FmtArgs fa = { .words = NULL };
+	va_copy(fa.va, args);
+
+	unsigned long int sum_len = 0;
+	for (uint16_t i = 0; i < cf->op_cnt; i++) {
+		sum_len += render_op_sink(cf->ops + i, &fa, sink, arg);
+	}
+
+	va_end(fa.va);
+
+	return sum_len;
+}
+
+unsigned long int vembfmt_cached_sink(EmbFmtCompiled *cache, EmbFmtSink sink, void *arg, char *format, va_list args) {
+	if (embfmt_cache_lookup(cache, format) == 0) {
+		return vembfmt_compiled_sink(sink, arg, cache, args);
+	} else {
+		return vembfmt_sink(sink, arg, format, args);
+	}
+}
+
+// ------------------------------------------------------------
+
+// number of words taken by the argument(s) of a conversion (strings: the word count only)
+static int capture_word_cnt(const EmbFmtOp *op) {
+	switch (sTypeDesAssignment[op->conv].type) {
+	case LITERAL_PERCENT:
+		return 0;
+	case STRING:
+	case CHARACTER:
+		return 1;
+	case DOUBLE:
+	case DOUBLE_EXPONENTIAL:
+		return 2;
+	case TIMESTAMP:
+		return (op->length == LEN_NORMAL) ? 2 : 3;
+	default: // integers
+		return (op->length == LEN_NORMAL) ? 1 : 2;
+	}
+}
+
+// store a value in one or two words
+static void capture_put(uint32_t **iter, uint64_t value, int word_cnt) {
+	*((*iter)++) = (uint32_t) value;
+	if (word_cnt > 1) {
+		*((*iter)++) = (uint32_t) (value >> 32);
+	}
+}
+
+// store a string in place: number of words, then the characters including the '\0'
+// room: number of words the characters may occupy
+static void capture_str(uint32_t **iter, const char *str, size_t room) {
+	if (room == 0) {
+		*((*iter)++) = 0; // printed as an empty string
+		return;
+	}
+
+	size_t copy_len = MIN(string_length((char*) str), room * sizeof(uint32_t) - 1);
+	uint32_t word_cnt = (copy_len + sizeof(uint32_t)) / sizeof(uint32_t); // the '\0' included
+	*((*iter)++) = word_cnt;
+	memcpy(*iter, str, copy_len);
+	((char*) (*iter))[copy_len] = '\0';
+	*iter += word_cnt;
+}
+
+int embfmt_capture(const EmbFmtCompiled *cf, uint32_t *words, unsigned long int max_words, va_list args) {
+	// words taken by the fixed size parts, strings get the rest of the room
+	unsigned long int fixed_cnt = 0;
+	for (uint16_t i = 0; i < cf->op_cnt; i++) {
+		if (cf->ops[i].conv != EMBFMT_CONV_NONE) {
+			fixed_cnt += capture_word_cnt(cf->ops + i);
+		}
+	}
+	if (fixed_cnt > max_words) {
+		return -1;
+	}
+
+	va_list va;
+	va_copy(va, args);
+
+	uint32_t *iter = words;
+	for (uint16_t i = 0; i < cf->op_cnt; i++) {
+		const EmbFmtOp *op = cf->ops + i;
+		if (op->conv == EMBFMT_CONV_NONE) {
+			continue;
+		}
+
+		fixed_cnt -= capture_word_cnt(op);
+
+		// fetch the arguments the same way as the printing functions do
+		switch (sTypeDesAssignment[op->conv].type) {
+		case LITERAL_PERCENT:
+			break;
+		case STRING: {
+			size_t room = max_words - (iter - words) - fixed_cnt - 1;
+			capture_str(&iter, va_arg(va, const char*), room);
+			break;
+		}
+		case DOUBLE:
+		case DOUBLE_EXPONENTIAL: {
+			double d = va_arg(va, double);
+			uint64_t u;
+			memcpy(&u, &d, sizeof(double));
+			capture_put(&iter, u, 2);
+			break;
+		}
+		case TIMESTAMP:
+			if (op->length == LEN_NORMAL) {
+				capture_put(&iter, va_arg(va, unsigned int), 1);
+			} else {
+				capture_put(&iter, va_arg(va, uint64_t), 2);
+			}
+			capture_put(&iter, va_arg(va, unsigned int), 1);
+			break;
+		case CHARACTER:
+			capture_put(&iter, va_arg(va, unsigned int), 1);
+			break;
+		default: // integers
+			if (op->length == LEN_NORMAL) {
+				capture_put(&iter, va_arg(va, unsigned int), 1);
+			} else {
+				capture_put(&iter, va_arg(va, uint64_t), 2);
+			}
+			break;
+		}
+	}
+
+	va_end(va);
+
+	return iter - words;
+}
+
+unsigned long int embfmt_render_captured_sink(EmbFmtSink sink, void *arg, const EmbFmtCompiled *cf, const uint32_t *words, unsigned long int word_cnt) {
+	FmtArgs fa = { .words = words, .words_end = words + word_cnt };
+
+	unsigned long int sum_len = 0;
+	for (uint16_t i = 0; i < cf->op_cnt; i++) {
+		sum_len += render_op_sink(cf->ops + i, &fa, sink, arg);
+	}
+
+	return sum_len;
+}
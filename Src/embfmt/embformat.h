@@ -4,8 +4,82 @@
 #define EMBFORMAT_EMBFORMAT_H
 
 #include <stdarg.h>
+#include <stdint.h>
+
+// Supported conversions: %d %i %u %x %X (l: 64-bit), %f %e, %s, %c, %% and
+// %T for PTP timestamps: (uint32_t sec, uint32_t nsec) printed as sec.nnnnnnnnn,
+// %lT takes (int64_t sec, int32_t nsec), precision sets the number of fractional digits.
 
 unsigned long int vembfmt(char *str, unsigned long int len, char *format, va_list args);
 unsigned long int embfmt(char *str, unsigned long int len, char *format, ...);
 
+// Compiled formats: a format string is parsed once into a sequence of
+// descriptors (a literal text and the conversion following it), rendering
+// from them involves no parsing. Descriptors are allocated from a static
+// arena and never freed: compile format strings of static storage only.
+
+#ifndef EMBFMT_OP_ARENA_LEN
+#define EMBFMT_OP_ARENA_LEN (256) // number of descriptors that can be allocated
+#endif
+
+#define EMBFMT_CONV_NONE (0xFF) // the descriptor holds literal text only
+
+// descriptor: literal text and the conversion following it
+typedef struct {
+	const char *literal; // literal text
+	uint16_t literal_len; // length of the literal text
+	uint8_t conv; // conversion (index in the conversion table) or EMBFMT_CONV_NONE
+	uint8_t flags; // conversion flags
+	int16_t width; // field width, -1 if not given
+	int16_t precision; // precision
+	uint8_t length; // length modifier
+	uint8_t precision_given; // precision was given explicitly
+} EmbFmtOp;
+
+// compiled format
+typedef struct {
+	const char *format; // the source format string
+	EmbFmtOp *ops; // descriptors, the last one holds the trailing text
+	uint16_t op_cnt; // number of descriptors
+	volatile uint8_t state; // compilation state (used by the cached variants)
+} EmbFmtCompiled;
+
+int embfmt_compile(EmbFmtCompiled *cf, char *format); // compile a format string, returns 0 on success, -1 if the arena is exhausted
+unsigned long int vembfmt_compiled(char *str, unsigned long int len, const EmbFmtCompiled *cf, va_list args);
+unsigned long int embfmt_compiled(char *str, unsigned long int len, const EmbFmtCompiled *cf, ...);
+
+// Cached variants: the format is compiled on the first call into the passed
+// (zero-initialized) cache. Formats not matching the cached one and formats
+// that could not be compiled are processed by vembfmt().
+int embfmt_cache_lookup(EmbFmtCompiled *cache, char *format); // compile into the cache on the first call, returns 0 if the cache holds the format, -1 otherwise
+unsigned long int vembfmt_cached(EmbFmtCompiled *cache, char *str, unsigned long int len, char *format, va_list args);
+unsigned long int embfmt_cached(EmbFmtCompiled *cache, char *str, unsigned long int len, char *format, ...);
+
+// embfmt() with a format cache per call site
+#define EMBFMT_CACHED(str, len, format, ...) ({ \
+	static EmbFmtCompiled embfmt_cache_; \
+	embfmt_cached(&embfmt_cache_, (str), (len), (format), ##__VA_ARGS__); })
+
+// Sink mode: instead of filling a buffer, the output is passed in pieces to a
+// callback as it gets produced. Literal text and string arguments are passed
+// in place, the other conversions are rendered into a small buffer on the
+// stack first. The output length is not limited, no terminating '\0' is passed.
+
+#ifndef EMBFMT_SINK_CONV_BUF_LEN
+#define EMBFMT_SINK_CONV_BUF_LEN (63) // maximal length of a single conversion (except strings) in sink mode
+#endif
+
+typedef void (*EmbFmtSink)(void *arg, const char *chunk, unsigned long int len); // output callback
+
+unsigned long int vembfmt_sink(EmbFmtSink sink, void *arg, char *format, va_list args);
+unsigned long int vembfmt_compiled_sink(EmbFmtSink sink, void *arg, const EmbFmtCompiled *cf, va_list args);
+unsigned long int vembfmt_cached_sink(EmbFmtCompiled *cache, EmbFmtSink sink, void *arg, char *format, va_list args);
+
+// Captured arguments: the arguments of a compiled format are copied into an
+// array of words, to be rendered later (e.g. deferred logging). Numbers are
+// stored as raw words, string arguments are copied in place (truncated if
+// the array is short of space).
+int embfmt_capture(const EmbFmtCompiled *cf, uint32_t *words, unsigned long int max_words, va_list args); // capture arguments, returns the number of words used, -1 if they do not fit
+unsigned long int embfmt_render_captured_sink(EmbFmtSink sink, void *arg, const EmbFmtCompiled *cf, const uint32_t *words, unsigned long int word_cnt); // render a format with captured arguments into a sink
+
 #endif //EMBFORMAT_EMBFORMAT_H
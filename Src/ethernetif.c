@@ -25,7 +25,11 @@
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
 #include "lwip/tcpip.h"
+#include "lwip/sys.h"
 #include "ethernetif.h"
+#include "tx_cpl_ring.h"
+#include "pkt_trace.h"
+#include "dlog.h"
 #include "../Components/lan8742/lan8742.h"
 #include <string.h>
 
@@ -44,8 +48,46 @@
 
 #define ETH_RX_BUFFER_SIZE                     (1536UL)
 
+#if ETH_RX_BUFFER_CNT <= ETH_RX_DESC_CNT
+#error "ETH_RX_BUFFER_CNT must be larger than ETH_RX_DESC_CNT!"
+#endif
+
+/* Rx batching: the interface thread fetches at most ETH_RX_BATCH_BUDGET frames per
+   wakeup, rebuilds the released descriptors in one pass and passes the frames to
+   the tcpip thread in a single message. If the budget is exhausted, the thread
+   sleeps ETH_RX_BATCH_BACKOFF ticks, so a frame flood cannot starve lower
+   priority tasks. ETH_RX_BATCH_MODE 0 selects frame-by-frame operation. */
+#ifndef ETH_RX_BATCH_MODE
+#define ETH_RX_BATCH_MODE                      (1)
+#endif
+#ifndef ETH_RX_BATCH_BUDGET
+#define ETH_RX_BATCH_BUDGET                    (8)
+#endif
+#ifndef ETH_RX_BATCH_BACKOFF
+#define ETH_RX_BATCH_BACKOFF                   (1)
+#endif
+
+#if ETH_RX_BATCH_MODE == 1
+/* Number of batches that can be queued towards the tcpip thread */
+#define ETH_RX_BATCH_CNT                       (3)
+/* Released Rx descriptors are rebuilt early if half of the ring is waiting */
+#define ETH_RX_REBUILD_THRESHOLD               (ETH_RX_DESC_CNT / 2)
+#else
+#define ETH_RX_REBUILD_THRESHOLD               (1)
+#endif
+
+/* The time to block waiting for free Tx descriptors. */
 #define ETH_DMA_TRANSMIT_TIMEOUT                (20U)
 
+/* PTP message fields used by the one-step Sync conversion */
+#define PTP_MSG_TYPE_SYNC                      (0x0)
+#define PTP_MSG_TYPE_FOLLOW_UP                 (0x8)
+#define PTP_MSG_FLAGS_OFFSET                   (6)     /* first octet of the flagField */
+#define PTP_MSG_FLAG_TWO_STEP                  (0x02)  /* twoStepFlag */
+#define PTP_MSG_SEQID_OFFSET                   (30)
+#define PTP_MSG_ORIGIN_TS_OFFSET               (34)    /* originTimestamp of Sync messages */
+#define PTP_MSG_SYNC_LEN                       (44)    /* length of Sync and Follow_Up messages */
+
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 /* 
@@ -56,43 +98,88 @@
           then passed to ETH HAL driver.
 
 @Notes: 
-  1.a. ETH DMA Rx descriptors must be contiguous, the default count is 4, 
+  1.a. ETH DMA Rx descriptors must be contiguous, the default count is 12, 
        to customize it please redefine ETH_RX_DESC_CNT in stm32xxxx_hal_conf.h
-  1.b. ETH DMA Tx descriptors must be contiguous, the default count is 4, 
+  1.b. ETH DMA Tx descriptors must be contiguous, the default count is 8, 
        to customize it please redefine ETH_TX_DESC_CNT in stm32xxxx_hal_conf.h
+  1.c. Both descriptor rings are placed back-to-back at the start of D2 SRAM3 by
+       the linker script, in the region configured as Device memory by MPU_Config().
 
-  2.a. Rx Buffers number must be between ETH_RX_DESC_CNT and 2*ETH_RX_DESC_CNT
+  2.a. Rx Buffers number (ETH_RX_BUFFER_CNT) must be larger than ETH_RX_DESC_CNT,
+       the spare buffers replace the ones lent to the stack. A frame is dropped
+       and its buffer is given back to the DMA if no spare buffer is available.
   2.b. Rx Buffers must have the same size: ETH_RX_BUFFER_SIZE, this value must
        passed to ETH DMA in the init field (EthHandle.Init.RxBuffLen)
   2.c  The RX Ruffers addresses and sizes must be properly defined to be aligned
-       to L1-CACHE line size (32 bytes).
+       to L1-CACHE line size (32 bytes). They are placed into D2 SRAM1-2.
 */
 
 #if defined ( __ICCARM__ ) /*!< IAR Compiler */
 
-#pragma location=0x30040000
+#pragma location=".RxDecripSection"
 ETH_DMADescTypeDef  DMARxDscrTab[ETH_RX_DESC_CNT]; /* Ethernet Rx DMA Descriptors */
-#pragma location=0x30040060
+#pragma location=".TxDecripSection"
 ETH_DMADescTypeDef  DMATxDscrTab[ETH_TX_DESC_CNT]; /* Ethernet Tx DMA Descriptors */
-#pragma location=0x30040200
-uint8_t Rx_Buff[ETH_RX_DESC_CNT][ETH_RX_BUFFER_SIZE]; /* Ethernet Receive Buffers */
+#pragma location=".RxArraySection"
+uint8_t Rx_Buff[ETH_RX_BUFFER_CNT][ETH_RX_BUFFER_SIZE]; /* Ethernet Receive Buffers */
 
 #elif defined ( __CC_ARM )  /* MDK ARM Compiler */
 
 __attribute__((section(".RxDecripSection"))) ETH_DMADescTypeDef  DMARxDscrTab[ETH_RX_DESC_CNT]; /* Ethernet Rx DMA Descriptors */
 __attribute__((section(".TxDecripSection"))) ETH_DMADescTypeDef  DMATxDscrTab[ETH_TX_DESC_CNT]; /* Ethernet Tx DMA Descriptors */
-__attribute__((section(".RxArraySection"))) uint8_t Rx_Buff[ETH_RX_DESC_CNT][ETH_RX_BUFFER_SIZE]; /* Ethernet Receive Buffer */
+__attribute__((section(".RxArraySection"))) uint8_t Rx_Buff[ETH_RX_BUFFER_CNT][ETH_RX_BUFFER_SIZE]; /* Ethernet Receive Buffer */
 
 #elif defined ( __GNUC__ ) /* GNU Compiler */ 
 
 ETH_DMADescTypeDef DMARxDscrTab[ETH_RX_DESC_CNT] __attribute__((section(".RxDecripSection"))); /* Ethernet Rx DMA Descriptors */
 ETH_DMADescTypeDef DMATxDscrTab[ETH_TX_DESC_CNT] __attribute__((section(".TxDecripSection")));   /* Ethernet Tx DMA Descriptors */
-uint8_t Rx_Buff[ETH_RX_DESC_CNT][ETH_RX_BUFFER_SIZE] __attribute__((section(".RxArraySection"))); /* Ethernet Receive Buffers */
+uint8_t Rx_Buff[ETH_RX_BUFFER_CNT][ETH_RX_BUFFER_SIZE] __attribute__((section(".RxArraySection"), aligned(32))); /* Ethernet Receive Buffers */
 
 uint8_t LwIP_HEAP[20*1024] __attribute__((section(".LwIPHEAP"))); /* LwIP heap */
 
+#endif
+
 struct pbuf *ppWriteBackPBufs[ETH_TX_DESC_CNT]; /* pBuf array for timestamp writeback */
+static uint32_t TxTapRecs[ETH_TX_DESC_CNT]; /* frame tap record handles, stored along with ppWriteBackPBufs */
 
+/* Zero-copy Rx buffer, handed to the stack wrapped into a custom pbuf */
+typedef struct
+{
+  struct pbuf_custom pbuf_custom; /* must be the first field */
+  uint8_t * buff;                 /* the Rx_Buff entry */
+} RxBuff_t;
+
+static RxBuff_t RxBuffs[ETH_RX_BUFFER_CNT]; /* Rx buffer wrappers */
+static RxBuff_t * RxDescBuffs[ETH_RX_DESC_CNT]; /* Buffers attached to the Rx descriptors */
+static RxBuff_t * RxFreeBuffs[ETH_RX_BUFFER_CNT]; /* Spare buffers, neither owned by the DMA nor by the stack */
+static uint32_t RxFreeBuffCnt = 0; /* Number of spare Rx buffers */
+
+static EthIfStats IfStats; /* Drop counters */
+
+static volatile EthIfPtpRxHook PtpRxHook = NULL; /* Early Rx hook for PTP frames */
+
+static volatile bool PtpOneStep = false; /* Two-step Syncs are sent as one-step ones */
+static uint16_t PtpOneStepSeqId = 0; /* sequenceId of the last one-step Sync */
+static bool PtpOneStepSeqValid = false; /* the Follow_Up of the last one-step Sync is pending */
+
+static volatile EthIfTapFrameCb TapFrameCb = NULL; /* Frame tap */
+static volatile EthIfTapTxDoneCb TapTxDoneCb = NULL; /* Frame tap, Tx done callback */
+
+static struct netif * EthIfNetif = NULL; /* The interface served by this driver */
+
+static const uint8_t PtpL2DefaultAddr[ETH_HWADDR_LEN] = ETHIF_PTP_L2_DEFAULT_ADDR; /* PTP over 802.3, all messages except peer delay */
+static const uint8_t PtpL2PeerDelayAddr[ETH_HWADDR_LEN] = ETHIF_PTP_L2_PEER_DELAY_ADDR; /* PTP over 802.3, peer delay messages */
+
+#if ETH_RX_BATCH_MODE == 1
+/* Batch of received frames passed to the tcpip thread in a single message */
+typedef struct
+{
+  struct netif * netif;
+  uint32_t cnt;
+  struct pbuf * p[ETH_RX_BATCH_BUDGET];
+} RxBatch_t;
+
+LWIP_MEMPOOL_DECLARE(RX_BATCH_POOL, ETH_RX_BATCH_CNT, sizeof(RxBatch_t), "Rx frame batch pool");
 #endif
 
 ETH_HandleTypeDef EthHandle;
@@ -101,6 +188,21 @@ ETH_TxPacketConfig TxConfig;
 lan8742_Object_t LAN8742;
 
 osSemaphoreId RxPktSemaphore = NULL; /* Semaphore to signal incoming packets */
+osSemaphoreId TxPktSemaphore = NULL; /* Semaphore to signal released Tx descriptors */
+static SemaphoreHandle_t TxLock = NULL; /* Mutex serializing the writers of the Tx ring */
+
+/* Tx descriptor accounting, the counters are free-running */
+static volatile uint32_t TxDescQueued = 0; /* Descriptors handed over to the DMA (written by low_level_output()) */
+static volatile uint32_t TxDescDispatched = 0; /* Descriptors of completed frames already dispatched (written by the interface thread) */
+static uint32_t TxDescCollected = 0; /* Descriptors released by the DMA and collected (written by the Tx complete ISR) */
+static uint32_t TxCollectIdx = 0; /* Next Tx descriptor to collect (ISR only) */
+
+/* Tx completion records, pushed by the Tx complete ISR, consumed by the interface thread */
+#if (ETH_TX_DESC_CNT & (ETH_TX_DESC_CNT - 1)) != 0
+#error "The Tx completion ring requires ETH_TX_DESC_CNT to be a power of 2!"
+#endif
+static TxCompletion TxCplRecs[ETH_TX_DESC_CNT];
+static TxCplRing TxCpl = { TxCplRecs, ETH_TX_DESC_CNT, 0, 0, 0 };
 
 /* Private function prototypes -----------------------------------------------*/
 static void ethernetif_input( void const * argument );
@@ -120,41 +222,153 @@ lan8742_IOCtx_t  LAN8742_IOCtx = {ETH_PHY_IO_Init,
                                ETH_PHY_IO_ReadReg,
                                ETH_PHY_IO_GetTick};
 
-LWIP_MEMPOOL_DECLARE(RX_POOL, 10, sizeof(struct pbuf_custom), "Zero-copy RX PBUF pool");
-
-void ethernetif_write_back_tx_timestamps() {
-    /* store timestamps for transmitted frames */
-      for (size_t j = 0; j < ETH_TX_DESC_CNT; j++) {
-          ETH_DMADescTypeDef * pDesc = &DMATxDscrTab[j];
-          struct pbuf * pPBuf = ppWriteBackPBufs[j];
-
-          if ((pPBuf != NULL) && (!(pDesc->DESC3 & ETH_DMATXNDESCWBF_OWN)) && (pDesc->DESC3 & ETH_DMATXNDESCWBF_LD) && (pDesc->DESC3 & ETH_DMATXNDESCWBF_TTSS)) {
-              //MSG("* ");
-
-              pPBuf->time_s = pDesc->DESC1;
-              pPBuf->time_ns = pDesc->DESC0;
-              ppWriteBackPBufs[j] = NULL;
-              pDesc->DESC3 &= ~ETH_DMATXNDESCWBF_TTSS;
-
-              if (pPBuf->ts_writeback_addr[0] != NULL) {
-                  *pPBuf->ts_writeback_addr[0] = pPBuf->time_s;
-              }
-              if (pPBuf->ts_writeback_addr[1] != NULL) {
-                  *pPBuf->ts_writeback_addr[1] = pPBuf->time_ns;
-              }
-              if (pPBuf->tx_cb) {
-                  pPBuf->tx_cb(pPBuf);
-              }
-
-              pPBuf->tx_cb = NULL;
-              pPBuf->ts_writeback_addr[0] = NULL;
-              pPBuf->ts_writeback_addr[1] = NULL;
-          }
+/**
+  * @brief  Take a spare Rx buffer.
+  * @retval the buffer or NULL if all buffers are in use
+  */
+static RxBuff_t * rx_buff_alloc(void)
+{
+  RxBuff_t * pBuff = NULL;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  if (RxFreeBuffCnt > 0)
+  {
+    pBuff = RxFreeBuffs[--RxFreeBuffCnt];
+    if (RxFreeBuffCnt < IfStats.rxFreeBuffMin)
+    {
+      IfStats.rxFreeBuffMin = RxFreeBuffCnt;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  return pBuff;
+}
+
+/**
+  * @brief  Put back an Rx buffer to the spares.
+  * @param  pBuff: the buffer
+  * @retval None
+  */
+static void rx_buff_free(RxBuff_t * pBuff)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  RxFreeBuffs[RxFreeBuffCnt++] = pBuff;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/**
+  * @brief  Collect the Tx descriptors released by the DMA and push a completion
+  *         record for each finished frame. Called from the Tx complete ISR.
+  * @retval None
+  */
+static void ethernetif_tx_collect(void)
+{
+  while (TxDescCollected != TxDescQueued)
+  {
+    ETH_DMADescTypeDef * pDesc = &DMATxDscrTab[TxCollectIdx];
+    struct pbuf * pPBuf = ppWriteBackPBufs[TxCollectIdx];
+
+    /* stop at the first descriptor still owned by the DMA */
+    if (pDesc->DESC3 & ETH_DMATXNDESCWBF_OWN)
+    {
+      break;
+    }
+
+    /* a pbuf is only stored at the last descriptor of a frame */
+    TxCompletion * pCpl = tx_cpl_ring_collect(&TxCpl, pPBuf != NULL);
+    if (pCpl != NULL)
+    {
+      ppWriteBackPBufs[TxCollectIdx] = NULL;
+
+      pCpl->p = pPBuf;
+      pCpl->tapRec = TxTapRecs[TxCollectIdx];
+      pCpl->tsValid = (pDesc->DESC3 & ETH_DMATXNDESCWBF_TTSS) ? 1 : 0;
+      if (pCpl->tsValid)
+      {
+        pCpl->sec = pDesc->DESC1;
+        pCpl->nsec = pDesc->DESC0;
+        pDesc->DESC3 &= ~ETH_DMATXNDESCWBF_TTSS;
       }
+
+      tx_cpl_ring_publish(&TxCpl);
+    }
+
+    TxCollectIdx = (TxCollectIdx + 1) % ETH_TX_DESC_CNT;
+    TxDescCollected++;
+  }
+}
+
+/**
+  * @brief  Complete a transmitted frame: deliver the transmit timestamp, call the
+  *         Tx callbacks and release the pbuf referenced by low_level_output().
+  * @param  pCpl: completion record of the frame
+  * @param  pArg: unused
+  * @retval None
+  */
+static void ethernetif_tx_complete(const TxCompletion * pCpl, void * pArg)
+{
+  struct pbuf * pPBuf = (struct pbuf *) pCpl->p;
+
+  /* store timestamps for transmitted frames */
+  if (pCpl->tsValid)
+  {
+    pPBuf->time_s = pCpl->sec;
+    pPBuf->time_ns = pCpl->nsec;
+
+    if (pPBuf->ts_writeback_addr[0] != NULL) {
+      *pPBuf->ts_writeback_addr[0] = pPBuf->time_s;
+    }
+    if (pPBuf->ts_writeback_addr[1] != NULL) {
+      *pPBuf->ts_writeback_addr[1] = pPBuf->time_ns;
+    }
+    if (pPBuf->tx_cb) {
+      pPBuf->tx_cb(pPBuf);
+    }
+  }
+
+  pPBuf->tx_cb = NULL;
+  pPBuf->ts_writeback_addr[0] = NULL;
+  pPBuf->ts_writeback_addr[1] = NULL;
+
+  /* complete the captured copy of the frame */
+  if (pCpl->tapRec != 0)
+  {
+    EthIfTapTxDoneCb txDoneCb = TapTxDoneCb;
+    if (txDoneCb != NULL)
+    {
+      txDoneCb(pCpl->tapRec, pCpl->tsValid, pCpl->sec, pCpl->nsec);
+    }
+  }
+
+  /* drop the reference taken in low_level_output() */
+  pbuf_free(pPBuf);
+}
+
+/**
+  * @brief  Dispatch the Tx completion records and give back the descriptors of
+  *         the completed frames. Runs in the interface thread (pbuf_free() is not ISR-safe).
+  * @retval None
+  */
+static void ethernetif_tx_dispatch(void)
+{
+  uint32_t descCnt = tx_cpl_ring_dispatch(&TxCpl, ethernetif_tx_complete, NULL);
+
+  if (descCnt > 0)
+  {
+    /* the descriptors of the dispatched frames can be reused */
+    TxDescDispatched += descCnt;
+    osSemaphoreRelease(TxPktSemaphore);
+  }
 }
 
 void HAL_ETH_TxCpltCallback(ETH_HandleTypeDef * heth) {
-    ethernetif_write_back_tx_timestamps();
+  ethernetif_tx_collect();
+
+  /* let the interface thread dispatch the finished frames */
+  osSemaphoreRelease(RxPktSemaphore);
 }
 
 /* Private functions ---------------------------------------------------------*/
@@ -175,6 +389,8 @@ static void low_level_init(struct netif *netif)
   ETH_MACConfigTypeDef MACConf;
   uint8_t macaddress[6]= {ETH_MAC_ADDR0, ETH_MAC_ADDR1, ETH_MAC_ADDR2, ETH_MAC_ADDR3, ETH_MAC_ADDR4, ETH_MAC_ADDR5};
   
+  EthIfNetif = netif;
+
   EthHandle.Instance = ETH;  
   EthHandle.Init.MACAddr = macaddress;
   EthHandle.Init.MediaInterface = HAL_ETH_RMII_MODE;
@@ -203,13 +419,28 @@ static void low_level_init(struct netif *netif)
   /* don't set NETIF_FLAG_ETHARP if this device is not an ethernet one */
   netif->flags |= NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP;
   
-  for(idx = 0; idx < ETH_RX_DESC_CNT; idx ++)
+  /* attach the first buffers to the descriptors, keep the rest as spares */
+  for(idx = 0; idx < ETH_RX_BUFFER_CNT; idx ++)
   {
-    HAL_ETH_DescAssignMemory(&EthHandle, idx, Rx_Buff[idx], NULL);
+    RxBuffs[idx].buff = Rx_Buff[idx];
+    RxBuffs[idx].pbuf_custom.custom_free_function = pbuf_free_custom;
+
+    if (idx < ETH_RX_DESC_CNT)
+    {
+      RxDescBuffs[idx] = &RxBuffs[idx];
+      HAL_ETH_DescAssignMemory(&EthHandle, idx, Rx_Buff[idx], NULL);
+    }
+    else
+    {
+      RxFreeBuffs[RxFreeBuffCnt++] = &RxBuffs[idx];
+    }
   }
-  
-  /* Initialize the RX POOL */
-  LWIP_MEMPOOL_INIT(RX_POOL);
+  IfStats.rxFreeBuffMin = RxFreeBuffCnt;
+
+#if ETH_RX_BATCH_MODE == 1
+  /* Initialize the Rx batch pool */
+  LWIP_MEMPOOL_INIT(RX_BATCH_POOL);
+#endif
   
   memset(&TxConfig, 0 , sizeof(ETH_TxPacketConfig));  
   TxConfig.Attributes = ETH_TX_PACKETS_FEATURES_CSUM | ETH_TX_PACKETS_FEATURES_CRCPAD;
@@ -218,10 +449,19 @@ static void low_level_init(struct netif *netif)
    
   /* create a binary semaphore used for informing ethernetif of frame reception */
   RxPktSemaphore = xSemaphoreCreateBinary();
+
+  /* create a binary semaphore used for informing ethernetif of frame transmission */
+  TxPktSemaphore = xSemaphoreCreateBinary();
+
+  /* create the lock serializing the writers of the Tx ring */
+  TxLock = xSemaphoreCreateMutex();
   
   /* create the task that handles the ETH_MAC */
   osThreadDef(EthIf, ethernetif_input, osPriorityRealtime, 0, INTERFACE_THREAD_STACK_SIZE);
-  osThreadCreate (osThread(EthIf), netif);
+  osThreadId ethIfThread = osThreadCreate (osThread(EthIf), netif);
+
+  /* log messages of the interface thread must not wait for the output */
+  dlog_defer_task(ethIfThread);
   
   /* Set PHY IO functions */
   LAN8742_RegisterBusIO(&LAN8742, &LAN8742_IOCtx);
@@ -269,11 +509,98 @@ static void low_level_init(struct netif *netif)
     MACConf.Speed = speed;
     HAL_ETH_SetMACConfig(&EthHandle, &MACConf);
     HAL_ETH_Start_IT(&EthHandle);
+    __HAL_ETH_DMA_ENABLE_IT(&EthHandle, ETH_DMACIER_RBUE); /* count Rx ring overruns */
     netif_set_up(netif);
     netif_set_link_up(netif);
   }
 }
 
+/**
+  * @brief  Send a two-step Sync as a one-step one and suppress its Follow_Up.
+  *         The current PTP time is written into the originTimestamp and
+  *         passed to the MAC as the reference of the one-step timestamp
+  *         correction: the egress time minus the reference is added to the
+  *         correctionField on transmission.
+  * @param  p: the frame to be sent
+  * @param  pTxConfig: packet configuration of the frame
+  * @retval true if the frame must not be sent
+  */
+static bool ethernetif_ptp_one_step(struct pbuf * p, ETH_TxPacketConfig * pTxConfig)
+{
+  PtpFrameInfo info;
+  uint8_t * pMsg;
+  uint16_t seqId;
+  uint32_t sec, nsec;
+
+  if (!PtpOneStep)
+  {
+    return false;
+  }
+
+  /* only messages contained in the first pbuf are considered */
+  if ((ptp_classify_frame((const uint8_t *)p->payload, p->len, &info) == PTP_FRAME_NONE)
+      || ((info.payloadOffset + PTP_MSG_SYNC_LEN) > p->len))
+  {
+    return false;
+  }
+
+  pMsg = (uint8_t *)p->payload + info.payloadOffset;
+  seqId = (((uint16_t)pMsg[PTP_MSG_SEQID_OFFSET]) << 8) | pMsg[PTP_MSG_SEQID_OFFSET + 1];
+
+  switch (pMsg[0] & 0x0F)
+  {
+  case PTP_MSG_TYPE_SYNC:
+    if (!(pMsg[PTP_MSG_FLAGS_OFFSET] & PTP_MSG_FLAG_TWO_STEP))
+    {
+      return false;
+    }
+
+    ETH_GetPTPTime(&EthHandle, &sec, &nsec);
+
+    pMsg[PTP_MSG_FLAGS_OFFSET] &= ~PTP_MSG_FLAG_TWO_STEP;
+
+    /* 48-bit seconds and 32-bit nanoseconds, big-endian */
+    memset(pMsg + PTP_MSG_ORIGIN_TS_OFFSET, 0, 2);
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 2] = sec >> 24;
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 3] = sec >> 16;
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 4] = sec >> 8;
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 5] = sec;
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 6] = nsec >> 24;
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 7] = nsec >> 16;
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 8] = nsec >> 8;
+    pMsg[PTP_MSG_ORIGIN_TS_OFFSET + 9] = nsec;
+
+    /* the correction invalidates the UDP checksum, over IPv4 it may be omitted */
+    if (info.cls == PTP_FRAME_UDP_EVENT)
+    {
+      pMsg[-2] = 0;
+      pMsg[-1] = 0;
+      pTxConfig->ChecksumCtrl = ETH_CHECKSUM_IPHDR_INSERT;
+    }
+
+    pTxConfig->Attributes |= ETH_TX_PACKETS_FEATURES_OSTC;
+    pTxConfig->OneStepTsSec = sec;
+    pTxConfig->OneStepTsNsec = nsec;
+
+    PtpOneStepSeqId = seqId;
+    PtpOneStepSeqValid = true;
+    IfStats.txOneStepSync++;
+    return false;
+
+  case PTP_MSG_TYPE_FOLLOW_UP:
+    if (PtpOneStepSeqValid && (seqId == PtpOneStepSeqId))
+    {
+      PtpOneStepSeqValid = false;
+      IfStats.txFollowUpSuppressed++;
+      return true;
+    }
+    return false;
+
+  default:
+    return false;
+  }
+}
+
 /**
   * @brief This function should do the actual transmission of the packet. The packet is
   * contained in the pbuf that is passed to the function. This pbuf
@@ -284,20 +611,31 @@ static void low_level_init(struct netif *netif)
   * @return ERR_OK if the packet could be sent
   *         an err_t value if the packet couldn't be sent
   *
-  * @note Returning ERR_MEM here if a DMA queue of your MAC is full can lead to
-  *       strange results. You might consider waiting for space in the DMA queue
-  *       to become available since the stack doesn't retry to send a packet
-  *       dropped because of memory failure (except for the TCP timers).
+  * @note The frame is only queued onto the DMA ring, the function does not wait
+  *       for the transmission to complete. The pbuf is referenced until the
+  *       frame's completion has been dispatched, see ethernetif_tx_dispatch(). The caller
+  *       is only blocked (for at most ETH_DMA_TRANSMIT_TIMEOUT) if the Tx ring
+  *       is completely full.
   */
 static err_t low_level_output(struct netif *netif, struct pbuf *p)
 {
   uint32_t i=0;
+  uint32_t descnbr, lastdesc;
+  uint32_t tapRec = 0, tapSec, tapNsec;
   struct pbuf *q;
   err_t errval = ERR_OK;
+  EthIfTapFrameCb tapFrameCb = TapFrameCb;
   ETH_BufferTypeDef Txbuffer[ETH_TX_DESC_CNT];
+  ETH_TxPacketConfig txConfig = TxConfig;
   
   memset(Txbuffer, 0 , ETH_TX_DESC_CNT*sizeof(ETH_BufferTypeDef));
 
+  /* Follow_Ups of one-step Syncs are not sent */
+  if (ethernetif_ptp_one_step(p, &txConfig))
+  {
+    return ERR_OK;
+  }
+
   for(q = p; q != NULL; q = q->next)
   {
     if(i >= ETH_TX_DESC_CNT)	
@@ -319,13 +657,71 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
     i++;
   }
 
-  TxConfig.Length = p->tot_len;
-  TxConfig.TxBuffer = Txbuffer;
+  /* the DMA takes two buffers per descriptor, the one-step reference timestamp
+     is passed in a context descriptor */
+  descnbr = (i + 1) / 2;
+  if (txConfig.Attributes & ETH_TX_PACKETS_FEATURES_OSTC)
+  {
+    descnbr++;
+  }
+
+  txConfig.Length = p->tot_len;
+  txConfig.TxBuffer = Txbuffer;
+
+  /* keep the frame alive until the DMA has finished with it */
+  pbuf_ref(p);
+
+  xSemaphoreTake(TxLock, portMAX_DELAY);
+
+  /* wait for free descriptors if the ring is full */
+  while (((TxDescQueued - TxDescDispatched) + descnbr) > ETH_TX_DESC_CNT)
+  {
+    xSemaphoreGive(TxLock);
+
+    if (osSemaphoreWait(TxPktSemaphore, ETH_DMA_TRANSMIT_TIMEOUT) != osOK)
+    {
+      IfStats.txRingFull++;
+      pbuf_free(p);
+      return ERR_IF;
+    }
+
+    xSemaphoreTake(TxLock, portMAX_DELAY);
+  }
+
+  /* capture the frame, its timestamp is completed by ethernetif_tx_dispatch() */
+  if (tapFrameCb != NULL)
+  {
+    ETH_GetPTPTime(&EthHandle, &tapSec, &tapNsec);
+    tapRec = tapFrameCb(p, true, tapSec, tapNsec);
+  }
+
+  /* the Tx complete ISR must see the queued descriptors and the pbuf together */
+  taskENTER_CRITICAL();
+  if (HAL_ETH_Transmit_IT(&EthHandle, &txConfig) == HAL_OK)
+  {
+    /* the frame ends at the descriptor preceding the new current one */
+    lastdesc = (EthHandle.TxDescList.CurTxDesc + ETH_TX_DESC_CNT - 1) % ETH_TX_DESC_CNT;
+    ppWriteBackPBufs[lastdesc] = p;
+    TxTapRecs[lastdesc] = tapRec;
+    TxDescQueued += descnbr;
+  }
+  else
+  {
+    errval = ERR_IF;
+  }
+  taskEXIT_CRITICAL();
 
-  ppWriteBackPBufs[EthHandle.TxDescList.CurTxDesc] = p;
+  if (errval != ERR_OK)
+  {
+    /* the captured copy is released without a transmit timestamp */
+    if ((tapRec != 0) && (TapTxDoneCb != NULL))
+    {
+      TapTxDoneCb(tapRec, false, 0, 0);
+    }
+    pbuf_free(p);
+  }
 
-  HAL_ETH_Transmit(&EthHandle, &TxConfig, ETH_DMA_TRANSMIT_TIMEOUT);
-  //HAL_ETH_Transmit_IT(&EthHandle, &TxConfig);
+  xSemaphoreGive(TxLock);
   
   return errval;
 }
@@ -342,74 +738,242 @@ static struct pbuf * low_level_input(struct netif *netif)
 {
   struct pbuf *p = NULL;
   ETH_BufferTypeDef RxBuff[ETH_RX_DESC_CNT];
-  uint32_t framelength = 0, i = 0;;
-  struct pbuf_custom* custom_pbuf;
+  uint32_t framelength = 0, i = 0, descidx;
+  RxBuff_t *pBuff, *pSpareBuff;
 
-  memset(RxBuff, 0 , ETH_RX_DESC_CNT*sizeof(ETH_BufferTypeDef));
-  
-  for(i = 0; i < ETH_RX_DESC_CNT -1; i++)
+  /* dropped frames are skipped, NULL is only returned if no more frames are pending */
+  for (;;)
   {
-    RxBuff[i].next=&RxBuff[i+1];
-  }
+    memset(RxBuff, 0 , ETH_RX_DESC_CNT*sizeof(ETH_BufferTypeDef));
+
+    for(i = 0; i < ETH_RX_DESC_CNT -1; i++)
+    {
+      RxBuff[i].next=&RxBuff[i+1];
+    }
+
+    if(HAL_ETH_GetRxDataBuffer(&EthHandle, RxBuff) != HAL_OK)
+    {
+      break;
+    }
 
-  if(HAL_ETH_GetRxDataBuffer(&EthHandle, RxBuff) == HAL_OK)
-  {
     HAL_ETH_GetRxDataLength(&EthHandle, &framelength);
 
-    /* Build Rx descriptor to be ready for next data reception */
-    HAL_ETH_BuildRxDescriptors(&EthHandle);
+    descidx = EthHandle.RxDescList.FirstAppDesc;
+    pBuff = RxDescBuffs[descidx];
+    pSpareBuff = NULL;
 
-    /* Invalidate data cache for ETH Rx Buffers */
-    SCB_InvalidateDCache_by_Addr((uint32_t *)RxBuff->buffer, framelength);
-    
-    custom_pbuf  = (struct pbuf_custom*)LWIP_MEMPOOL_ALLOC(RX_POOL);
-    if(custom_pbuf != NULL)
+    /* replace the buffer of the descriptor with a spare one,
+       frames spanning multiple buffers are not expected (and not supported) */
+    if (EthHandle.RxDescList.AppDescNbr == 1)
     {
-      custom_pbuf->custom_free_function = pbuf_free_custom;
+      pSpareBuff = rx_buff_alloc();
+    }
 
-      p = pbuf_alloced_custom(PBUF_RAW, framelength, PBUF_REF, custom_pbuf, RxBuff->buffer, framelength);
+    if (pSpareBuff != NULL)
+    {
+      RxDescBuffs[descidx] = pSpareBuff;
+      HAL_ETH_DescAssignMemory(&EthHandle, descidx, pSpareBuff->buff, NULL);
+    }
+    else
+    {
+      IfStats.rxNoBuffer++;
+    }
+
+    /* Release the Rx descriptors, they are rebuilt in one pass after the batch
+       (or earlier if too many of them are waiting) */
+    HAL_ETH_ReleaseRxDescriptors(&EthHandle);
+    if (EthHandle.RxDescList.ReleasedDescNbr >= ETH_RX_REBUILD_THRESHOLD)
+    {
+      HAL_ETH_RebuildReleasedRxDescriptors(&EthHandle);
+    }
 
-      /* Store timestamp */
-      p->time_s = RxBuff->ts_sec;
-      p->time_ns = RxBuff->ts_nsec;
+    /* no spare buffer: the frame is dropped, its buffer is back at the DMA */
+    if (pSpareBuff == NULL)
+    {
+      continue;
     }
 
+    /* Invalidate data cache for ETH Rx Buffers */
+    SCB_InvalidateDCache_by_Addr((uint32_t *)pBuff->buff, framelength);
+
+    p = pbuf_alloced_custom(PBUF_RAW, framelength, PBUF_REF, &pBuff->pbuf_custom, pBuff->buff, ETH_RX_BUFFER_SIZE);
+
+    /* Store timestamp, frames not selected by the timestamp filter carry zero */
+    p->time_s = RxBuff->ts_sec;
+    p->time_ns = RxBuff->ts_nsec;
+
+    IfStats.rxFrames++;
+    if ((p->time_s != 0) || (p->time_ns != 0))
+    {
+      IfStats.rxTimestamped++;
+    }
+
+    PKT_TRACE_BEGIN(p);
+
+    break;
   }
   
   return p;
 }
 
+#if ETH_RX_BATCH_MODE == 1
+/**
+  * @brief  Pass a batch of received frames to the stack, runs in the tcpip thread.
+  * @param  ctx: the batch
+  * @retval None
+  */
+static void ethernetif_input_batch(void * ctx)
+{
+  RxBatch_t * pBatch = (RxBatch_t *)ctx;
+  uint32_t i;
+
+  for (i = 0; i < pBatch->cnt; i++)
+  {
+    PKT_TRACE_STAMP(pBatch->p[i], PKT_TRACE_TCPIP_INPUT);
+    if (ethernet_input(pBatch->p[i], pBatch->netif) != ERR_OK)
+    {
+      pbuf_free(pBatch->p[i]);
+    }
+  }
+
+  LWIP_MEMPOOL_FREE(RX_BATCH_POOL, pBatch);
+}
+#endif
+
+/**
+  * @brief  Pass a received PTP frame directly to the registered PTP Rx hook,
+  *         bypassing the tcpip thread.
+  * @param  p: the received frame
+  * @retval true if the hook has consumed the frame
+  */
+static bool ethernetif_ptp_cut_through(struct pbuf *p)
+{
+  EthIfPtpRxHook hook = PtpRxHook;
+  PtpFrameInfo info;
+
+  if (hook == NULL)
+  {
+    return false;
+  }
+
+  if (ptp_classify_frame((const uint8_t *)p->payload, p->len, &info) == PTP_FRAME_NONE)
+  {
+    return false;
+  }
+
+  return hook(p, &info);
+}
+
+/**
+  * @brief  Fetch at most ETH_RX_BATCH_BUDGET received frames and pass them to the stack.
+  * @param  netif: the lwip network interface structure for this ethernetif
+  * @retval number of frames fetched
+  */
+static uint32_t ethernetif_drain(struct netif *netif)
+{
+  struct pbuf *p;
+  uint32_t cnt = 0;
+#if ETH_RX_BATCH_MODE == 1
+  RxBatch_t * pBatch = (RxBatch_t *)LWIP_MEMPOOL_ALLOC(RX_BATCH_POOL);
+
+  if (pBatch != NULL)
+  {
+    pBatch->netif = netif;
+    pBatch->cnt = 0;
+  }
+#endif
+
+  while ((cnt < ETH_RX_BATCH_BUDGET) && ((p = low_level_input(netif)) != NULL))
+  {
+    EthIfTapFrameCb tapFrameCb = TapFrameCb;
+
+    cnt++;
+
+    if (tapFrameCb != NULL)
+    {
+      uint32_t tapSec = p->time_s, tapNsec = p->time_ns;
+
+      /* frames without a hardware timestamp are captured with the current time */
+      if ((tapSec == 0) && (tapNsec == 0))
+      {
+        ETH_GetPTPTime(&EthHandle, &tapSec, &tapNsec);
+      }
+      tapFrameCb(p, false, tapSec, tapNsec);
+    }
+
+    /* PTP frames go straight to the PTP task */
+    if (ethernetif_ptp_cut_through(p))
+    {
+      continue;
+    }
+
+#if ETH_RX_BATCH_MODE == 1
+    if (pBatch != NULL)
+    {
+      pBatch->p[pBatch->cnt++] = p;
+      continue;
+    }
+#endif
+
+    /* frame-by-frame operation (or all batches are still queued) */
+    PKT_TRACE_STAMP(p, PKT_TRACE_TCPIP_INPUT);
+    if (netif->input( p, netif) != ERR_OK )
+    {
+      IfStats.rxStackBusy++;
+      pbuf_free(p);
+    }
+  }
+
+  /* give the released descriptors back to the DMA in one pass */
+  HAL_ETH_RebuildReleasedRxDescriptors(&EthHandle);
+
+#if ETH_RX_BATCH_MODE == 1
+  if (pBatch != NULL)
+  {
+    if (pBatch->cnt == 0)
+    {
+      LWIP_MEMPOOL_FREE(RX_BATCH_POOL, pBatch);
+    }
+    else if (tcpip_try_callback(ethernetif_input_batch, pBatch) != ERR_OK)
+    {
+      IfStats.rxStackBusy += pBatch->cnt;
+      while (pBatch->cnt > 0)
+      {
+        pbuf_free(pBatch->p[--pBatch->cnt]);
+      }
+      LWIP_MEMPOOL_FREE(RX_BATCH_POOL, pBatch);
+    }
+  }
+#endif
+
+  return cnt;
+}
+
 /**
   * @brief This function is the ethernetif_input task, it is processed when a packet 
-  * is ready to be read from the interface. It uses the function low_level_input() 
-  * that should handle the actual reception of bytes from the network
-  * interface. Then the type of the received packet is determined and
-  * the appropriate input function is called.
+  * is ready to be read from the interface. It uses the function ethernetif_drain()
+  * to fetch the received frames in batches of at most ETH_RX_BATCH_BUDGET frames
+  * and to pass them to the stack.
   *
   * @param netif the lwip network interface structure for this ethernetif
   */
 void ethernetif_input( void const * argument )
 {
-  struct pbuf *p;
   struct netif *netif = (struct netif *) argument;
   
   for( ;; )
   {
     if (osSemaphoreWait( RxPktSemaphore, TIME_WAITING_FOR_INPUT)==osOK)
     {
-      do
+      while (ethernetif_drain(netif) == ETH_RX_BATCH_BUDGET)
       {
-        p = low_level_input( netif );
-        if (p != NULL)
-        {
-          if (netif->input( p, netif) != ERR_OK )
-          {
-            pbuf_free(p);
-          }
-        }
-      }while(p!=NULL);
+        ethernetif_tx_dispatch();
 
-      ethernetif_write_back_tx_timestamps();
+        /* budget exhausted, let the lower priority tasks run */
+        osDelay(ETH_RX_BATCH_BACKOFF);
+      }
+
+      ethernetif_tx_dispatch();
     }
   }
 }
@@ -465,8 +1029,149 @@ err_t ethernetif_init(struct netif *netif)
   */
 void pbuf_free_custom(struct pbuf *p)
 {
-  struct pbuf_custom* custom_pbuf = (struct pbuf_custom*)p;
-  LWIP_MEMPOOL_FREE(RX_POOL, custom_pbuf);
+  rx_buff_free((RxBuff_t *)p);
+}
+
+/**
+  * @brief  Ethernet DMA error callback, counts the Rx buffer unavailable events.
+  * @param  heth: ETH handle
+  * @retval None
+  */
+void HAL_ETH_DMAErrorCallback(ETH_HandleTypeDef *heth)
+{
+  if (heth->DMAErrorCode & ETH_DMACSR_RBU)
+  {
+    IfStats.rxDescUnavailable++;
+
+    /* the Rx DMA is suspended until descriptors are rebuilt */
+    osSemaphoreRelease(RxPktSemaphore);
+  }
+}
+
+/**
+  * @brief  Register the early Rx hook for PTP frames. The hook is called from the
+  *         interface thread for every frame recognized by ptp_classify_frame().
+  *         It must not block, frames not consumed by the hook go to the stack.
+  * @param  hook: the hook, NULL to unregister
+  * @retval None
+  */
+void ethernetif_set_ptp_rx_hook(EthIfPtpRxHook hook)
+{
+  PtpRxHook = hook;
+}
+
+/**
+  * @brief  Register the frame tap. The frame callback is called for every received frame
+  *         and for every frame queued for transmission, the Tx done callback delivers
+  *         the transmit timestamps of the captured Tx frames. Neither of them may block.
+  * @param  frameCb: frame callback, NULL to unregister
+  * @param  txDoneCb: Tx done callback
+  * @retval None
+  */
+void ethernetif_set_tap(EthIfTapFrameCb frameCb, EthIfTapTxDoneCb txDoneCb)
+{
+  if (frameCb != NULL)
+  {
+    TapTxDoneCb = txDoneCb;
+    TapFrameCb = frameCb;
+  }
+  else
+  {
+    /* Tx done callbacks are still delivered for the frames in flight */
+    TapFrameCb = NULL;
+  }
+}
+
+/**
+  * @brief  Transmit a PTP message over IEEE 802.3 (EtherType 0x88F7). The Ethernet header
+  *         is prepended in the headroom of the pbuf (allocate it at least with PBUF_LINK),
+  *         the payload pointer is restored before returning. Since the same pbuf is passed
+  *         to the driver, the transmit timestamp is delivered through its time_s/time_ns
+  *         fields, ts_writeback_addr and tx_cb just like for UDP messages.
+  * @param  p: pbuf holding the PTP message
+  * @param  pDstAddr: destination MAC address (e.g. ETHIF_PTP_L2_DEFAULT_ADDR)
+  * @retval ERR_OK if the frame has been queued for transmission
+  */
+err_t ethernetif_l2_output(struct pbuf * p, const uint8_t * pDstAddr)
+{
+  struct eth_addr dst;
+  void * payload = p->payload;
+  err_t err;
+
+  if ((EthIfNetif == NULL) || !netif_is_link_up(EthIfNetif))
+  {
+    return ERR_IF;
+  }
+
+  SMEMCPY(dst.addr, pDstAddr, ETH_HWADDR_LEN);
+
+  LOCK_TCPIP_CORE();
+  err = ethernet_output(EthIfNetif, p, (const struct eth_addr *)EthIfNetif->hwaddr, &dst, PTP_CLS_ETHERTYPE_PTP);
+  UNLOCK_TCPIP_CORE();
+
+  /* hide the Ethernet header again */
+  if (p->payload != payload)
+  {
+    pbuf_remove_header(p, SIZEOF_ETH_HDR);
+  }
+
+  return err;
+}
+
+/**
+  * @brief  Enable or disable the reception of the PTP over IEEE 802.3 multicast
+  *         addresses (01-1B-19-00-00-00 and 01-80-C2-00-00-0E) using the
+  *         MAC perfect address filters 1 and 2.
+  * @param  enable: enable or disable the filters
+  * @retval None
+  */
+void ethernetif_set_ptp_l2_filters(bool enable)
+{
+  HAL_ETH_SetDestMACAddrMatch(&EthHandle, ETH_MAC_ADDRESS1, enable ? PtpL2DefaultAddr : NULL);
+  HAL_ETH_SetDestMACAddrMatch(&EthHandle, ETH_MAC_ADDRESS2, enable ? PtpL2PeerDelayAddr : NULL);
+}
+
+/**
+  * @brief  Enable or disable one-step Sync transmission. Two-step Syncs are
+  *         sent as one-step ones using the MAC's one-step timestamp correction,
+  *         their Follow_Ups are suppressed. The transmit timestamps of the Syncs
+  *         are still delivered. PTP over UDP/IPv4 and 802.3 must be enabled in
+  *         the timestamp filter, see ETH_SetPTPRxTimestampFilter().
+  * @param  enable: enable or disable one-step Syncs
+  * @retval None
+  */
+void ethernetif_set_ptp_one_step(bool enable)
+{
+  PtpOneStepSeqValid = false;
+  PtpOneStep = enable;
+}
+
+/**
+  * @brief  Check if one-step Sync transmission is enabled.
+  * @retval true if enabled
+  */
+bool ethernetif_get_ptp_one_step(void)
+{
+  return PtpOneStep;
+}
+
+/**
+  * @brief  Get the interface drop counters.
+  * @param  pStats: pointer to the structure to fill
+  * @retval None
+  */
+void ethernetif_get_stats(EthIfStats * pStats)
+{
+  uint32_t mpocr;
+
+  /* the MTL counters are cleared on read, accumulate them */
+  mpocr = READ_REG(EthHandle.Instance->MTLRQMPOCR);
+  IfStats.rxFifoOverflow += (mpocr & ETH_MTLRQMPOCR_OVFPKTCNT) >> ETH_MTLRQMPOCR_OVFPKTCNT_Pos;
+  IfStats.rxMissed += (mpocr & ETH_MTLRQMPOCR_MISPKTCNT) >> ETH_MTLRQMPOCR_MISPKTCNT_Pos;
+
+  IfStats.rxFreeBuff = RxFreeBuffCnt;
+
+  *pStats = IfStats;
 }
 
 /**
@@ -551,6 +1256,7 @@ void HAL_ETH_MspInit(ETH_HandleTypeDef *heth)
   */
 void HAL_ETH_RxCpltCallback(ETH_HandleTypeDef *heth)
 {
+  PKT_TRACE_IRQ();
   osSemaphoreRelease(RxPktSemaphore);
 }
 
@@ -686,6 +1392,7 @@ void ethernet_link_thread( void const * argument )
         MACConf.Speed = speed;
         HAL_ETH_SetMACConfig(&EthHandle, &MACConf);
         HAL_ETH_Start_IT(&EthHandle);
+        __HAL_ETH_DMA_ENABLE_IT(&EthHandle, ETH_DMACIER_RBUE); /* count Rx ring overruns */
         netif_set_up(netif);
         netif_set_link_up(netif);
       }
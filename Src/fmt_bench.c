@@ -0,0 +1,121 @@
+/*
+ * fmt_bench.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "fmt_bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "embfmt/embformat.h"
+
+// arguments are read from volatiles, so that calls cannot be evaluated at compile time
+static volatile uint32_t sSmall = 42;
+static volatile uint32_t sLarge = 4000000000UL;
+static volatile int32_t sNegative = -1234567;
+static volatile uint64_t sLong = 12345678901234ULL;
+static volatile double sDouble = 3.14159265;
+static volatile uint32_t sSec = 1760572800UL, sNsec = 5432100;
+
+typedef void (*FmtBenchFn)(char *buf);
+
+// a benchmark case: the same output produced by embfmt (parsing the format or using a compiled one) and snprintf
+typedef struct {
+    const char *name; // name of the case
+    FmtBenchFn embfmtFn; // printing by embfmt
+    FmtBenchFn cachedFn; // printing by embfmt with a compiled format
+    FmtBenchFn sinkFn; // printing by embfmt with a compiled format, in sink mode
+    FmtBenchFn snprintfFn; // printing by snprintf
+} FmtBenchCase;
+
+// sink collecting the pieces into a buffer
+typedef struct {
+    char *buf; // output buffer
+    uint32_t len; // number of characters collected
+} FmtBenchSinkBuf;
+
+static void fmt_bench_sink(void *arg, const char *chunk, unsigned long int len) {
+    FmtBenchSinkBuf *pSink = (FmtBenchSinkBuf *) arg;
+    if (pSink->len + len < FMT_BENCH_BUF_LEN) {
+        memcpy(pSink->buf + pSink->len, chunk, len);
+        pSink->len += len;
+    }
+    pSink->buf[pSink->len] = '\0';
+}
+
+static void fmt_bench_sink_print(EmbFmtCompiled *pCache, char *buf, char *fmt, ...) {
+    FmtBenchSinkBuf sink = { buf, 0 };
+    va_list args;
+    va_start(args, fmt);
+    vembfmt_cached_sink(pCache, fmt_bench_sink, &sink, fmt, args);
+    va_end(args);
+}
+
+#define FMT_BENCH_CASE(name, efmt, sfmt, ...) \
+    static void name##_embfmt(char *buf) { embfmt(buf, FMT_BENCH_BUF_LEN - 1, efmt, __VA_ARGS__); } \
+    static void name##_cached(char *buf) { EMBFMT_CACHED(buf, FMT_BENCH_BUF_LEN - 1, efmt, __VA_ARGS__); } \
+    static void name##_sink(char *buf) { static EmbFmtCompiled cache; fmt_bench_sink_print(&cache, buf, efmt, __VA_ARGS__); } \
+    static void name##_snprintf(char *buf) { snprintf(buf, FMT_BENCH_BUF_LEN, sfmt, __VA_ARGS__); }
+
+FMT_BENCH_CASE(u_small, "%u", "%u", sSmall)
+FMT_BENCH_CASE(u_large, "%u", "%u", sLarge)
+FMT_BENCH_CASE(d_neg, "%d", "%d", sNegative)
+FMT_BENCH_CASE(x_pad, "%08x", "%08x", sLarge)
+FMT_BENCH_CASE(lu, "%lu", "%llu", (unsigned long long) sLong)
+FMT_BENCH_CASE(f, "%.6f", "%.6f", sDouble)
+FMT_BENCH_CASE(ts, "%T", "%u.%09u", sSec, sNsec)
+FMT_BENCH_CASE(line, "sec: %u, nsec: %u, offset: %d ns", "sec: %u, nsec: %u, offset: %d ns", sSec, sNsec, sNegative)
+
+#define FMT_BENCH_ENTRY(name) { #name, name##_embfmt, name##_cached, name##_sink, name##_snprintf }
+
+static const FmtBenchCase sCases[] = {
+        FMT_BENCH_ENTRY(u_small),
+        FMT_BENCH_ENTRY(u_large),
+        FMT_BENCH_ENTRY(d_neg),
+        FMT_BENCH_ENTRY(x_pad),
+        FMT_BENCH_ENTRY(lu),
+        FMT_BENCH_ENTRY(f),
+        FMT_BENCH_ENTRY(ts),
+        FMT_BENCH_ENTRY(line),
+};
+
+// measure the average cost of a printing function
+static uint32_t fmt_bench_measure(FmtBenchFn fn, FmtBenchTimeFn timeFn, uint32_t rounds, char *buf) {
+    fn(buf); // warm up the caches
+
+    uint32_t t0 = timeFn();
+    for (uint32_t i = 0; i < rounds; i++) {
+        fn(buf);
+    }
+    uint32_t t1 = timeFn();
+
+    return (t1 - t0) / rounds;
+}
+
+void fmt_bench_run(FmtBenchTimeFn timeFn, const char *unit, uint32_t rounds, FmtBenchPrintFn printFn) {
+    char embfmtBuf[FMT_BENCH_BUF_LEN], cachedBuf[FMT_BENCH_BUF_LEN], sinkBuf[FMT_BENCH_BUF_LEN], snprintfBuf[FMT_BENCH_BUF_LEN];
+
+    if (rounds == 0) {
+        rounds = 1;
+    }
+
+    printFn("Average cost of a call [%s], %u rounds\n", unit, rounds);
+    printFn("case\t\tembfmt\tcompiled\tsink\tsnprintf\n");
+
+    for (uint32_t i = 0; i < sizeof(sCases) / sizeof(FmtBenchCase); i++) {
+        const FmtBenchCase *pCase = sCases + i;
+
+        uint32_t embfmtCost = fmt_bench_measure(pCase->embfmtFn, timeFn, rounds, embfmtBuf);
+        uint32_t cachedCost = fmt_bench_measure(pCase->cachedFn, timeFn, rounds, cachedBuf);
+        uint32_t sinkCost = fmt_bench_measure(pCase->sinkFn, timeFn, rounds, sinkBuf);
+        uint32_t snprintfCost = fmt_bench_measure(pCase->snprintfFn, timeFn, rounds, snprintfBuf);
+
+        // flag the cases where the outputs differ
+        const char *mismatch = (strcmp(embfmtBuf, snprintfBuf) || strcmp(cachedBuf, snprintfBuf) || strcmp(sinkBuf, snprintfBuf)) ? "\t(output differs)" : "";
+
+        printFn("%s\t\t%u\t%u\t\t%u\t%u%s\n", pCase->name, embfmtCost, cachedCost, sinkCost, snprintfCost, mismatch);
+    }
+}
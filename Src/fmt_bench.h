@@ -0,0 +1,25 @@
+/*
+ * fmt_bench.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef FMT_BENCH_H_
+#define FMT_BENCH_H_
+
+#include <stdint.h>
+
+// Formatting benchmark: typical format strings are printed by embfmt (parsing
+// the format on every call, using a compiled format and passing the output to
+// a sink) and by the C library's
+// snprintf, the average cost of a call is reported for each.
+// Target independent, runs on the target (CLI) and on the host (Sim/).
+
+#define FMT_BENCH_BUF_LEN (96) // size of the output buffer
+
+typedef uint32_t (*FmtBenchTimeFn)(); // free running time source (e.g. cycle counter)
+typedef void (*FmtBenchPrintFn)(const char *fmt, ...); // report printer (only %s and %u conversions are used)
+
+void fmt_bench_run(FmtBenchTimeFn timeFn, const char *unit, uint32_t rounds, FmtBenchPrintFn printFn); // run the benchmark, costs are printed in time units per call
+
+#endif /* FMT_BENCH_H_ */
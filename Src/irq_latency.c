@@ -0,0 +1,54 @@
+/*
+ * irq_latency.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "irq_latency.h"
+
+#include <string.h>
+
+#include "ptp_clock.h"
+#include "ptp_sched.h"
+
+static PtpSchedTimer sProbe; // the probe timer
+static uint32_t sSamples; // number of events served
+static uint32_t sMaxNs; // maximal latency
+static uint64_t sSumNs; // sum of the latencies
+
+// record the latency of a probe event (Ethernet interrupt)
+static void irq_latency_cb(void *pArg, uint32_t sec, uint32_t nsec) {
+    uint32_t nowSec, nowNsec;
+    ptp_clock_now(&nowSec, &nowNsec);
+
+    int64_t late = (((int64_t) nowSec) - sec) * PTP_SCHED_NSEC_PER_SEC + (((int64_t) nowNsec) - nsec);
+    if (late < 0) {
+        late = 0;
+    }
+
+    sSamples++;
+    sSumNs += (uint64_t) late;
+    if (late > sMaxNs) {
+        sMaxNs = (late > (int64_t) UINT32_MAX) ? UINT32_MAX : (uint32_t) late;
+    }
+}
+
+int irq_latency_start() {
+    ptp_sched_cancel(&sProbe);
+
+    sSamples = 0;
+    sMaxNs = 0;
+    sSumNs = 0;
+
+    return ptp_sched_periodic(&sProbe, IRQ_LATENCY_PROBE_PERIOD_NS, 0, irq_latency_cb, NULL);
+}
+
+void irq_latency_stop(IrqLatencyStats *pStats) {
+    ptp_sched_cancel(&sProbe);
+
+    memset(pStats, 0, sizeof(IrqLatencyStats));
+    pStats->samples = sSamples;
+    pStats->missed = sProbe.missed;
+    pStats->maxNs = sMaxNs;
+    pStats->avgNs = (sSamples > 0) ? (uint32_t) (sSumNs / sSamples) : 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * irq_latency.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef IRQ_LATENCY_H_
+#define IRQ_LATENCY_H_
+
+#include <stdint.h>
+
+// Interrupt latency probe: a periodic PTP-time event is scheduled and the
+// delay of its callbacks from the scheduled instants is recorded. This is the
+// latency of the Ethernet interrupt (including a PTP clock readout), the one
+// the timestamping and the PTP-time scheduler depend on.
+
+#define IRQ_LATENCY_PROBE_PERIOD_NS (100000) // period of the probe events [ns]
+
+// latency statistics
+typedef struct {
+    uint32_t samples; // number of probe events served
+    uint32_t missed; // number of probe events missed entirely
+    uint32_t maxNs; // maximal latency [ns]
+    uint32_t avgNs; // average latency [ns]
+} IrqLatencyStats;
+
+int irq_latency_start(); // start probing (requires the PTP-time scheduler)
+void irq_latency_stop(IrqLatencyStats *pStats); // stop probing and get the statistics
+
+#endif /* IRQ_LATENCY_H_ */
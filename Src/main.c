@@ -17,12 +17,20 @@
 #include "stm32h7xx_hal_tim_ex.h"
 
 #include "cli.h"
+#include "console_uart.h"
+#include "dlog.h"
+#include "telemetry.h"
 
 #include <math.h>
 
 #include "flexptp/ptp_defs.h"
 
+#include "fmt_bench.h"
+#include "irq_latency.h"
 #include "persistent_storage.h"
+#include "pkt_trace.h"
+#include "ptp_clock.h"
+#include "ptp_sched.h"
 
 #include "flexptp/ptp_core.h"
 
@@ -39,6 +47,7 @@ struct netif gnetif; /* network interface structure */
 
 // Devices handles
 static UART_HandleTypeDef shUART3;
+extern ETH_HandleTypeDef EthHandle;
 
 /* Private function prototypes -----------------------------------------------*/
 static void SystemClock_Config(void);
@@ -47,6 +56,9 @@ static void StartThread(void const *argument);
 static void Netif_Config(void);
 static void MPU_Config(void);
 static void CPU_CACHE_Enable(void);
+#ifdef USE_ITCM_CRITICAL_PATH
+static void VectorTable_Relocate(void);
+#endif
 
 /* Private functions ---------------------------------------------------------*/
 
@@ -88,34 +100,66 @@ static int CB_listTasks(const CliToken_Type *ppArgs, uint8_t argc) {
     return 0;
 }
 
+// print the duration of a storage operation and the interrupt latency measured meanwhile
+static void config_print_op_stats(uint32_t startTick, bool probing) {
+    uint32_t duration = HAL_GetTick() - startTick;
+
+    MSG("Took %u ms", duration);
+    if (probing) {
+        IrqLatencyStats lat;
+        irq_latency_stop(&lat);
+        MSG(", interrupt latency: max. %u ns, avg. %u ns (%u samples, %u missed)", lat.maxNs, lat.avgNs, lat.samples, lat.missed);
+    }
+    MSG("\n");
+}
+
 static int CB_config(const CliToken_Type *ppArgs, uint8_t argc) {
     if (!strcmp(ppArgs[0], "save")) {
         MSG("Saving to persistent storage...");
 
-        // clear storage
-        ps_clear();
-
         // save PTP-config
         PtpConfig config;
         ptp_store_config(&config);
-        ps_store(CONFIG_PTP, &config);
 
-        MSG("done!\n");
+        bool probing = (irq_latency_start() == 0);
+        uint32_t startTick = HAL_GetTick();
+        bool ok = ps_store(CONFIG_PTP, &config);
+
+        MSG(ok ? "done!\n" : "failed!\n");
+        config_print_op_stats(startTick, probing);
 
         return 0;
     } else if (!strcmp(ppArgs[0], "load")) {
         MSG("Loading from persistent storage...");
 
         // load PTP-config
-        ptp_load_config_from_dump(ps_load(CONFIG_PTP));
+        const void *pConfig = ps_load(CONFIG_PTP);
+        if (pConfig == NULL) {
+            MSG("no valid config stored!\n");
+            return 0;
+        }
+        ptp_load_config_from_dump(pConfig);
 
         MSG("done!\n");
 
         return 0;
     } else if (!strcmp(ppArgs[0], "clear")) {
         MSG("Clearing persistent storage...");
-        ps_clear();
-        MSG("done!\n");
+
+        bool probing = (irq_latency_start() == 0);
+        uint32_t startTick = HAL_GetTick();
+        bool ok = ps_clear();
+
+        MSG(ok ? "done!\n" : "failed!\n");
+        config_print_op_stats(startTick, probing);
+
+        return 0;
+    } else if (!strcmp(ppArgs[0], "info")) {
+        PsInfo info;
+        ps_get_info(&info);
+        MSG("Active sector: %d, used: %u of %u bytes\n", info.activeSector, info.used, info.size);
+        MSG("Records: %u, valid entries: %u, damaged: %u, ECC errors: %u\n", info.records, info.entries, info.corrupted, info.eccErrors);
+        MSG("Generation: %u\n", info.generation);
 
         return 0;
     }
@@ -123,6 +167,16 @@ static int CB_config(const CliToken_Type *ppArgs, uint8_t argc) {
     return -1;
 }
 
+static uint32_t fmtbench_cycles() {
+    return DWT_CYCCNT();
+}
+
+static int CB_fmtbench(const CliToken_Type *ppArgs, uint8_t argc) {
+    uint32_t rounds = (argc > 0) ? atoi(ppArgs[0]) : 1000;
+    fmt_bench_run(fmtbench_cycles, "cycles", rounds, MSG);
+    return 0;
+}
+
 //static int CB_start_stop_ptp(const CliToken_Type *ppArgs, uint8_t argc) {
 //    if (!strcmp(ppArgs[0], "start")) {
 //        MSG("Starting PTP!\n");
@@ -142,10 +196,15 @@ static void task_board(void const *argument) {
     // register cli commands
     cli_register_command("ping [on|off] \t\t\tTurn on/off ping led blinking", 1, 0, CB_ping);
     cli_register_command("tasks \t\t\tPrint list or registered tasks", 1, 0, CB_listTasks);
-    cli_register_command("config {save|load|clear} \t\t\tSave/load/clear config to/from persistent storage", 1, 1, CB_config);
+    cli_register_command("config {save|load|clear|info} \t\t\tSave/load/clear config to/from persistent storage", 1, 1, CB_config);
+    cli_register_command("fmtbench [rounds] \t\t\tCompare embfmt and snprintf formatting costs", 1, 0, CB_fmtbench);
 //    cli_register_command("ptp {start|stop} \t\t\tStart PTP", 1, 1, CB_start_stop_ptp);
 
+    // initialize packet latency tracing (if enabled)
+    pkt_trace_init();
+
     // construct config table
+    ps_init();
     ps_add_entry(sizeof(PtpConfig), CONFIG_PTP);
 
     while (true) {
@@ -202,22 +261,21 @@ void retarget_printf() {
     //huart.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
     HAL_UART_Init(&shUART3);
 
-    USART3->CR3 |= USART_CR3_OVRDIS;
-
     // Initialize retargeting
     RetargetInit(&shUART3);
 
-    // set fallback output device
-    RetargetSetFallbackOutput(output_usart);
+    // DMA driven transmission and reception
+    console_uart_init(&shUART3);
 
-    // enable DMA interrupts
-    //HAL_NVIC_SetPriority(USART3_IRQn, 10, 10);
-    //HAL_NVIC_EnableIRQ(USART3_IRQn);
+    // set fallback output and input device
+    RetargetSetFallbackOutput(console_uart_write);
+    RetargetSetInput(console_uart_read);
 }
 
 // hardware initialization
 void hw_init() {
     retarget_printf(); // retarget printf to USART3
+    dwt_init(); // enable the cycle counter
 }
 
 /**
@@ -226,6 +284,11 @@ void hw_init() {
  * @retval None
  */
 int main(void) {
+#ifdef USE_ITCM_CRITICAL_PATH
+    /* Serve exceptions without reading flash bank 1 */
+    VectorTable_Relocate();
+#endif
+
     /* Turn off MPU */
     HAL_MPU_Disable();
 
@@ -286,6 +349,18 @@ static void StartThread(void const *argument) {
     /* Initialize the LwIP stack */
     Netif_Config();
 
+    /* Initialize the PTP clock read API */
+    ptp_clock_init(&EthHandle);
+
+    /* Initialize the PTP-time event scheduler */
+    ptp_sched_init(&EthHandle);
+
+    /* Start the deferred logging */
+    dlog_init();
+
+    /* Start the telemetry sampling */
+    tlm_init();
+
     /* register CLI task*/
     reg_task_cli();
 
@@ -384,6 +459,10 @@ static void SystemClock_Config(void) {
     while (!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {
     }
 
+    /* Enable D2 domain SRAM1-2 Clock (0x30000000 AXI, Ethernet Rx buffers) */
+    __HAL_RCC_D2SRAM1_CLK_ENABLE();
+    __HAL_RCC_D2SRAM2_CLK_ENABLE();
+
     /* Enable D2 domain SRAM3 Clock (0x30040000 AXI)*/
     __HAL_RCC_D2SRAM3_CLK_ENABLE();
 
@@ -440,6 +519,24 @@ static void SystemClock_Config(void) {
 
 }
 
+#ifdef USE_ITCM_CRITICAL_PATH
+#define VECTOR_TABLE_SIZE (16 + WAKEUP_PIN_IRQn + 1) // system exceptions and interrupts
+static uint32_t sVectorTable[VECTOR_TABLE_SIZE] __attribute__((aligned(1024)));
+
+/**
+ * @brief  Copy the vector table to RAM and switch over to it.
+ * @param  None
+ * @retval None
+ */
+static void VectorTable_Relocate(void) {
+    extern const uint32_t g_pfnVectors[];
+    memcpy(sVectorTable, g_pfnVectors, sizeof(sVectorTable));
+    SCB->VTOR = (uint32_t) sVectorTable;
+    __DSB();
+    __ISB();
+}
+#endif
+
 /**
  * @brief  Configure the MPU attributes
  * @param  None
@@ -449,10 +546,11 @@ static void MPU_Config(void) {
     MPU_Region_InitTypeDef MPU_InitStruct;
 
     /* Configure the MPU attributes as Device not cacheable
-     for ETH DMA descriptors */
+     for ETH DMA descriptors (the whole area below the LwIP heap,
+     the descriptor rings are sized by ETH_RX/TX_DESC_CNT) */
     MPU_InitStruct.Enable = MPU_REGION_ENABLE;
     MPU_InitStruct.BaseAddress = 0x30040000;
-    MPU_InitStruct.Size = MPU_REGION_SIZE_256B;
+    MPU_InitStruct.Size = MPU_REGION_SIZE_16KB;
     MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
     MPU_InitStruct.IsBufferable = MPU_ACCESS_BUFFERABLE;
     MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
@@ -12,14 +12,31 @@
 #include "lwip/udp.h"
 #include "lwip/tcp.h"
 #include "lwip/ip.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "event_groups.h"
 
 #include <string.h>
 #include <retarget.h>
 
 #include "netterm.h"
 #include "cli.h"
+#include "dlog.h"
+#include "telemetry.h"
 #include "utils.h"
 
+// ----- TASK PROPERTIES -----
+static TaskHandle_t sTH; // task handle
+static uint8_t sPrio = 1; // priority
+static uint16_t sStkSize = 2048; // stack size
+static void task_netterm(void *pParam); // task routine function
+// ---------------------------
+
 static struct udp_pcb *spBeacon_pcb;
 static struct tcp_pcb *spNettermListen_pcb;
 
@@ -28,11 +45,24 @@ static ip_addr_t sBeaconMulticastAddr;
 
 static err_t netterm_tcp_accept_cb(void *arg, struct tcp_pcb *newpcb, err_t err);
 
-static int output_netterm(char *ptr, int len);
+static int output_netterm_default(char *ptr, int len);
+static int output_netterm_session(char *ptr, int len);
+static void netterm_task_init();
+
+static int sCliCmd = -1; // handle of the CLI command
+static EventGroupHandle_t sRoomEvents; // bit i: room got freed in the output ring of session i (or it got closed)
+static int CB_netterm(const CliToken_Type *ppArgs, uint8_t argc);
 
 //static void netterm_recv_cb(void * pArg, struct udp_pcb * pPCB, struct pbuf *pP, const ip_addr_t * pAddr, uint16_t port);
 
 void netterm_init() {
+	// the command queue and the task are kept across reconnections
+	if (sTH == NULL) {
+		netterm_task_init();
+	}
+
+	LOCK_TCPIP_CORE();
+
 	// join igmp group for beacon messages
 	sBeaconMulticastAddr.addr = ipaddr_addr(NETTERM_BEACON_ADDR);
 	igmp_joingroup(&netif_default->ip_addr, &sBeaconMulticastAddr);
@@ -47,9 +77,20 @@ void netterm_init() {
 	tcp_bind(spNettermListen_pcb, IP_ADDR_ANY, NETTERM_TERMINAL_PORT);
 	spNettermListen_pcb = tcp_listen(spNettermListen_pcb);
 	tcp_accept(spNettermListen_pcb, netterm_tcp_accept_cb);
+
+	UNLOCK_TCPIP_CORE();
+
+	sCliCmd = cli_register_command("netterm \t\t\tPrint network terminal session statistics", 1, 0, CB_netterm);
 }
 
 void netterm_deinit() {
+	if (sCliCmd >= 0) {
+		cli_remove_command(sCliCmd);
+		sCliCmd = -1;
+	}
+
+	LOCK_TCPIP_CORE();
+
 	// leave igmp group
 	ip_addr_t addr = { ipaddr_addr(NETTERM_BEACON_ADDR) };
 	igmp_leavegroup(&netif_default->ip_addr, &addr);
@@ -59,6 +100,8 @@ void netterm_deinit() {
 
 	// remove udp pcb
 	udp_remove(spBeacon_pcb);
+
+	UNLOCK_TCPIP_CORE();
 }
 
 // ------------------------
@@ -95,137 +138,552 @@ static void beacon_recv_cb(void *pArg, struct udp_pcb *pPCB, struct pbuf *pP, co
 
 // trim whitespace (e.g. CR and LF) characters from the end of input string in a non-destructive way
 static void trim_end_nondest(char *pStr, size_t *len) {
-	while (pStr[(*len) - 1] <= ' ' && (*len) > 0) {
+	while ((*len) > 0 && pStr[(*len) - 1] <= ' ') {
 		(*len)--;
 	}
 }
 
 #define NETTERM_MAX_LINE_LENGTH (127)
-static struct tcp_pcb *sDefOutputConnection = NULL;
-static struct tcp_pcb *sCurrentOutput = NULL;
+#define NETTERM_COPY_CHUNK (128) // output is copied in pieces of this size with interrupts masked
+#define NETTERM_CMD_QUEUE_LEN (8) // number of commands waiting for execution (all sessions)
+#define NETTERM_CMD_RESET_OUTPUT (0xFF) // queue item: the default output session got closed
+
+// Sessions are served from a fixed table. Received segments are assembled
+// into lines in the tcpip thread, the commands are executed one-by-one by the
+// netterm task whose output is redirected to the issuing session, so a
+// command's output can wait for room without stalling the TCP stack.
 
 // parameters of a tcp connection
 struct NettermConnArgs {
+	struct tcp_pcb *pcb; // pcb of the connection (NULL: unused slot)
+	uint8_t gen; // incremented on each reuse of the slot, commands of a closed session get skipped
 	bool canBeDefaultOutputTTY; // marks if this connection could be a default output
-	char inputBuf[NETTERM_MAX_LINE_LENGTH + 1]; // input buffer
-	char cmdBuf[NETTERM_MAX_LINE_LENGTH + 1]; // input buffer
+	char lineBuf[NETTERM_MAX_LINE_LENGTH + 1]; // line being received
+	uint32_t lineLen; // length of the received part of the line
+	bool lineOverflow; // the line is too long, the rest of it is discarded
+	uint32_t cmdCnt, cmdDropped; // statistics of the received commands
+
+	// Output is collected in a ring and handed over to the TCP stack in the
+	// tcpip thread: right away if a line is complete or a full segment is
+	// waiting, after a short delay otherwise. Room is freed as the send
+	// buffer accepts the data. When the ring is full, the commands of the
+	// session wait, other writers (default output, tcpip thread, interrupts)
+	// drop: they hold the shared output lock or must not block.
+	char outBuf[NETTERM_OUT_BUF_SIZE]; // output ring
+	volatile uint32_t outHead, outTail; // free-running write and read indices
+	volatile bool urgent; // the output should be sent without delay
+
+	uint32_t txBytes, txWaits, txDropped; // statistics
 };
 
-static err_t netterm_tcp_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
-	if (p == NULL) {
-		goto close_conn;
+static struct NettermConnArgs sConns[NETTERM_MAX_CONN_CNT]; // connection slots
+#define NETTERM_ROOM_BIT(pConn) ((EventBits_t) (1 << ((pConn) - sConns))) // room event of a session
+static struct NettermConnArgs *sDefOutputConnection = NULL;
+static uint8_t sDefOutputGen; // generation of the default output session
+static struct NettermConnArgs *sCurrentOutput = NULL; // session of the command being executed
+static uint8_t sCurrentGen; // generation of the session of the command being executed
+
+// command passed to the netterm task
+typedef struct {
+	uint8_t slot; // index of the session in the table
+	uint8_t gen; // generation of the session
+	char line[NETTERM_MAX_LINE_LENGTH + 1]; // command line
+} NettermCmd;
+
+static QueueHandle_t sCmdQueue; // commands waiting for execution
+
+static TaskHandle_t sTcpipTH; // the tcpip thread
+static volatile bool sFlushPending = false; // flush is scheduled in the tcpip thread
+static bool sFlushTimerArmed = false; // delayed flush is scheduled
+
+// hand the buffered output of a connection over to the TCP stack, runs in the tcpip thread
+static void netterm_push(struct NettermConnArgs *pConn) {
+	struct tcp_pcb *pcb = pConn->pcb;
+	if (pcb == NULL) {
+		return;
 	}
 
-	// ----- RECEIVE COMMAND STRING ------
+	bool sent = false;
+	while (true) {
+		uint32_t tail = pConn->outTail;
+		uint32_t pending = pConn->outHead - tail;
+		uint32_t pos = tail % NETTERM_OUT_BUF_SIZE;
+		uint32_t len = MIN(MIN(pending, NETTERM_OUT_BUF_SIZE - pos), tcp_sndbuf(pcb));
 
-	struct NettermConnArgs *pConnArgs = arg;
+		if ((len == 0) || (tcp_write(pcb, pConn->outBuf + pos, len, TCP_WRITE_FLAG_COPY) != ERR_OK)) {
+			break; // continued when data gets acknowledged
+		}
 
-	size_t len = MIN(p->len, NETTERM_MAX_LINE_LENGTH);
-	memcpy(pConnArgs->inputBuf, p->payload, len);
-	pbuf_free(p);
+		taskENTER_CRITICAL();
+		pConn->outTail = tail + len;
+		if (pConn->outTail == pConn->outHead) {
+			pConn->urgent = false;
+		}
+		taskEXIT_CRITICAL();
 
-	pConnArgs->inputBuf[len] = '\0';
+		sent = true;
+	}
+
+	if (sent) {
+		tcp_output(pcb);
+		xEventGroupSetBits(sRoomEvents, NETTERM_ROOM_BIT(pConn)); // wake all the writers waiting for this session
+	}
+}
+
+// send the output collected so far, runs in the tcpip thread
+static void netterm_flush_timeout(void *pArg) {
+	sFlushTimerArmed = false;
+
+	for (uint32_t i = 0; i < NETTERM_MAX_CONN_CNT; i++) {
+		netterm_push(sConns + i);
+	}
+}
+
+// send the urgent output and delay the rest, runs in the tcpip thread
+static void netterm_flush(void *pArg) {
+	sFlushPending = false;
+
+	bool delayed = false;
+	for (uint32_t i = 0; i < NETTERM_MAX_CONN_CNT; i++) {
+		struct NettermConnArgs *pConn = sConns + i;
+		if (pConn->urgent) {
+			netterm_push(pConn);
+		} else if ((pConn->pcb != NULL) && (pConn->outHead != pConn->outTail)) {
+			delayed = true;
+		}
+	}
 
-	trim_end_nondest(pConnArgs->inputBuf, &len);
+	if (delayed && !sFlushTimerArmed) {
+		sFlushTimerArmed = true;
+		sys_timeout(NETTERM_FLUSH_DELAY_MS, netterm_flush_timeout, NULL);
+	}
+}
 
-	pConnArgs->inputBuf[len] = '\0';
+// make the tcpip thread look at the collected output
+static void netterm_schedule_flush(bool inTcpip) {
+	if (inTcpip) {
+		netterm_flush(NULL);
+		return;
+	}
 
-	// ----- PROCESS COMMANDS ONE-BY-ONE -----
-	char *c = pConnArgs->inputBuf;
-	while (*c != '\0') {
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR(); // usable from interrupts as well
+	bool schedule = !sFlushPending;
+	sFlushPending = true;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
 
-		// ------- EXTRACT COMMAND ---------
+	if (schedule && (tcpip_try_callback(netterm_flush, NULL) != ERR_OK)) {
+		sFlushPending = false; // retried on the next write
+	}
+}
+
+// check if the caller is the tcpip thread
+static bool netterm_in_tcpip() {
+	return (__get_IPSR() == 0) && (xTaskGetCurrentTaskHandle() == sTcpipTH);
+}
 
-		// determine the length of current command
-		char *c_next = c; // beginning of the next command, i. e. end of current one
-		while ((*c_next != '\n') && (*c_next != '\0')) {
-			c_next++;
+// get the handle of a session
+static uint16_t netterm_session_handle(struct NettermConnArgs *pConn) {
+	return (((uint16_t) pConn->gen) << 8) | (pConn - sConns);
+}
+
+int netterm_session_write_record(uint16_t hSession, const void *pData, uint32_t len) {
+	uint32_t slot = hSession & 0xFF;
+	if (slot >= NETTERM_MAX_CONN_CNT) {
+		return -1;
+	}
+
+	struct NettermConnArgs *pConn = sConns + slot;
+	int ret;
+
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+	uint32_t head = pConn->outHead;
+	if ((pConn->pcb == NULL) || (pConn->gen != (hSession >> 8))) {
+		ret = -1;
+	} else if ((NETTERM_OUT_BUF_SIZE - (head - pConn->outTail)) < len) {
+		pConn->txDropped += len;
+		ret = 0;
+	} else {
+		uint32_t pos = head % NETTERM_OUT_BUF_SIZE;
+		uint32_t first = MIN(len, NETTERM_OUT_BUF_SIZE - pos);
+		memcpy(pConn->outBuf + pos, pData, first);
+		memcpy(pConn->outBuf, ((const char*) pData) + first, len - first);
+		pConn->outHead = head + len;
+		pConn->txBytes += len;
+		if ((pConn->outHead - pConn->outTail) >= TCP_MSS) {
+			pConn->urgent = true;
 		}
-		size_t cmdlen = c_next - c; // determine command length from the pointers
-		strncpy(pConnArgs->cmdBuf, c, cmdlen); // extract command
-		trim_end_nondest(pConnArgs->cmdBuf, &cmdlen); // trim trailing whitespaces
-		if (cmdlen == 0) { // if the string contained only whitespaces, then skip processing
-			continue;
+		ret = 1;
+	}
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if (ret == 1) {
+		netterm_schedule_flush(netterm_in_tcpip());
+	}
+
+	return ret;
+}
+
+// copy text into the output ring at head, the telemetry record marker is stripped
+// (clients tell records from text by it), returns the number of bytes stored
+static uint32_t netterm_copy_text(struct NettermConnArgs *pConn, uint32_t head, const char *ptr, uint32_t n) {
+	if (memchr(ptr, TLM_SYNC, n) == NULL) {
+		uint32_t pos = head % NETTERM_OUT_BUF_SIZE;
+		uint32_t first = MIN(n, NETTERM_OUT_BUF_SIZE - pos);
+		memcpy(pConn->outBuf + pos, ptr, first);
+		memcpy(pConn->outBuf, ptr + first, n - first);
+		return n;
+	}
+
+	uint32_t stored = 0;
+	for (uint32_t i = 0; i < n; i++) {
+		if (((uint8_t) ptr[i]) != TLM_SYNC) {
+			pConn->outBuf[(head + stored++) % NETTERM_OUT_BUF_SIZE] = ptr[i];
 		}
-		pConnArgs->cmdBuf[cmdlen] = '\0'; // ...otherwise stub string
+	}
+	return stored;
+}
+
+// write to the output of a session of generation gen, stops if the session gets closed (or its slot reused) meanwhile,
+// waits for room only if allowed by the caller (it must not hold the output lock)
+static void netterm_conn_write(struct NettermConnArgs *pConn, uint8_t gen, const char *ptr, int len, bool mayWait) {
+	bool inIrq = __get_IPSR() != 0;
+	bool inTcpip = netterm_in_tcpip();
+	bool canWait = mayWait && !inIrq && !inTcpip && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING);
+
+	int written = 0;
+	while (written < len) {
+		// copy a piece, unless the session got closed in the meantime
+		UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+		if ((pConn->pcb == NULL) || (pConn->gen != gen)) {
+			taskEXIT_CRITICAL_FROM_ISR(mask);
+			return;
+		}
+
+		uint32_t head = pConn->outHead;
+		uint32_t room = NETTERM_OUT_BUF_SIZE - (head - pConn->outTail);
+		uint32_t n = MIN(MIN((uint32_t) (len - written), room), NETTERM_COPY_CHUNK);
+		pConn->outHead = head + netterm_copy_text(pConn, head, ptr + written, n);
 
-		c = c_next; // move iterator
-		if ((*c) != '\0') { // if we are not at the end of the input string...
-			c++;	// ...advance iterator to the next, unexamined character
+		// complete lines and full segments are sent right away
+		if ((memchr(ptr + written, '\n', n) != NULL) || ((pConn->outHead - pConn->outTail) >= TCP_MSS)) {
+			pConn->urgent = true;
 		}
+		taskEXIT_CRITICAL_FROM_ISR(mask);
 
-		// ---------- PROCESS COMMAND ------------
+		written += n;
+		if ((written == len) || (n > 0)) {
+			continue;
+		}
 
-		if (!strcmp(pConnArgs->cmdBuf, "exit")) {
-			goto close_conn;
-		} else if (!strncmp(pConnArgs->cmdBuf, "msg", 3)) {
-			if (sDefOutputConnection != NULL) {
-				tcp_write(sDefOutputConnection, pConnArgs->cmdBuf + 4, strlen(pConnArgs->cmdBuf) - 4, TCP_WRITE_FLAG_COPY);
-				tcp_write(sDefOutputConnection, "\r\n", 2, TCP_WRITE_FLAG_COPY);
+		// the ring is full
+		if (inTcpip) { // acknowledgements are processed by this very thread, only the send buffer can take more
+			netterm_push(pConn);
+			if (pConn->outHead != pConn->outTail + NETTERM_OUT_BUF_SIZE) {
+				continue;
+			}
+		} else if (canWait) {
+			// the event is cleared before checking the ring again, so a push in between is not missed
+			EventBits_t roomBit = NETTERM_ROOM_BIT(pConn);
+			xEventGroupClearBits(sRoomEvents, roomBit);
+			if ((pConn->outHead - pConn->outTail) < NETTERM_OUT_BUF_SIZE) {
+				continue;
 			}
-		} else if (!strcmp(pConnArgs->cmdBuf, "nodeftty")) {
-			pConnArgs->canBeDefaultOutputTTY = false;
-		} else {
 
-			struct NettermConnArgs *pConnParams = arg;
-			if (pConnParams->canBeDefaultOutputTTY && sDefOutputConnection == NULL) { // set default output if needed
-				sDefOutputConnection = tpcb;
-				RetargetSetOutput(output_netterm);
+			pConn->txWaits++;
+			pConn->urgent = true;
+			netterm_schedule_flush(false);
+			if (xEventGroupWaitBits(sRoomEvents, roomBit, pdFALSE, pdTRUE, pdMS_TO_TICKS(NETTERM_TX_TIMEOUT_MS)) & roomBit) {
+				continue;
 			}
+		}
 
-			// set new output function
-			StreamOutputFunction oldSof = RetargetGetOutput();
-			RetargetSetOutput(output_netterm);
-			sCurrentOutput = tpcb;
+		if (pConn->gen == gen) {
+			pConn->txDropped += len - written;
+		}
+		break;
+	}
 
-			// process line
-			process_cli_line(pConnArgs->cmdBuf);
+	if (pConn->gen != gen) {
+		return; // the slot serves another session by now
+	}
 
-			// restore old output function
-			RetargetSetOutput(oldSof);
-			sCurrentOutput = NULL;
-		}
+	pConn->txBytes += written;
+
+	netterm_schedule_flush(inTcpip);
+}
+
+// mark the slot of a session unused, runs in the tcpip thread
+static void netterm_release_slot(struct NettermConnArgs *pConn) {
+	bool resetOutput = false;
+	taskENTER_CRITICAL();
+	if (sDefOutputConnection == pConn) {
+		sDefOutputConnection = NULL;
+		resetOutput = true;
+	}
+	pConn->pcb = NULL;
+	taskEXIT_CRITICAL();
+
+	// the writers waiting for room give up
+	xEventGroupSetBits(sRoomEvents, NETTERM_ROOM_BIT(pConn));
+
+	// subscriptions are not kept for the next session of the slot
+	tlm_session_closed(netterm_session_handle(pConn));
+
+	// the global output is switched back by the netterm task, the tcpip thread must not wait for the output lock
+	if (resetOutput) {
+		NettermCmd cmd = { .slot = NETTERM_CMD_RESET_OUTPUT };
+		xQueueSendToFront(sCmdQueue, &cmd, 0);
+	}
+}
+
+// release the slot and close the connection, runs in the tcpip thread
+static err_t netterm_close_conn(struct NettermConnArgs *pConn) {
+	struct tcp_pcb *pcb = pConn->pcb;
+
+	netterm_push(pConn); // tcp_close() still sends what was handed over
+	netterm_release_slot(pConn);
 
+	tcp_arg(pcb, NULL);
+	tcp_recv(pcb, NULL);
+	tcp_sent(pcb, NULL);
+	tcp_err(pcb, NULL);
+	if (tcp_close(pcb) != ERR_OK) {
+		tcp_abort(pcb);
+		return ERR_ABRT;
 	}
 
 	return ERR_OK;
+}
+
+// process a complete line, returns false if the session has to be closed, runs in the tcpip thread
+static bool netterm_process_line(struct NettermConnArgs *pConn, char *pLine) {
+	char pResp[TLM_MAX_RESP_LEN + 1];
+
+	if (!strcmp(pLine, "exit")) {
+		return false;
+	} else if (!strncmp(pLine, "msg", 3)) {
+		struct NettermConnArgs *pDef = sDefOutputConnection;
+		if ((pDef != NULL) && (strlen(pLine) > 4)) {
+			netterm_conn_write(pDef, sDefOutputGen, pLine + 4, strlen(pLine) - 4, false);
+			netterm_conn_write(pDef, sDefOutputGen, "\r\n", 2, false);
+		}
+	} else if (!strcmp(pLine, "nodeftty")) {
+		pConn->canBeDefaultOutputTTY = false;
+	} else if (tlm_process_line(netterm_session_handle(pConn), pLine, pResp, TLM_MAX_RESP_LEN)) { // telemetry subscriptions
+		netterm_conn_write(pConn, pConn->gen, pResp, strlen(pResp), false);
+	} else { // pass the command to the netterm task
+		NettermCmd cmd;
+		cmd.slot = pConn - sConns;
+		cmd.gen = pConn->gen;
+		strcpy(cmd.line, pLine);
+		if (xQueueSendToBack(sCmdQueue, &cmd, 0) == pdTRUE) {
+			pConn->cmdCnt++;
+		} else {
+			pConn->cmdDropped++;
+			const char *pcBusy = "Busy, command dropped!\r\n";
+			netterm_conn_write(pConn, pConn->gen, pcBusy, strlen(pcBusy), false);
+		}
+	}
+
+	return true;
+}
+
+static err_t netterm_tcp_recv_cb(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
+	struct NettermConnArgs *pConn = arg;
+
+	if (p == NULL) {
+		goto close_conn;
+	}
+
+	// ----- ASSEMBLE LINES ACROSS SEGMENTS -----
+
+	bool keepOpen = true;
+	for (struct pbuf *q = p; (q != NULL) && keepOpen; q = q->next) {
+		const char *pData = q->payload;
+		for (uint16_t i = 0; (i < q->len) && keepOpen; i++) {
+			char c = pData[i];
+
+			if ((c != '\n') && (c != '\r')) {
+				if (pConn->lineLen < NETTERM_MAX_LINE_LENGTH) {
+					pConn->lineBuf[pConn->lineLen++] = c;
+				} else {
+					pConn->lineOverflow = true; // the rest of the line is discarded
+				}
+				continue;
+			}
+
+			// end of line
+			size_t len = pConn->lineLen;
+			trim_end_nondest(pConn->lineBuf, &len);
+			pConn->lineBuf[len] = '\0';
+
+			if (pConn->lineOverflow) {
+				pConn->cmdDropped++;
+				const char *pcTooLong = "Line too long, dropped!\r\n";
+				netterm_conn_write(pConn, pConn->gen, pcTooLong, strlen(pcTooLong), false);
+			} else if (len > 0) { // lines containing only whitespaces are skipped
+				keepOpen = netterm_process_line(pConn, pConn->lineBuf);
+			}
+
+			pConn->lineLen = 0;
+			pConn->lineOverflow = false;
+		}
+	}
+
+	// open the receive window
+	tcp_recved(tpcb, p->tot_len);
+	pbuf_free(p);
+
+	if (keepOpen) {
+		return ERR_OK;
+	}
 
 	// close connection
 	close_conn:
 
-	if (sDefOutputConnection == tpcb) {
-		RetargetSetOutput(NULL);
-		sDefOutputConnection = NULL;
-	}
+	return netterm_close_conn(pConn);
 
-	tcp_close(tpcb);
-	free(arg);
+}
 
+static err_t netterm_tcp_sent_cb(void *arg, struct tcp_pcb *tpcb, u16_t len) {
+	netterm_push(arg);
 	return ERR_OK;
-
 }
 
 static void netterm_tcp_err_cb(void *arg, err_t err) {
-	printf("TCP error: %d!\n", err);
+	MSG("TCP error: %d!\n", err);
+
+	// the pcb has already been freed
+	netterm_release_slot(arg);
 }
 
-static int output_netterm(char *ptr, int len) {
-	struct tcp_pcb *pcb = (sCurrentOutput == NULL) ? sDefOutputConnection : sCurrentOutput;
-	if (pcb != NULL) {
-		tcp_write(pcb, ptr, len, TCP_WRITE_FLAG_COPY);
+// output of the tasks not redirected (if a session is the default output)
+static int output_netterm_default(char *ptr, int len) {
+	UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+	struct NettermConnArgs *pConn = sDefOutputConnection;
+	uint8_t gen = sDefOutputGen;
+	taskEXIT_CRITICAL_FROM_ISR(mask);
+
+	if (pConn != NULL) {
+		netterm_conn_write(pConn, gen, ptr, len, false); // the output lock is held, never wait
 	}
 	return len;
 }
 
+// output of the netterm task, goes to the session of the command being executed
+// (used by this task alone, it is written without the output lock and can wait for room)
+static int output_netterm_session(char *ptr, int len) {
+	struct NettermConnArgs *pConn = sCurrentOutput;
+	if (pConn != NULL) {
+		netterm_conn_write(pConn, sCurrentGen, ptr, len, true);
+	}
+	return len;
+}
+
+// execute the commands of the sessions
+static void task_netterm(void *pParam) {
+	static NettermCmd cmd;
+
+	RetargetRedirectTask(xTaskGetCurrentTaskHandle(), output_netterm_session, false);
+
+	while (true) {
+		xQueueReceive(sCmdQueue, &cmd, portMAX_DELAY);
+
+		// the default output session got closed
+		if (cmd.slot == NETTERM_CMD_RESET_OUTPUT) {
+			if (sDefOutputConnection == NULL) {
+				RetargetSetOutput(NULL);
+			}
+			continue;
+		}
+
+		// skip the commands of closed sessions
+		struct NettermConnArgs *pConn = sConns + cmd.slot;
+		if ((pConn->pcb == NULL) || (pConn->gen != cmd.gen)) {
+			continue;
+		}
+
+		// set default output if needed
+		if (pConn->canBeDefaultOutputTTY && (sDefOutputConnection == NULL)) {
+			taskENTER_CRITICAL();
+			sDefOutputGen = cmd.gen;
+			sDefOutputConnection = pConn;
+			taskEXIT_CRITICAL();
+			RetargetSetOutput(output_netterm_default);
+		}
+
+		sCurrentGen = cmd.gen;
+		sCurrentOutput = pConn;
+		process_cli_line(cmd.line);
+		sCurrentOutput = NULL;
+	}
+}
+
+// create the command queue and the netterm task
+static void netterm_task_init() {
+	sRoomEvents = xEventGroupCreate();
+	sCmdQueue = xQueueCreate(NETTERM_CMD_QUEUE_LEN, sizeof(NettermCmd));
+
+	BaseType_t result = xTaskCreate(task_netterm, "netterm", sStkSize, NULL, sPrio, &sTH);
+	if (result != pdPASS) { // error handling
+		MSG("Failed to create task! (errcode: %ld)\n", result);
+	}
+}
+
 static err_t netterm_tcp_accept_cb(void *arg, struct tcp_pcb *newpcb, err_t err) {
-	// allocate space for connection parameters
-	struct NettermConnArgs *pConnPar = malloc(sizeof(struct NettermConnArgs));
+	// callbacks run in the tcpip thread, its messages must not wait for the output
+	if (sTcpipTH == NULL) {
+		sTcpipTH = xTaskGetCurrentTaskHandle();
+		dlog_defer_task(sTcpipTH);
+	}
+
+	// find a free slot for the connection
+	struct NettermConnArgs *pConnPar = NULL;
+	for (uint32_t i = 0; (i < NETTERM_MAX_CONN_CNT) && (pConnPar == NULL); i++) {
+		if (sConns[i].pcb == NULL) {
+			pConnPar = sConns + i;
+		}
+	}
+
+	if ((err != ERR_OK) || (pConnPar == NULL)) {
+		tcp_abort(newpcb);
+		return ERR_ABRT;
+	}
+
+	pConnPar->gen++;
 	pConnPar->canBeDefaultOutputTTY = true;
+	pConnPar->lineLen = 0;
+	pConnPar->lineOverflow = false;
+	pConnPar->cmdCnt = pConnPar->cmdDropped = 0;
+	pConnPar->outHead = pConnPar->outTail = 0;
+	pConnPar->urgent = false;
+	pConnPar->txBytes = pConnPar->txWaits = pConnPar->txDropped = 0;
+	pConnPar->pcb = newpcb;
 
 	tcp_arg(newpcb, pConnPar);
 	tcp_recv(newpcb, netterm_tcp_recv_cb);
+	tcp_sent(newpcb, netterm_tcp_sent_cb);
 	tcp_err(newpcb, netterm_tcp_err_cb);
-	tcp_write(newpcb, TERMINAL_LEAD, strlen(TERMINAL_LEAD), TCP_WRITE_FLAG_COPY);
+	netterm_conn_write(pConnPar, pConnPar->gen, TERMINAL_LEAD, strlen(TERMINAL_LEAD), false);
 
 	return ERR_OK;
 }
+
+// ------------------------
+
+// print session statistics
+static int CB_netterm(const CliToken_Type *ppArgs, uint8_t argc) {
+	for (uint32_t i = 0; i < NETTERM_MAX_CONN_CNT; i++) {
+		struct NettermConnArgs *pConn = sConns + i;
+		struct tcp_pcb *pcb = pConn->pcb;
+		if (pcb == NULL) {
+			continue;
+		}
+
+		MSG("#%u %s:%u%s\n", i, ipaddr_ntoa(&pcb->remote_ip), pcb->remote_port, (pConn == sDefOutputConnection) ? " (default output)" : "");
+		MSG("    commands: %u, dropped: %u\n", pConn->cmdCnt, pConn->cmdDropped);
+		MSG("    sent: %u, buffered: %u, waits for room: %u, dropped: %u\n", pConn->txBytes, pConn->outHead - pConn->outTail, pConn->txWaits, pConn->txDropped);
+	}
+
+	return 0;
+}
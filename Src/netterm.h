@@ -12,8 +12,19 @@
 #define NETTERM_BEACON_PORT (8021)
 #define NETTERM_TERMINAL_PORT (235)
 
+#define NETTERM_MAX_CONN_CNT (4) // maximum number of terminal connections
+#define NETTERM_OUT_BUF_SIZE (4096) // size of the output buffer of a connection
+#define NETTERM_FLUSH_DELAY_MS (10) // output not ending in a newline is sent after this delay [ms]
+#define NETTERM_TX_TIMEOUT_MS (1000) // writers waiting for room longer than this drop the rest of their data [ms]
+
+#include <stdint.h>
+
+// sessions are referred to by handles (slot index and slot generation)
+#define NETTERM_SESSION_NONE (0xFFFF)
+
 void netterm_init(); // initialize network terminal
 void netterm_deinit(); // deinitialize...
+int netterm_session_write_record(uint16_t hSession, const void *pData, uint32_t len); // queue a block of data as a whole, never blocks, returns 1: queued, 0: no room (dropped), -1: the session is closed
 
 
 #endif /* NETWORK_TERMINAL_H_ */
@@ -0,0 +1,384 @@
+/*
+ * pcap_tap.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "pcap_tap.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "lwip/tcp.h"
+#include "lwip/prot/ip.h"
+#include "lwip/tcpip.h"
+
+#include "ethernetif.h"
+#include "ptp_classifier.h"
+#include "netterm.h"
+#include "cli.h"
+#include "utils.h"
+
+#define TAP_CLASSIFY_LEN (128) // number of leading bytes examined by the filter
+#define TAP_ALIGN(x) (((x) + 7) & ~7) // records are aligned to 8 bytes
+
+// state of a record in the capture buffer
+typedef enum {
+    TAP_REC_SKIP, // padding at the end of the buffer
+    TAP_REC_PENDING, // Tx frame waiting for its timestamp
+    TAP_REC_READY // ready to be sent
+} TapRecState;
+
+// internal header preceding each record in the capture buffer
+typedef struct {
+    uint16_t state; // TapRecState
+    uint16_t seq; // sequence number, validates Tx record handles
+    uint32_t size; // size of the whole record including this header
+} TapRecHeader;
+
+static uint8_t sBuf[PCAP_TAP_BUF_SIZE] __attribute__((aligned(8))); // capture buffer
+static uint32_t sHead, sTail; // free-running byte indices of the capture buffer
+static uint16_t sSeq; // record sequence number
+
+static struct tcp_pcb *spListen_pcb; // listening pcb
+static struct tcp_pcb *spClient_pcb; // connected client (a single one)
+static volatile bool sCapturing = false; // a client is connected
+static volatile bool sFlushPending = false; // flush is scheduled in the tcpip thread
+static volatile uint8_t sFilter = PCAP_TAP_FILTER_PTP | PCAP_TAP_FILTER_NETTERM; // frame classes to capture
+
+static uint32_t sCaptured, sDropped; // statistics
+
+static int sCliCmd = -1; // handle of the CLI command
+
+// ------------------------
+
+// get the TCP/UDP ports of an IPv4 frame
+static bool get_l4_ports(const uint8_t *pFrame, uint32_t len, uint16_t *pSrc, uint16_t *pDst) {
+    uint32_t offset = 12; // EtherType
+    if (len < offset + 2) {
+        return false;
+    }
+
+    uint16_t etherType = (pFrame[offset] << 8) | pFrame[offset + 1];
+    if (etherType == PTP_CLS_ETHERTYPE_VLAN) {
+        offset += 4;
+        if (len < offset + 2) {
+            return false;
+        }
+        etherType = (pFrame[offset] << 8) | pFrame[offset + 1];
+    }
+    offset += 2;
+
+    if ((etherType != PTP_CLS_ETHERTYPE_IPV4) || (len < offset + 20)) {
+        return false;
+    }
+
+    const uint8_t *pIp = pFrame + offset;
+    uint32_t ihl = (pIp[0] & 0x0F) * 4;
+    if (((pIp[9] != IP_PROTO_TCP) && (pIp[9] != IP_PROTO_UDP)) || (len < offset + ihl + 4)) {
+        return false;
+    }
+
+    *pSrc = (pIp[ihl] << 8) | pIp[ihl + 1];
+    *pDst = (pIp[ihl + 2] << 8) | pIp[ihl + 3];
+    return true;
+}
+
+// decide if a frame should be captured
+static bool tap_filter(struct pbuf *p) {
+    uint8_t pHead[TAP_CLASSIFY_LEN];
+    uint32_t len = pbuf_copy_partial(p, pHead, TAP_CLASSIFY_LEN, 0);
+    uint16_t src, dst;
+    bool l4 = get_l4_ports(pHead, len, &src, &dst);
+
+    // never capture the capture stream
+    if (l4 && ((src == PCAP_TAP_PORT) || (dst == PCAP_TAP_PORT))) {
+        return false;
+    }
+
+    uint8_t filter = sFilter;
+    if (filter == PCAP_TAP_FILTER_ALL) {
+        return true;
+    }
+
+    PtpFrameInfo info;
+    if ((filter & PCAP_TAP_FILTER_PTP) && (ptp_classify_frame(pHead, len, &info) != PTP_FRAME_NONE)) {
+        return true;
+    }
+
+    if ((filter & PCAP_TAP_FILTER_NETTERM) && l4 && ((src == NETTERM_TERMINAL_PORT) || (dst == NETTERM_TERMINAL_PORT))) {
+        return true;
+    }
+
+    return false;
+}
+
+// reserve a record in the capture buffer, returns NULL if the buffer is full
+static TapRecHeader* tap_reserve(uint32_t size, uint16_t *pSeq) {
+    TapRecHeader *pRec = NULL;
+
+    taskENTER_CRITICAL();
+    uint32_t offset = sHead % PCAP_TAP_BUF_SIZE;
+    uint32_t contiguous = PCAP_TAP_BUF_SIZE - offset;
+    uint32_t needed = (size <= contiguous) ? size : (contiguous + size); // records never wrap around
+
+    if ((PCAP_TAP_BUF_SIZE - (sHead - sTail)) >= needed) {
+        if (size > contiguous) { // pad the end of the buffer
+            TapRecHeader *pSkip = (TapRecHeader*) (sBuf + offset);
+            pSkip->state = TAP_REC_SKIP;
+            pSkip->size = contiguous;
+            offset = 0;
+        }
+
+        pRec = (TapRecHeader*) (sBuf + offset);
+        pRec->state = TAP_REC_PENDING;
+        pRec->size = size;
+        sSeq = (sSeq == UINT16_MAX) ? 1 : (sSeq + 1); // zero would make a zero handle
+        pRec->seq = sSeq;
+        *pSeq = pRec->seq;
+        sHead += needed;
+        sCaptured++;
+    } else {
+        sDropped++;
+    }
+    taskEXIT_CRITICAL();
+
+    return pRec;
+}
+
+static void tap_flush(void *pArg);
+
+// mark a record ready and schedule sending it
+static void tap_commit(TapRecHeader *pRec) {
+    taskENTER_CRITICAL();
+    pRec->state = TAP_REC_READY;
+    bool schedule = !sFlushPending;
+    sFlushPending = true;
+    taskEXIT_CRITICAL();
+
+    if (schedule && (tcpip_try_callback(tap_flush, NULL) != ERR_OK)) {
+        sFlushPending = false; // retried on the next commit
+    }
+}
+
+// frame tap callback
+static uint32_t tap_frame_cb(struct pbuf *p, bool tx, uint32_t sec, uint32_t nsec) {
+    if (!sCapturing || !tap_filter(p)) {
+        return 0;
+    }
+
+    uint32_t inclLen = MIN(p->tot_len, PCAP_TAP_SNAPLEN);
+    uint16_t seq;
+    TapRecHeader *pRec = tap_reserve(TAP_ALIGN(sizeof(TapRecHeader) + sizeof(PcapRecordHeader) + inclLen), &seq);
+    if (pRec == NULL) {
+        return 0;
+    }
+
+    // fill the pcap record
+    PcapRecordHeader *pPcapRec = (PcapRecordHeader*) (pRec + 1);
+    pPcapRec->tsSec = sec;
+    pPcapRec->tsFrac = nsec;
+    pPcapRec->inclLen = inclLen;
+    pPcapRec->origLen = p->tot_len;
+    pbuf_copy_partial(p, pPcapRec + 1, inclLen, 0);
+
+    // Tx frames are completed when their timestamp is available
+    if (tx) {
+        return (((uint32_t) seq) << 16) | (((uint8_t*) pRec - sBuf) >> 3);
+    } else {
+        tap_commit(pRec);
+        return 0;
+    }
+}
+
+// Tx done callback, inserts the transmit timestamp
+static void tap_tx_done_cb(uint32_t hRec, bool tsValid, uint32_t sec, uint32_t nsec) {
+    TapRecHeader *pRec = (TapRecHeader*) (sBuf + ((hRec & 0xFFFF) << 3));
+
+    // the buffer may have been reset since the frame was captured
+    if ((pRec->state != TAP_REC_PENDING) || (pRec->seq != (hRec >> 16))) {
+        return;
+    }
+
+    if (tsValid) {
+        PcapRecordHeader *pPcapRec = (PcapRecordHeader*) (pRec + 1);
+        pPcapRec->tsSec = sec;
+        pPcapRec->tsFrac = nsec;
+    }
+
+    tap_commit(pRec);
+}
+
+// send the ready records to the client, runs in the tcpip thread
+static void tap_flush(void *pArg) {
+    sFlushPending = false;
+
+    if (spClient_pcb == NULL) {
+        return;
+    }
+
+    bool sent = false;
+    while (sTail != sHead) {
+        TapRecHeader *pRec = (TapRecHeader*) (sBuf + (sTail % PCAP_TAP_BUF_SIZE));
+
+        if (pRec->state == TAP_REC_PENDING) { // records are sent in order
+            break;
+        }
+
+        if (pRec->state == TAP_REC_READY) {
+            PcapRecordHeader *pPcapRec = (PcapRecordHeader*) (pRec + 1);
+            uint32_t len = sizeof(PcapRecordHeader) + pPcapRec->inclLen;
+
+            if ((tcp_sndbuf(spClient_pcb) < len) || (tcp_write(spClient_pcb, pPcapRec, len, TCP_WRITE_FLAG_COPY) != ERR_OK)) {
+                break; // continued when data gets acknowledged
+            }
+            sent = true;
+        }
+
+        taskENTER_CRITICAL();
+        sTail += pRec->size;
+        taskEXIT_CRITICAL();
+    }
+
+    if (sent) {
+        tcp_output(spClient_pcb);
+    }
+}
+
+// drop every record
+static void tap_reset() {
+    taskENTER_CRITICAL();
+    sTail = sHead = 0;
+    taskEXIT_CRITICAL();
+}
+
+// ------------------------
+
+static void tap_close_client() {
+    sCapturing = false;
+    ethernetif_set_tap(NULL, NULL);
+
+    tcp_arg(spClient_pcb, NULL);
+    tcp_recv(spClient_pcb, NULL);
+    tcp_sent(spClient_pcb, NULL);
+    tcp_err(spClient_pcb, NULL);
+    if (tcp_close(spClient_pcb) != ERR_OK) {
+        tcp_abort(spClient_pcb);
+    }
+    spClient_pcb = NULL;
+
+    tap_reset();
+}
+
+static err_t tap_tcp_sent_cb(void *pArg, struct tcp_pcb *pPCB, u16_t len) {
+    tap_flush(NULL);
+    return ERR_OK;
+}
+
+static err_t tap_tcp_recv_cb(void *pArg, struct tcp_pcb *pPCB, struct pbuf *p, err_t err) {
+    if (p == NULL) { // connection closed by the client
+        tap_close_client();
+        return ERR_OK;
+    }
+
+    // incoming data is ignored
+    tcp_recved(pPCB, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static void tap_tcp_err_cb(void *pArg, err_t err) {
+    // the pcb has already been freed
+    spClient_pcb = NULL;
+    sCapturing = false;
+    ethernetif_set_tap(NULL, NULL);
+    tap_reset();
+}
+
+static err_t tap_tcp_accept_cb(void *pArg, struct tcp_pcb *pNewPCB, err_t err) {
+    // only a single client is served
+    if ((err != ERR_OK) || (spClient_pcb != NULL)) {
+        tcp_abort(pNewPCB);
+        return ERR_ABRT;
+    }
+
+    spClient_pcb = pNewPCB;
+    tcp_recv(pNewPCB, tap_tcp_recv_cb);
+    tcp_sent(pNewPCB, tap_tcp_sent_cb);
+    tcp_err(pNewPCB, tap_tcp_err_cb);
+
+    // send file header
+    PcapFileHeader hdr = {
+            .magic = PCAP_MAGIC_NSEC,
+            .versionMajor = PCAP_VERSION_MAJOR,
+            .versionMinor = PCAP_VERSION_MINOR,
+            .thisZone = 0,
+            .sigFigs = 0,
+            .snapLen = PCAP_TAP_SNAPLEN,
+            .linkType = PCAP_LINKTYPE_ETHERNET };
+    tcp_write(pNewPCB, &hdr, sizeof(hdr), TCP_WRITE_FLAG_COPY);
+    tcp_output(pNewPCB);
+
+    // start capturing
+    tap_reset();
+    ethernetif_set_tap(tap_frame_cb, tap_tx_done_cb);
+    sCapturing = true;
+
+    return ERR_OK;
+}
+
+// ------------------------
+
+// print capture statistics or set the filter
+static int CB_pcaptap(const CliToken_Type *ppArgs, uint8_t argc) {
+    if (argc == 0) {
+        MSG("Client: %s, filter: 0x%02X\n", sCapturing ? "connected" : "none", sFilter);
+        MSG("Captured: %u, dropped: %u\n", sCaptured, sDropped);
+        return 0;
+    }
+
+    uint8_t filter = 0;
+    for (uint8_t i = 0; i < argc; i++) {
+        if (!strcmp(ppArgs[i], "ptp")) {
+            filter |= PCAP_TAP_FILTER_PTP;
+        } else if (!strcmp(ppArgs[i], "netterm")) {
+            filter |= PCAP_TAP_FILTER_NETTERM;
+        } else if (!strcmp(ppArgs[i], "all")) {
+            filter = PCAP_TAP_FILTER_ALL;
+        } else {
+            return -1;
+        }
+    }
+
+    sFilter = filter;
+    return 0;
+}
+
+void pcap_tap_init() {
+    LOCK_TCPIP_CORE();
+    spListen_pcb = tcp_new();
+    tcp_bind(spListen_pcb, IP_ADDR_ANY, PCAP_TAP_PORT);
+    spListen_pcb = tcp_listen(spListen_pcb);
+    tcp_accept(spListen_pcb, tap_tcp_accept_cb);
+    UNLOCK_TCPIP_CORE();
+
+    sCliCmd = cli_register_command("pcaptap [ptp] [netterm] [all] \t\t\tPrint capture statistics or select frames to capture", 1, 0, CB_pcaptap);
+}
+
+void pcap_tap_deinit() {
+    if (sCliCmd >= 0) {
+        cli_remove_command(sCliCmd);
+        sCliCmd = -1;
+    }
+
+    LOCK_TCPIP_CORE();
+    if (spClient_pcb != NULL) {
+        tap_close_client();
+    }
+    tcp_close(spListen_pcb);
+    spListen_pcb = NULL;
+    UNLOCK_TCPIP_CORE();
+}
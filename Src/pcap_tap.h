@@ -0,0 +1,52 @@
+/*
+ * pcap_tap.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef PCAP_TAP_H_
+#define PCAP_TAP_H_
+
+#include <stdint.h>
+
+// Mirrors selected received and transmitted frames along with their hardware
+// timestamps to a TCP client in pcap format (nanosecond resolution), e.g.
+// nc <board-ip> 2236 | wireshark -k -i -
+
+#define PCAP_TAP_PORT (2236) // TCP port of the capture stream
+#define PCAP_TAP_SNAPLEN (256) // frames are truncated to this length
+#define PCAP_TAP_BUF_SIZE (16384) // capture buffer size, power of 2
+
+#define PCAP_MAGIC_NSEC (0xA1B23C4D) // pcap magic number, nanosecond timestamps
+#define PCAP_MAGIC_USEC (0xA1B2C3D4) // pcap magic number, microsecond timestamps
+#define PCAP_VERSION_MAJOR (2)
+#define PCAP_VERSION_MINOR (4)
+#define PCAP_LINKTYPE_ETHERNET (1)
+
+// pcap file header
+typedef struct {
+    uint32_t magic; // magic number
+    uint16_t versionMajor, versionMinor; // format version
+    int32_t thisZone; // GMT to local correction (unused)
+    uint32_t sigFigs; // accuracy of timestamps (unused)
+    uint32_t snapLen; // maximal length of captured frames
+    uint32_t linkType; // data link type
+} PcapFileHeader;
+
+// pcap record header
+typedef struct {
+    uint32_t tsSec; // timestamp seconds
+    uint32_t tsFrac; // timestamp nanoseconds (or microseconds)
+    uint32_t inclLen; // number of bytes captured
+    uint32_t origLen; // length of the frame
+} PcapRecordHeader;
+
+// frame classes to capture
+#define PCAP_TAP_FILTER_PTP (1 << 0) // PTP messages (UDP and 802.3)
+#define PCAP_TAP_FILTER_NETTERM (1 << 1) // network terminal traffic
+#define PCAP_TAP_FILTER_ALL (0xFF) // every frame (except the capture stream itself)
+
+void pcap_tap_init(); // start listening for capture clients
+void pcap_tap_deinit(); // stop capturing and close the connections
+
+#endif /* PCAP_TAP_H_ */
@@ -7,18 +7,141 @@ const uint8_t gPersistentData[PERSISTENT_STORAGE_SIZE] __attribute__((section(".
 
 #include "stm32h7xx_hal.h"
 
+#include "utils.h"
+
 #define FLASH_WORD_SIZE (32)
+#define FLASH_WORD_ROUND_UP(size) (((size) + FLASH_WORD_SIZE - 1) & ~(FLASH_WORD_SIZE - 1))
+
+#define PS_SECTOR_MAGIC (0x50534C47) // 'PSLG'
+#define PS_RECORD_MAGIC (0x50535245) // 'PSRE'
+#define PS_ERASED_WORD (0xFFFFFFFF)
+
+// Layout of a sector: a sector header and the records following it, every
+// structure is aligned to a flash word (the unit of programming). The sector
+// with a valid header of the highest generation is the active one.
+
+// sector header, occupies the first flash word
+typedef struct {
+    uint32_t magic; // PS_SECTOR_MAGIC
+    uint32_t generation; // incremented on every clear and compaction
+    uint32_t crc; // CRC of the fields above
+    uint32_t reserved[5];
+} PsSectorHeader;
+
+// record header, the data follows in the next flash word(s)
+typedef struct {
+    uint32_t magic; // PS_RECORD_MAGIC
+    uint32_t id; // id of the entry
+    uint32_t seq; // sequence number, the highest valid one is the current version
+    uint32_t size; // size of the data
+    uint32_t dataCrc; // CRC of the data
+    uint32_t hdrCrc; // CRC of the fields above
+    uint32_t reserved[2];
+} PsRecordHeader;
+
+#define PS_HDR_CRC_LEN (5 * sizeof(uint32_t)) // bytes of the record header covered by hdrCrc
 
 typedef struct {
-    uint32_t flashAddr; // config location in flash (persistent storage)
-    uint32_t size; // size of config
     uint32_t id; // id of this config entry
+    uint32_t size; // size of config, 0 if the entry was found in flash but not added
+    const PsRecordHeader * pRec; // current version in flash, NULL if none
 } ConfigEntry;
 
 #define MAX_CONFIG_ENTRIES (8)
 static ConfigEntry sEntries[MAX_CONFIG_ENTRIES] = { 0 };
 static uint32_t sEntryCnt = 0;
 
+static int32_t sActive = -1; // index of the active sector, -1 if none carries a valid header
+static uint32_t sGeneration = 0; // generation of the active sector
+static uint32_t sFreeAddr = 0; // start of the unused area in the active sector
+static uint32_t sSeq = 0; // sequence number of the last record
+static uint32_t sRecordCnt = 0; // records in the log
+static uint32_t sCorruptedCnt = 0; // damaged records found
+
+// A flash word torn by a power cut during programming may read back with a
+// double ECC error, which raises a bus fault. While the storage reads its own
+// sectors the fault is survived: ps_bus_fault() skips the faulting load and
+// flags the error, the structure read is treated as damaged.
+static volatile bool sEccGuard = false; // reads of the storage are guarded
+static volatile bool sEccHit = false; // an ECC error has been hit since the last check
+static uint32_t sEccErrCnt = 0; // ECC errors survived
+
+#define PS_SECTOR_BEGIN(idx) (((uint32_t)gPersistentData) + (idx) * PERSISTENT_STORAGE_SECTOR_SIZE)
+#define PS_SECTOR_END(idx) (PS_SECTOR_BEGIN(idx) + PERSISTENT_STORAGE_SECTOR_SIZE)
+
+// compute CRC-32 (poly. 0x04C11DB7) using the CRC unit
+static uint32_t ps_crc(const void * ptr, uint32_t size) {
+    const uint8_t * p = (const uint8_t *)ptr;
+
+    CRC->INIT = 0xFFFFFFFF;
+    CRC->CR = CRC_CR_RESET; // 32-bit polynomial, no bit reversal
+
+    for (; size >= 4; size -= 4, p += 4) {
+        uint32_t word;
+        memcpy(&word, p, 4);
+        CRC->DR = word;
+    }
+    for (; size > 0; size--, p++) {
+        *((__IO uint8_t *)&CRC->DR) = *p;
+    }
+
+    return CRC->DR;
+}
+
+// start guarded reading of the storage
+static void ps_ecc_guard_begin() {
+    sEccHit = false;
+    sEccGuard = true;
+    __COMPILER_BARRIER();
+}
+
+// end guarded reading of the storage
+static void ps_ecc_guard_end() {
+    __COMPILER_BARRIER();
+    sEccGuard = false;
+}
+
+// check and clear the ECC error flag, call after each guarded read
+static bool ps_ecc_hit() {
+    __COMPILER_BARRIER(); // the reads must not be moved past the check
+    bool hit = sEccHit;
+    sEccHit = false;
+    return hit;
+}
+
+bool ps_bus_fault(uint32_t * pFrame) {
+    if (!sEccGuard || !(FLASH->SR2 & FLASH_SR_DBECCERR) || !(SCB->CFSR & SCB_CFSR_PRECISERR_Msk)) {
+        return false;
+    }
+
+    // only errors within the storage are handled
+    uint32_t addr = FLASH_BANK2_BASE + (FLASH->ECC_FA2 & FLASH_ECC_FA_FAIL_ECC_ADDR) * FLASH_WORD_SIZE;
+    if ((addr < (uint32_t)gPersistentData) || (addr >= ((uint32_t)gPersistentData + PERSISTENT_STORAGE_SIZE))) {
+        return false;
+    }
+
+    FLASH->CCR2 = FLASH_CCR_CLR_DBECCERR | FLASH_CCR_CLR_SNECCERR;
+    SCB->CFSR = SCB_CFSR_BUSFAULTSR_Msk; // write 1 to clear
+
+    // skip the faulting load (loads are precise), the first halfword tells the length of a Thumb instruction
+    uint16_t instr = *((const uint16_t *)pFrame[6]);
+    pFrame[6] += ((instr & 0xF800) >= 0xE800) ? 4 : 2;
+
+    sEccHit = true;
+    sEccErrCnt++;
+
+    return true;
+}
+
+static bool ps_is_erased(uint32_t addr, uint32_t size) {
+    for (uint32_t i = 0; i < size; i += 4) {
+        if (*((const uint32_t *)(addr + i)) != PS_ERASED_WORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static ConfigEntry * ps_get_entry_by_id(uint32_t id) {
     uint32_t ei;
     for (ei = 0; ei < sEntryCnt; ei++) {
@@ -29,81 +152,328 @@ static ConfigEntry * ps_get_entry_by_id(uint32_t id) {
     return NULL;
 }
 
-bool ps_add_entry(uint32_t size, uint32_t id) {
-    // check for free space
+static ConfigEntry * ps_create_entry(uint32_t id) {
     if (sEntryCnt == MAX_CONFIG_ENTRIES) {
-        return false;
+        return NULL;
     }
 
-    // check for conflicting id
-    if (ps_get_entry_by_id(id) != NULL) {
+    ConfigEntry * entry = sEntries + sEntryCnt;
+    entry->id = id;
+    entry->size = 0;
+    entry->pRec = NULL;
+
+    sEntryCnt++;
+
+    return entry;
+}
+
+// check the header of a sector, get its generation
+static bool ps_sector_valid(uint32_t idx, uint32_t * pGeneration) {
+    const PsSectorHeader * pSecHdr = (const PsSectorHeader *)PS_SECTOR_BEGIN(idx);
+    if ((pSecHdr->magic != PS_SECTOR_MAGIC) || (pSecHdr->crc != ps_crc(pSecHdr, 2 * sizeof(uint32_t)))) {
         return false;
     }
+    *pGeneration = pSecHdr->generation;
+    return true;
+}
 
-    // new entry can be safely created...
+// scan the log of the active sector and build the index
+static void ps_scan() {
+    sActive = -1;
+    sGeneration = 0;
+    sRecordCnt = 0;
+    sCorruptedCnt = 0;
 
-    // get free address
-    uint32_t freeAddr;
-    if (sEntryCnt == 0) {
-        freeAddr = (uint32_t)gPersistentData;
-    } else {
-        // get first theoretical free address
-        freeAddr = sEntries[sEntryCnt].flashAddr + sEntries[sEntryCnt].size;
+    ps_ecc_guard_begin();
+
+    // select the sector of the highest generation
+    for (uint32_t idx = 0; idx < PERSISTENT_STORAGE_SECTOR_CNT; idx++) {
+        uint32_t generation;
+        bool valid = ps_sector_valid(idx, &generation);
+        if (ps_ecc_hit()) {
+            valid = false;
+        }
+        if (valid && ((sActive < 0) || (generation > sGeneration))) {
+            sActive = idx;
+            sGeneration = generation;
+        }
+    }
 
-        // align address to next 32-byte boundary
-        freeAddr = ((freeAddr % FLASH_WORD_SIZE) != 0) ? ((freeAddr & 0xFFFFFFFFE0) + FLASH_WORD_SIZE) : freeAddr;
+    if (sActive < 0) {
+        ps_ecc_guard_end();
+        return; // not formatted, the storage gets initialized on the first store
     }
 
-    // fill-in entry fields
-    ConfigEntry * entry = sEntries + sEntryCnt;
-    entry->id = id;
-    entry->size = size;
-    entry->flashAddr = freeAddr;
+    uint32_t end = PS_SECTOR_END(sActive);
+    uint32_t addr = PS_SECTOR_BEGIN(sActive) + FLASH_WORD_SIZE;
+    sFreeAddr = end;
+    while (addr < end) {
+        const PsRecordHeader * pRec = (const PsRecordHeader *)addr;
 
-    sEntryCnt++;
+        // end of the log
+        bool erased = ps_is_erased(addr, FLASH_WORD_SIZE);
+        bool torn = ps_ecc_hit();
+        if (erased && !torn) {
+            sFreeAddr = addr;
+            break;
+        }
+
+        // a damaged header cannot be skipped, the rest of the log is given up (until the next compaction),
+        // a header torn by a power cut is handled the same way: the next store finds no room and compacts
+        uint32_t dataAreaSize = FLASH_WORD_ROUND_UP(pRec->size);
+        bool damaged = (pRec->magic != PS_RECORD_MAGIC) || (pRec->hdrCrc != ps_crc(pRec, PS_HDR_CRC_LEN))
+                || (dataAreaSize > (end - addr - FLASH_WORD_SIZE));
+        if (ps_ecc_hit() || torn || damaged) {
+            sCorruptedCnt++;
+            break;
+        }
+
+        sRecordCnt++;
+        sSeq = MAX(sSeq, pRec->seq);
+
+        // only records with intact data are indexed
+        bool intact = (pRec->dataCrc == ps_crc((const void *)(addr + FLASH_WORD_SIZE), pRec->size));
+        if (ps_ecc_hit()) {
+            intact = false;
+        }
+        if (intact) {
+            ConfigEntry * entry = ps_get_entry_by_id(pRec->id);
+            if (entry == NULL) {
+                entry = ps_create_entry(pRec->id);
+            }
+            if ((entry != NULL) && ((entry->pRec == NULL) || (pRec->seq > entry->pRec->seq))) {
+                entry->pRec = pRec;
+            }
+        } else {
+            sCorruptedCnt++;
+        }
+
+        addr += FLASH_WORD_SIZE + dataAreaSize;
+    }
+
+    ps_ecc_guard_end();
+}
+
+void ps_init() {
+    __HAL_RCC_CRC_CLK_ENABLE();
+
+    // ECC errors must raise a bus fault instead of escalating to a hard fault
+    SCB->SHCSR |= SCB_SHCSR_BUSFAULTENA_Msk;
+
+    memset(sEntries, 0, sizeof(sEntries));
+    sEntryCnt = 0;
+    sSeq = 0;
+
+    ps_scan();
+}
+
+bool ps_add_entry(uint32_t size, uint32_t id) {
+    ConfigEntry * entry = ps_get_entry_by_id(id);
+
+    // check for conflicting id
+    if ((entry != NULL) && (entry->size != 0)) {
+        return false;
+    }
+
+    // check for free space
+    if ((entry == NULL) && ((entry = ps_create_entry(id)) == NULL)) {
+        return false;
+    }
+
+    entry->size = size;
 
     return true;
 }
 
-static void ps_write(void * ptr, uint32_t flashAddr, uint32_t size) {
+static void ps_unlock() {
     HAL_FLASH_Unlock();
     __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGSERR);
+}
 
-    uint8_t maskingBuffer[FLASH_WORD_SIZE];
-    int notIntegerSection = (size % FLASH_WORD_SIZE) != 0;
-    uint32_t blockCnt = size / FLASH_WORD_SIZE + notIntegerSection; // determine block count
+// write data to flash word aligned address
+static bool ps_write(const void * ptr, uint32_t flashAddr, uint32_t size) {
+    uint32_t maskingBuffer[FLASH_WORD_SIZE / sizeof(uint32_t)];
+    uint32_t blockCnt = FLASH_WORD_ROUND_UP(size) / FLASH_WORD_SIZE; // determine block count
     for (uint32_t bi = 0; bi < blockCnt; bi++) { // write by 32-bytes
         uint32_t offset = bi * FLASH_WORD_SIZE; // offset
-        uint32_t src = ((uint32_t)ptr) + offset; // source address
+        uint32_t len = MIN(size - offset, FLASH_WORD_SIZE);
 
-        // last iteration, mask out bytes not corresponding to input buffer
-        if (notIntegerSection && (bi + 1) >= blockCnt) {
-            memset(maskingBuffer, 0, FLASH_WORD_SIZE); // clear buffer
-            memcpy(maskingBuffer, (void *)src, size % FLASH_WORD_SIZE);
-            src = (uint32_t)maskingBuffer;
-        }
+        // copy to an aligned buffer, mask out bytes not corresponding to input buffer
+        memset(maskingBuffer, 0xFF, FLASH_WORD_SIZE);
+        memcpy(maskingBuffer, ((const uint8_t *)ptr) + offset, len);
 
         // write!
-        HAL_FLASH_Program(FLASH_TYPEPROGRAM_FLASHWORD, flashAddr + offset, src);
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_FLASHWORD, flashAddr + offset, (uint32_t)maskingBuffer) != HAL_OK) {
+            return false;
+        }
     }
 
-    HAL_FLASH_Lock();
+    return true;
+}
+
+// erase a sector unless it is blank already (a sector with a torn word is never blank)
+static bool ps_erase(uint32_t idx) {
+    ps_ecc_guard_begin();
+    bool erased = ps_is_erased(PS_SECTOR_BEGIN(idx), PERSISTENT_STORAGE_SECTOR_SIZE);
+    erased = !ps_ecc_hit() && erased;
+    ps_ecc_guard_end();
+
+    if (erased) {
+        return true;
+    }
+
+    FLASH_EraseInitTypeDef erase = { 0 };
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Banks = PERSISTENT_STORAGE_BANK;
+    erase.Sector = PERSISTENT_STORAGE_FIRST_SECTOR + idx;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+    uint32_t sectorError;
+    return HAL_FLASHEx_Erase(&erase, &sectorError) == HAL_OK;
 }
 
-void ps_store(uint32_t id, void * ptr) {
+// append a record at addr, the header goes first: an interrupted data write leaves a record with bad data CRC behind
+static const PsRecordHeader * ps_append(uint32_t addr, uint32_t id, uint32_t seq, const void * ptr, uint32_t size) {
+    PsRecordHeader hdr;
+    memset(&hdr, 0xFF, sizeof(hdr));
+    hdr.magic = PS_RECORD_MAGIC;
+    hdr.id = id;
+    hdr.seq = seq;
+    hdr.size = size;
+    hdr.dataCrc = ps_crc(ptr, size);
+    hdr.hdrCrc = ps_crc(&hdr, PS_HDR_CRC_LEN);
+
+    if (!ps_write(&hdr, addr, sizeof(hdr)) || !ps_write(ptr, addr + FLASH_WORD_SIZE, size)) {
+        return NULL;
+    }
+
+    return (const PsRecordHeader *)addr;
+}
+
+// Switch over to the spare sector: copy the current versions (unless clear is
+// set) and commit the sector by writing its header. Until the header is in
+// place, the previous sector remains the active one.
+static bool ps_switch_sector(bool clear) {
+    uint32_t spare = (sActive < 0) ? 0 : ((sActive + 1) % PERSISTENT_STORAGE_SECTOR_CNT);
+    if (!ps_erase(spare)) {
+        return false;
+    }
+
+    // copy the records
+    const PsRecordHeader * newRecs[MAX_CONFIG_ENTRIES] = { 0 };
+    uint32_t addr = PS_SECTOR_BEGIN(spare) + FLASH_WORD_SIZE;
+    uint32_t recordCnt = 0;
+    for (uint32_t ei = 0; ei < sEntryCnt; ei++) {
+        const PsRecordHeader * pRec = sEntries[ei].pRec;
+        if (clear || (pRec == NULL)) {
+            continue;
+        }
+
+        newRecs[ei] = ps_append(addr, pRec->id, pRec->seq, (const uint8_t *)pRec + FLASH_WORD_SIZE, pRec->size);
+        if (newRecs[ei] == NULL) {
+            return false;
+        }
+        addr += FLASH_WORD_SIZE + FLASH_WORD_ROUND_UP(pRec->size);
+        recordCnt++;
+    }
+
+    // commit
+    PsSectorHeader hdr;
+    memset(&hdr, 0xFF, sizeof(hdr));
+    hdr.magic = PS_SECTOR_MAGIC;
+    hdr.generation = sGeneration + 1;
+    hdr.crc = ps_crc(&hdr, 2 * sizeof(uint32_t));
+
+    if (!ps_write(&hdr, PS_SECTOR_BEGIN(spare), sizeof(hdr))) {
+        return false;
+    }
+
+    int32_t prev = sActive;
+
+    sActive = spare;
+    sGeneration = hdr.generation;
+    sFreeAddr = addr;
+    sRecordCnt = recordCnt;
+    sCorruptedCnt = 0;
+    for (uint32_t ei = 0; ei < sEntryCnt; ei++) {
+        sEntries[ei].pRec = newRecs[ei];
+    }
+
+    // the previous sector becomes the spare one
+    if (prev >= 0) {
+        ps_erase(prev);
+    }
+
+    return true;
+}
+
+bool ps_store(uint32_t id, const void * ptr) {
     ConfigEntry * entry = ps_get_entry_by_id(id);
-    if (entry != NULL) {
-        ps_write(ptr, entry->flashAddr, entry->size);
+    if ((entry == NULL) || (entry->size == 0)) {
+        return false;
     }
+
+    // spare the flash if nothing has changed
+    if ((entry->pRec != NULL) && (entry->pRec->size == entry->size)
+            && !memcmp((const uint8_t *)entry->pRec + FLASH_WORD_SIZE, ptr, entry->size)) {
+        return true;
+    }
+
+    ps_unlock();
+
+    bool ok = true;
+    uint32_t recSize = FLASH_WORD_SIZE + FLASH_WORD_ROUND_UP(entry->size);
+    if ((sActive < 0) || (recSize > (PS_SECTOR_END(sActive) - sFreeAddr))) {
+        ok = ps_switch_sector(sActive < 0);
+    }
+
+    if (ok && (recSize <= (PS_SECTOR_END(sActive) - sFreeAddr))) {
+        const PsRecordHeader * pRec = ps_append(sFreeAddr, id, ++sSeq, ptr, entry->size);
+
+        // the area is consumed even if programming fails
+        sFreeAddr += recSize;
+        sRecordCnt++;
+
+        ok = (pRec != NULL);
+        if (ok) {
+            entry->pRec = pRec;
+        }
+    } else {
+        ok = false;
+    }
+
+    HAL_FLASH_Lock();
+
+    return ok;
 }
 
 const void * ps_load(uint32_t id) {
     ConfigEntry * entry = ps_get_entry_by_id(id);
-    return (const void *) entry->flashAddr;
+    if ((entry == NULL) || (entry->pRec == NULL) || (entry->pRec->size != entry->size)) {
+        return NULL;
+    }
+    return (const void *)((uint32_t)entry->pRec + FLASH_WORD_SIZE);
 }
 
-void ps_clear() {
-    HAL_FLASH_Unlock();
-    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGSERR);
-    FLASH_Erase_Sector(FLASH_SECTOR_7, FLASH_BANK_1, VOLTAGE_RANGE_3);
+bool ps_clear() {
+    ps_unlock();
+    bool ok = ps_switch_sector(true);
+    HAL_FLASH_Lock();
+
+    return ok;
+}
+
+void ps_get_info(PsInfo * pInfo) {
+    pInfo->size = PERSISTENT_STORAGE_SECTOR_SIZE;
+    pInfo->used = (sActive >= 0) ? (sFreeAddr - PS_SECTOR_BEGIN(sActive)) : 0;
+    pInfo->records = sRecordCnt;
+    pInfo->entries = 0;
+    for (uint32_t ei = 0; ei < sEntryCnt; ei++) {
+        pInfo->entries += (sEntries[ei].pRec != NULL) ? 1 : 0;
+    }
+    pInfo->generation = sGeneration;
+    pInfo->activeSector = sActive;
+    pInfo->corrupted = sCorruptedCnt;
+    pInfo->eccErrors = sEccErrCnt;
 }
@@ -4,12 +4,48 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define PERSISTENT_STORAGE_SIZE (128 * 1024) // size of persistent storage
+// Persistent storage is an append-only log of records in a flash sector.
+// Storing an entry appends a new version of it (a few flash words), the latest
+// valid version is located through a RAM index built by ps_init(). Records are
+// protected by CRCs, a save interrupted by a power cut leaves the previous
+// version in effect. When the log gets full, the latest versions are copied
+// to the other sector, which is committed by writing its header last.
+//
+// A flash word torn by a power cut reads back with a double ECC error, which
+// raises a bus fault. The fault handler passes it to ps_bus_fault(): while
+// the storage scans its sectors, the read is skipped and the record is taken
+// as damaged. A torn record header ends the log, the next store compacts the
+// intact records into the other sector; a torn word in the spare sector gets
+// erased before the sector is reused.
+//
+// The storage lives on flash bank 2, the code runs from bank 1: programming
+// and erasing does not stall instruction fetches (read-while-write).
+
+#define PERSISTENT_STORAGE_SECTOR_SIZE (128 * 1024) // size of a flash sector
+#define PERSISTENT_STORAGE_SECTOR_CNT (2) // number of sectors used (active and spare)
+#define PERSISTENT_STORAGE_SIZE (PERSISTENT_STORAGE_SECTOR_CNT * PERSISTENT_STORAGE_SECTOR_SIZE) // size of persistent storage
+#define PERSISTENT_STORAGE_BANK (FLASH_BANK_2) // flash bank holding the storage
+#define PERSISTENT_STORAGE_FIRST_SECTOR (FLASH_SECTOR_0) // first flash sector of the storage (within the bank)
 extern const uint8_t gPersistentData[PERSISTENT_STORAGE_SIZE];
 
+// storage usage information
+typedef struct {
+    uint32_t size; // size of a sector
+    uint32_t used; // bytes occupied by the log in the active sector
+    uint32_t records; // number of records in the log (including outdated versions)
+    uint32_t entries; // number of entries having a valid version
+    uint32_t generation; // number of times the storage got cleared or compacted
+    int32_t activeSector; // index of the active sector, -1 if not formatted yet
+    uint32_t corrupted; // number of records found damaged (e.g. interrupted saves)
+    uint32_t eccErrors; // number of ECC errors (torn flash words) survived since startup
+} PsInfo;
+
+void ps_init(); // build the index from the log in flash
 bool ps_add_entry(uint32_t size, uint32_t id); // add entry to persistent storage
-void ps_store(uint32_t id, void * ptr); // store to persistent storage
-const void * ps_load(uint32_t id); // load by id
-void ps_clear(); // clear storage area
+bool ps_store(uint32_t id, const void * ptr); // store to persistent storage
+const void * ps_load(uint32_t id); // load by id, NULL if no valid version is stored
+bool ps_clear(); // clear storage area
+void ps_get_info(PsInfo * pInfo); // get usage information
+bool ps_bus_fault(uint32_t * pFrame); // handle a bus fault hit by reading the storage, pFrame is the exception stack frame, returns false if the fault is not an ECC error of the storage
 
 #endif /* PERSISTENT_STORAGE_H_ */
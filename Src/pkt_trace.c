@@ -0,0 +1,189 @@
+/*
+ * pkt_trace.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "pkt_trace.h"
+
+#if PKT_TRACE_ENABLE == 1
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "utils.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// trace record of a single packet
+typedef struct {
+    const struct pbuf *pPBuf; // traced packet (NULL if the slot is free)
+    uint32_t pStamps[PKT_TRACE_STAGE_CNT]; // cycle counter values
+    uint32_t stampMask; // recorded stages
+} PktTraceRecord;
+
+static volatile uint32_t sIrqCycles; // cycle counter at the last Rx interrupt
+
+static PktTraceRecord sInflight[PKT_TRACE_INFLIGHT_CNT]; // packets being traced
+static uint32_t sInflightIdx; // next in-flight slot to use
+
+static PktTraceRecord sRecords[PKT_TRACE_RECORD_CNT]; // completed records
+static uint32_t sRecordIdx; // free-running write index of the completed records
+
+static uint32_t sSamples[PKT_TRACE_RECORD_CNT]; // scratch area for the histograms
+static volatile bool sFrozen; // completed records are not committed while being evaluated
+
+static const char *spStageNames[PKT_TRACE_STAGE_CNT] = { "irq", "ll_input", "tcpip_input", "ptp_recv", "queue_pop", "processed" };
+
+// find the in-flight record of a packet, the most recent first (call in critical section)
+static PktTraceRecord* pkt_trace_find(const struct pbuf *pP) {
+    for (uint32_t i = 1; i <= PKT_TRACE_INFLIGHT_CNT; i++) {
+        PktTraceRecord *pRec = &sInflight[(sInflightIdx - i) % PKT_TRACE_INFLIGHT_CNT];
+        if (pRec->pPBuf == pP) {
+            return pRec;
+        }
+    }
+    return NULL;
+}
+
+void pkt_trace_irq() {
+    sIrqCycles = DWT_CYCCNT();
+}
+
+void pkt_trace_begin(const struct pbuf *pP) {
+    uint32_t t = DWT_CYCCNT();
+
+    // the oldest slot is reused, records of frames never reaching
+    // the PTP task (ARP, ICMP etc.) are simply overwritten
+    taskENTER_CRITICAL();
+    PktTraceRecord *pRec = &sInflight[sInflightIdx % PKT_TRACE_INFLIGHT_CNT];
+    sInflightIdx++;
+    pRec->pPBuf = pP;
+    pRec->pStamps[PKT_TRACE_IRQ] = sIrqCycles;
+    pRec->pStamps[PKT_TRACE_LL_INPUT] = t;
+    pRec->stampMask = (1 << PKT_TRACE_IRQ) | (1 << PKT_TRACE_LL_INPUT);
+    taskEXIT_CRITICAL();
+}
+
+void pkt_trace_stamp(const struct pbuf *pP, PktTraceStage stage) {
+    uint32_t t = DWT_CYCCNT();
+
+    taskENTER_CRITICAL();
+    PktTraceRecord *pRec = pkt_trace_find(pP);
+    if (pRec != NULL) {
+        pRec->pStamps[stage] = t;
+        pRec->stampMask |= (1 << stage);
+    }
+    taskEXIT_CRITICAL();
+}
+
+void pkt_trace_end(const struct pbuf *pP) {
+    uint32_t t = DWT_CYCCNT();
+
+    taskENTER_CRITICAL();
+    PktTraceRecord *pRec = pkt_trace_find(pP);
+    if (pRec != NULL) {
+        pRec->pStamps[PKT_TRACE_PROCESSED] = t;
+        pRec->stampMask |= (1 << PKT_TRACE_PROCESSED);
+        if (!sFrozen) {
+            sRecords[sRecordIdx % PKT_TRACE_RECORD_CNT] = *pRec;
+            sRecordIdx++;
+        }
+        pRec->pPBuf = NULL;
+    }
+    taskEXIT_CRITICAL();
+}
+
+// convert cycles to nanoseconds, stage latencies are often below a microsecond
+static uint32_t cycles_to_ns(uint32_t cycles) {
+    return (uint32_t) ((((uint64_t) cycles) * 1000) / (SystemCoreClock / 1000000));
+}
+
+static int cmp_u32(const void *pA, const void *pB) {
+    uint32_t a = *((const uint32_t*) pA), b = *((const uint32_t*) pB);
+    return (a > b) - (a < b);
+}
+
+// print the statistics of the collected samples
+static void print_histogram(const char *pName, uint32_t cnt) {
+    if (cnt == 0) {
+        MSG("%s:\t0\n", pName);
+        return;
+    }
+
+    qsort(sSamples, cnt, sizeof(uint32_t), cmp_u32);
+    MSG("%s:\t%u\t%u\t%u\t%u\t%u\n", pName, cnt, cycles_to_ns(sSamples[0]), cycles_to_ns(sSamples[cnt / 2]), cycles_to_ns(sSamples[(cnt * 99) / 100]),
+            cycles_to_ns(sSamples[cnt - 1]));
+}
+
+// collect the samples of a stage (elapsed time since the previous recorded stage) or of the whole path (stage == PKT_TRACE_STAGE_CNT)
+static uint32_t collect_samples(PktTraceStage stage, uint32_t recCnt) {
+    uint32_t cnt = 0;
+
+    for (uint32_t i = 0; i < recCnt; i++) {
+        const PktTraceRecord *pRec = &sRecords[i];
+
+        if (stage == PKT_TRACE_STAGE_CNT) {
+            sSamples[cnt++] = pRec->pStamps[PKT_TRACE_PROCESSED] - pRec->pStamps[PKT_TRACE_IRQ];
+            continue;
+        }
+
+        if (!(pRec->stampMask & (1 << stage))) {
+            continue;
+        }
+
+        // find the previous recorded stage
+        int prev = stage - 1;
+        while ((prev >= 0) && !(pRec->stampMask & (1 << prev))) {
+            prev--;
+        }
+
+        if (prev >= 0) {
+            sSamples[cnt++] = pRec->pStamps[stage] - pRec->pStamps[prev];
+        }
+    }
+
+    return cnt;
+}
+
+// print latency histograms
+static int CB_pkttrace(const CliToken_Type *ppArgs, uint8_t argc) {
+    if (argc > 0) {
+        if (!strcmp(ppArgs[0], "clear")) {
+            taskENTER_CRITICAL();
+            sRecordIdx = 0;
+            taskEXIT_CRITICAL();
+            return 0;
+        }
+        return -1;
+    }
+
+    // freeze the records while evaluating them
+    taskENTER_CRITICAL();
+    sFrozen = true;
+    uint32_t recCnt = MIN(sRecordIdx, PKT_TRACE_RECORD_CNT);
+    taskEXIT_CRITICAL();
+
+    MSG("stage [ns]:\tcount\tmin\tp50\tp99\tmax\n");
+    for (PktTraceStage stage = PKT_TRACE_LL_INPUT; stage < PKT_TRACE_STAGE_CNT; stage++) {
+        print_histogram(spStageNames[stage], collect_samples(stage, recCnt));
+    }
+    print_histogram("total", collect_samples(PKT_TRACE_STAGE_CNT, recCnt));
+
+    sFrozen = false;
+
+    return 0;
+}
+
+void pkt_trace_init() {
+    memset(sInflight, 0, sizeof(sInflight));
+    sInflightIdx = 0;
+    sRecordIdx = 0;
+
+    cli_register_command("pkttrace [clear] \t\t\tPrint/clear per-packet Rx latency histograms", 1, 0, CB_pkttrace);
+}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * pkt_trace.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef PKT_TRACE_H_
+#define PKT_TRACE_H_
+
+#include <stdint.h>
+
+// enable per-packet latency tracing (cycle counter stamps along the receive path)
+#ifndef PKT_TRACE_ENABLE
+#define PKT_TRACE_ENABLE (0)
+#endif
+
+#define PKT_TRACE_INFLIGHT_CNT (32) // number of packets traced concurrently
+#define PKT_TRACE_RECORD_CNT (256) // number of completed records kept for the histograms
+
+// stages of the receive path
+typedef enum {
+    PKT_TRACE_IRQ, // Ethernet Rx interrupt
+    PKT_TRACE_LL_INPUT, // frame fetched by low_level_input()
+    PKT_TRACE_TCPIP_INPUT, // frame entered the tcpip thread (skipped on cut-through)
+    PKT_TRACE_PTP_RECV, // packet handed over to the PTP task's FIFO
+    PKT_TRACE_QUEUE_POP, // packet popped by the PTP task
+    PKT_TRACE_PROCESSED, // ptp_process_packet() completed
+    PKT_TRACE_STAGE_CNT
+} PktTraceStage;
+
+struct pbuf;
+
+#if PKT_TRACE_ENABLE == 1
+
+void pkt_trace_init(); // initialize tracing and register CLI command
+void pkt_trace_irq(); // record the Rx interrupt (ISR context)
+void pkt_trace_begin(const struct pbuf *pP); // start tracing a received frame
+void pkt_trace_stamp(const struct pbuf *pP, PktTraceStage stage); // record a stage of a traced frame
+void pkt_trace_end(const struct pbuf *pP); // record completion and commit the trace record
+
+#define PKT_TRACE_IRQ() pkt_trace_irq()
+#define PKT_TRACE_BEGIN(p) pkt_trace_begin(p)
+#define PKT_TRACE_STAMP(p, stage) pkt_trace_stamp((p), (stage))
+#define PKT_TRACE_END(p) pkt_trace_end(p)
+
+#else
+
+#define pkt_trace_init()
+#define PKT_TRACE_IRQ()
+#define PKT_TRACE_BEGIN(p)
+#define PKT_TRACE_STAMP(p, stage)
+#define PKT_TRACE_END(p)
+
+#endif
+
+#endif /* PKT_TRACE_H_ */
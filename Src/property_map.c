@@ -49,6 +49,51 @@ bool pm_add(const char *pKey, PM_Type type, const void *pField, size_t count) {
 	return true;
 }
 
+// look up a property by its name
+bool pm_find(const char *pKey, PM_Type *pType, const void **ppField, size_t *pCount) {
+	size_t i;
+	for (i = 0; i < sFillLevel; i++) {
+		const PM_Record *pRec = &spRecs[i];
+		if (!strncmp(pRec->pKey, pKey, PM_MAX_PROPERTY_NAME_LENGTH)) {
+			*pType = pRec->type;
+			*ppField = pRec->pField;
+			*pCount = pRec->count;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// size of a single element of a type
+size_t pm_type_size(PM_Type type) {
+	switch (type) {
+	case PMT_STRING:
+	case PMT_CHAR:
+		return sizeof(char);
+	case PMT_INT8:
+	case PMT_UINT8:
+		return sizeof(uint8_t);
+	case PMT_INT16:
+	case PMT_UINT16:
+		return sizeof(uint16_t);
+	case PMT_INT32:
+	case PMT_UINT32:
+		return sizeof(uint32_t);
+	case PMT_INT64:
+	case PMT_UINT64:
+		return sizeof(uint64_t);
+	case PMT_FLOAT:
+		return sizeof(float);
+	case PMT_DOUBLE:
+		return sizeof(double);
+	case PMT_BOOL:
+		return sizeof(bool);
+	default:
+		return 0;
+	}
+}
+
 #define PM_JSON_FIELD_BUF_LEN (1023)
 static char * spJSONFieldBuf;
 
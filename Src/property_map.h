@@ -21,5 +21,7 @@ typedef enum {
 
 bool pm_add(const char *pKey, PM_Type type, const void *pField, size_t count); // add property to map
 void pm_output_json(char *pDestBuf, size_t destBufLen); // output map in json format
+bool pm_find(const char *pKey, PM_Type *pType, const void **ppField, size_t *pCount); // look up a property by its name
+size_t pm_type_size(PM_Type type); // size of a single element of a type (strings: size of a character)
 
 #endif /* PROPERTY_MAP_H_ */
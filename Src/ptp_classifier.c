@@ -0,0 +1,113 @@
+/*
+ * ptp_classifier.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "ptp_classifier.h"
+
+#include <stddef.h>
+
+#define ETH_HEADER_LEN (14) // destination + source address + EtherType
+#define VLAN_TAG_LEN (4) // 802.1Q tag length
+#define IPV4_MIN_HEADER_LEN (20) // IPv4 header without options
+#define IPV4_PROTO_UDP (17) // UDP protocol number
+#define IPV4_FRAG_MASK (0x3FFF) // more fragments flag and fragment offset
+#define UDP_HEADER_LEN (8) // UDP header length
+
+// read a 16-bit big-endian field
+static inline uint16_t read_be16(const uint8_t *p) {
+	return (((uint16_t) p[0]) << 8) | p[1];
+}
+
+// classify PTP over UDP/IPv4 frames, offset points to the IPv4 header
+static PtpFrameClass classify_ipv4(const uint8_t *pFrame, uint32_t len, uint32_t offset, PtpFrameInfo *pInfo) {
+	const uint8_t *pIp = pFrame + offset;
+
+	if (len < offset + IPV4_MIN_HEADER_LEN) {
+		return PTP_FRAME_NONE;
+	}
+
+	// only unfragmented IPv4 datagrams carrying UDP are considered
+	uint32_t ihl = (pIp[0] & 0x0F) * 4;
+	if (((pIp[0] >> 4) != 4) || (ihl < IPV4_MIN_HEADER_LEN) || (pIp[9] != IPV4_PROTO_UDP) || ((read_be16(pIp + 6) & IPV4_FRAG_MASK) != 0)) {
+		return PTP_FRAME_NONE;
+	}
+
+	// the datagram must fit into the frame (the frame may be padded)
+	uint32_t ipLen = read_be16(pIp + 2);
+	if ((ipLen < ihl + UDP_HEADER_LEN) || (offset + ipLen > len)) {
+		return PTP_FRAME_NONE;
+	}
+
+	const uint8_t *pUdp = pIp + ihl;
+	uint16_t dstPort = read_be16(pUdp + 2);
+	uint32_t udpLen = read_be16(pUdp + 4);
+	if ((udpLen < UDP_HEADER_LEN) || (udpLen > ipLen - ihl)) {
+		return PTP_FRAME_NONE;
+	}
+
+	PtpFrameClass cls;
+	if (dstPort == PTP_CLS_UDP_EVENT_PORT) {
+		cls = PTP_FRAME_UDP_EVENT;
+	} else if (dstPort == PTP_CLS_UDP_GENERAL_PORT) {
+		cls = PTP_FRAME_UDP_GENERAL;
+	} else {
+		return PTP_FRAME_NONE;
+	}
+
+	pInfo->payloadOffset = offset + ihl + UDP_HEADER_LEN;
+	pInfo->payloadLen = udpLen - UDP_HEADER_LEN;
+
+	return cls;
+}
+
+// classify a raw Ethernet frame (without FCS)
+PtpFrameClass ptp_classify_frame(const uint8_t *pFrame, uint32_t len, PtpFrameInfo *pInfo) {
+	PtpFrameClass cls = PTP_FRAME_NONE;
+	uint32_t offset = ETH_HEADER_LEN;
+
+	pInfo->cls = PTP_FRAME_NONE;
+	pInfo->payloadOffset = 0;
+	pInfo->payloadLen = 0;
+
+	if ((pFrame == NULL) || (len < ETH_HEADER_LEN)) {
+		return PTP_FRAME_NONE;
+	}
+
+	// skip a single VLAN tag
+	uint16_t etherType = read_be16(pFrame + 12);
+	if (etherType == PTP_CLS_ETHERTYPE_VLAN) {
+		if (len < ETH_HEADER_LEN + VLAN_TAG_LEN) {
+			return PTP_FRAME_NONE;
+		}
+		etherType = read_be16(pFrame + 16);
+		offset += VLAN_TAG_LEN;
+	}
+
+	if (etherType == PTP_CLS_ETHERTYPE_PTP) {
+		cls = PTP_FRAME_L2;
+		pInfo->payloadOffset = offset;
+		pInfo->payloadLen = len - offset; // may contain padding
+
+		// trim the padding based on the messageLength field of the PTP header
+		if (pInfo->payloadLen >= PTP_CLS_MIN_MSG_LEN) {
+			uint16_t msgLen = read_be16(pFrame + offset + 2);
+			if ((msgLen >= PTP_CLS_MIN_MSG_LEN) && (msgLen < pInfo->payloadLen)) {
+				pInfo->payloadLen = msgLen;
+			}
+		}
+	} else if (etherType == PTP_CLS_ETHERTYPE_IPV4) {
+		cls = classify_ipv4(pFrame, len, offset, pInfo);
+	}
+
+	// the message must contain at least a complete PTP header
+	if ((cls == PTP_FRAME_NONE) || (pInfo->payloadLen < PTP_CLS_MIN_MSG_LEN)) {
+		pInfo->payloadOffset = 0;
+		pInfo->payloadLen = 0;
+		return PTP_FRAME_NONE;
+	}
+
+	pInfo->cls = cls;
+	return cls;
+}
@@ -0,0 +1,36 @@
+/*
+ * ptp_classifier.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef PTP_CLASSIFIER_H_
+#define PTP_CLASSIFIER_H_
+
+#include <stdint.h>
+
+#define PTP_CLS_ETHERTYPE_IPV4 (0x0800) // IPv4 EtherType
+#define PTP_CLS_ETHERTYPE_VLAN (0x8100) // 802.1Q VLAN tag
+#define PTP_CLS_ETHERTYPE_PTP (0x88F7) // PTP over IEEE 802.3 EtherType
+#define PTP_CLS_UDP_EVENT_PORT (319) // PTP event message port
+#define PTP_CLS_UDP_GENERAL_PORT (320) // PTP general message port
+#define PTP_CLS_MIN_MSG_LEN (34) // length of the common PTP header
+
+// classes of received frames
+typedef enum {
+	PTP_FRAME_NONE = 0, // not a PTP frame
+	PTP_FRAME_UDP_EVENT, // PTP over UDP/IPv4, event message (port 319)
+	PTP_FRAME_UDP_GENERAL, // PTP over UDP/IPv4, general message (port 320)
+	PTP_FRAME_L2 // PTP over IEEE 802.3 (EtherType 0x88F7)
+} PtpFrameClass;
+
+// result of the classification
+typedef struct {
+	PtpFrameClass cls; // class of the frame
+	uint16_t payloadOffset; // offset of the PTP message from the start of the frame
+	uint16_t payloadLen; // length of the PTP message (without padding)
+} PtpFrameInfo;
+
+PtpFrameClass ptp_classify_frame(const uint8_t *pFrame, uint32_t len, PtpFrameInfo *pInfo); // classify a raw Ethernet frame
+
+#endif /* PTP_CLASSIFIER_H_ */
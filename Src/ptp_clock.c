@@ -0,0 +1,251 @@
+/*
+ * ptp_clock.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "ptp_clock.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "cli.h"
+#include "utils.h"
+#include "property_map.h"
+
+#define NSEC_PER_SEC (1000000000UL)
+
+// Linear model of the PTP clock over the cycle counter. Two copies are kept:
+// the tick interrupt fills the inactive one and then flips the index, so
+// readers (of any priority) never wait for the writer.
+typedef struct {
+    volatile uint32_t version; // incremented on every update
+    uint32_t cyc; // cycle counter at the cross-timestamp
+    uint32_t sec, nsec; // PTP time at the cross-timestamp
+    uint64_t nsPerCycle; // PTP nanoseconds per cycle (Q32)
+    uint32_t stepCnt; // time step count of the HAL at the cross-timestamp
+    uint32_t errNs; // error bound of the extrapolation [ns]
+    bool valid; // the model can be used
+} PtpClockModel;
+
+static ETH_HandleTypeDef *spEth; // interface running the PTP clock
+static PtpClockModel sModels[2]; // double-buffered model
+static volatile uint32_t sActive; // index of the model in use
+static uint64_t sNominalNsPerCycle; // nominal PTP nanoseconds per cycle (Q32)
+static uint32_t sSyncPeriodCycles; // period of the cross-timestamps [cycles]
+static uint32_t sMaxExtrapCycles; // maximal extrapolation distance [cycles]
+static uint32_t sTickCnt; // ticks since the last cross-timestamp
+static uint32_t sErrMaxCur, sErrMaxPrev, sErrWindowCnt; // windowed maximum of the prediction errors
+static PtpClockStats sStats; // statistics
+
+__ITCM_FUNC void ptp_clock_now(uint32_t *pSec, uint32_t *pNsec) {
+    ETH_GetPTPTime(spEth, pSec, pNsec);
+}
+
+uint32_t ptp_clock_now_fast(uint32_t *pSec, uint32_t *pNsec) {
+    const PtpClockModel *pM;
+    uint32_t version, cyc, sec, nsec, errNs, stepCnt;
+    uint64_t nsPerCycle;
+    bool valid;
+
+    // copy the active model, retry if it got updated meanwhile
+    do {
+        pM = &sModels[sActive];
+        version = pM->version;
+        __DMB();
+        cyc = pM->cyc;
+        sec = pM->sec;
+        nsec = pM->nsec;
+        nsPerCycle = pM->nsPerCycle;
+        stepCnt = pM->stepCnt;
+        errNs = pM->errNs;
+        valid = pM->valid;
+        __DMB();
+    } while ((version & 1) || (version != pM->version));
+
+    uint32_t dc = DWT_CYCCNT() - cyc;
+
+    // the MAC is read if the model is unusable, outdated or a time step happened since
+    if (!valid || (dc > sMaxExtrapCycles) || (stepCnt != ETH_GetPTPStepCount(spEth))) {
+        if (spEth == NULL) { // not initialized yet (e.g. early log records)
+            *pSec = *pNsec = 0;
+            return 0;
+        }
+        ptp_clock_now(pSec, pNsec);
+        return 0;
+    }
+
+    // the bound is measured one sync period ahead, the rate error grows linearly with the distance
+    if (dc > sSyncPeriodCycles) {
+        errNs = (uint32_t) ((((uint64_t) errNs) * dc) / sSyncPeriodCycles);
+    }
+
+    nsec += (uint32_t) ((((uint64_t) dc) * nsPerCycle) >> 32);
+    if (nsec >= NSEC_PER_SEC) { // the extrapolation distance is less than a second
+        nsec -= NSEC_PER_SEC;
+        sec++;
+    }
+
+    *pSec = sec;
+    *pNsec = nsec;
+    return errNs;
+}
+
+// take a cross-timestamp: the cycle counter is sampled before and after the MAC readout
+static void ptp_clock_cross_timestamp(uint32_t *pCyc, uint32_t *pSec, uint32_t *pNsec) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t c1 = DWT_CYCCNT();
+    ETH_GetPTPTime(spEth, pSec, pNsec);
+    uint32_t c2 = DWT_CYCCNT();
+    __set_PRIMASK(primask);
+
+    *pCyc = c1 + (c2 - c1) / 2;
+}
+
+// update the model with a new cross-timestamp (tick interrupt)
+static void ptp_clock_sync() {
+    const PtpClockModel *pCur = &sModels[sActive];
+    PtpClockModel *pNext = &sModels[sActive ^ 1];
+
+    uint32_t stepCnt = ETH_GetPTPStepCount(spEth);
+    uint32_t cyc, sec, nsec;
+    ptp_clock_cross_timestamp(&cyc, &sec, &nsec);
+
+    uint64_t nsPerCycle = pCur->valid ? pCur->nsPerCycle : sNominalNsPerCycle;
+    bool restart = true;
+
+    if (pCur->valid && (pCur->stepCnt == stepCnt)) {
+        uint32_t dc = cyc - pCur->cyc;
+        int64_t dPtp = (((int64_t) sec) - pCur->sec) * (int64_t) NSEC_PER_SEC + (((int64_t) nsec) - pCur->nsec);
+
+        if ((dc > 0) && (dc <= sMaxExtrapCycles) && (dPtp > 0)) {
+            int64_t err = dPtp - (int64_t) ((((uint64_t) dc) * pCur->nsPerCycle) >> 32);
+            if ((err < PTP_CLOCK_STEP_THRESHOLD_NS) && (err > -PTP_CLOCK_STEP_THRESHOLD_NS)) {
+                // refine the rate estimate
+                uint64_t meas = (((uint64_t) dPtp) << 32) / dc;
+                nsPerCycle = pCur->nsPerCycle + ((((int64_t) meas) - ((int64_t) pCur->nsPerCycle)) >> PTP_CLOCK_RATE_FILTER_SHIFT);
+
+                // evaluate the prediction error
+                uint32_t absErr = (uint32_t) ((err < 0) ? -err : err);
+                sStats.lastErrNs = (int32_t) err;
+                sStats.maxErrNs = MAX(sStats.maxErrNs, absErr);
+                sErrMaxCur = MAX(sErrMaxCur, absErr);
+                if (++sErrWindowCnt >= PTP_CLOCK_ERR_WINDOW) {
+                    sErrMaxPrev = sErrMaxCur;
+                    sErrMaxCur = 0;
+                    sErrWindowCnt = 0;
+                }
+
+                restart = false;
+            }
+        }
+    }
+
+    if (restart) { // time step or missed cross-timestamps, the error bound is unknown
+        sStats.resets++;
+        sErrMaxCur = sErrMaxPrev = PTP_CLOCK_STEP_THRESHOLD_NS;
+        sErrWindowCnt = 0;
+    }
+
+    // fill the inactive model and switch over
+    pNext->version++;
+    __DMB();
+    pNext->cyc = cyc;
+    pNext->sec = sec;
+    pNext->nsec = nsec;
+    pNext->nsPerCycle = nsPerCycle;
+    pNext->stepCnt = stepCnt;
+    pNext->errNs = MAX(sErrMaxCur, sErrMaxPrev);
+    pNext->valid = true;
+    __DMB();
+    pNext->version++;
+    __DMB();
+    sActive ^= 1;
+
+    sStats.syncs++;
+}
+
+void ptp_clock_tick() {
+    if (spEth == NULL) {
+        return;
+    }
+
+    if (++sTickCnt >= PTP_CLOCK_SYNC_PERIOD_MS) {
+        sTickCnt = 0;
+        ptp_clock_sync();
+    }
+}
+
+void ptp_clock_get_stats(PtpClockStats *pStats) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *pStats = sStats;
+    pStats->errBoundNs = MAX(sErrMaxCur, sErrMaxPrev);
+    int64_t dev = ((int64_t) sModels[sActive].nsPerCycle) - ((int64_t) sNominalNsPerCycle);
+    __set_PRIMASK(primask);
+
+    pStats->rateDevPpb = (int32_t) ((dev * 1000000000LL) / (int64_t) sNominalNsPerCycle);
+}
+
+#define PTP_CLOCK_BENCH_ROUNDS (64) // number of readouts the cost is averaged over
+
+// print extrapolation statistics and readout costs
+static int CB_ptpclock(const CliToken_Type *ppArgs, uint8_t argc) {
+    if (argc > 0) {
+        if (!strcmp(ppArgs[0], "clear")) {
+            uint32_t primask = __get_PRIMASK();
+            __disable_irq();
+            sStats.maxErrNs = 0;
+            sStats.resets = 0;
+            __set_PRIMASK(primask);
+            return 0;
+        }
+        return -1;
+    }
+
+    PtpClockStats stats;
+    ptp_clock_get_stats(&stats);
+
+    // measure the cost of both readout methods
+    uint32_t sec, nsec;
+    uint32_t t0 = DWT_CYCCNT();
+    for (uint32_t i = 0; i < PTP_CLOCK_BENCH_ROUNDS; i++) {
+        ptp_clock_now(&sec, &nsec);
+    }
+    uint32_t t1 = DWT_CYCCNT();
+    for (uint32_t i = 0; i < PTP_CLOCK_BENCH_ROUNDS; i++) {
+        ptp_clock_now_fast(&sec, &nsec);
+    }
+    uint32_t t2 = DWT_CYCCNT();
+
+    MSG("Cross-timestamps: %u (every %u ms), model restarts: %u\n", stats.syncs, PTP_CLOCK_SYNC_PERIOD_MS, stats.resets);
+    MSG("Rate deviation: %d ppb\n", stats.rateDevPpb);
+    MSG("Prediction error [ns]: last %d, max. %u, recent bound %u\n", stats.lastErrNs, stats.maxErrNs, stats.errBoundNs);
+    MSG("Readout cost [cycles]: MAC %u, extrapolated %u\n", (t1 - t0) / PTP_CLOCK_BENCH_ROUNDS, (t2 - t1) / PTP_CLOCK_BENCH_ROUNDS);
+
+    return 0;
+}
+
+void ptp_clock_init(ETH_HandleTypeDef *heth) {
+    memset(sModels, 0, sizeof(sModels));
+    memset(&sStats, 0, sizeof(sStats));
+    sActive = 0;
+    sTickCnt = 0;
+    sErrMaxCur = sErrMaxPrev = PTP_CLOCK_STEP_THRESHOLD_NS;
+    sErrWindowCnt = 0;
+
+    sNominalNsPerCycle = (((uint64_t) NSEC_PER_SEC) << 32) / SystemCoreClock;
+    sSyncPeriodCycles = (SystemCoreClock / 1000) * PTP_CLOCK_SYNC_PERIOD_MS;
+    sMaxExtrapCycles = (SystemCoreClock / 1000) * PTP_CLOCK_MAX_EXTRAP_MS;
+
+    spEth = heth; // enables the cross-timestamps
+
+    // published for telemetry
+    pm_add("ptpclock.syncs", PMT_UINT32, &sStats.syncs, 1);
+    pm_add("ptpclock.resets", PMT_UINT32, &sStats.resets, 1);
+    pm_add("ptpclock.lastErrNs", PMT_INT32, &sStats.lastErrNs, 1);
+    pm_add("ptpclock.maxErrNs", PMT_UINT32, &sStats.maxErrNs, 1);
+
+    cli_register_command("ptpclock [clear] \t\t\tPrint PTP clock extrapolation statistics and readout costs", 1, 0, CB_ptpclock);
+}
@@ -0,0 +1,43 @@
+/*
+ * ptp_clock.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef PTP_CLOCK_H_
+#define PTP_CLOCK_H_
+
+#include <stdint.h>
+
+#include "stm32h7xx_hal.h"
+
+// PTP clock read API. ptp_clock_now() reads the MAC (a few AHB accesses),
+// ptp_clock_now_fast() extrapolates from the last cycle counter <-> PTP
+// cross-timestamp and does not touch the peripheral. Cross-timestamps are
+// taken from the tick interrupt, the extrapolation error is measured at
+// each of them and reported along with the fast readouts, scaled up for
+// readouts further than a sync period from the last cross-timestamp.
+
+#define PTP_CLOCK_SYNC_PERIOD_MS (10) // period of the cross-timestamps [ms]
+#define PTP_CLOCK_MAX_EXTRAP_MS (100) // fast reads fall back to the MAC if the last cross-timestamp is older than this [ms]
+#define PTP_CLOCK_STEP_THRESHOLD_NS (10000) // prediction errors above this restart the model [ns]
+#define PTP_CLOCK_RATE_FILTER_SHIFT (4) // rate estimate smoothing, 2^-N weight of a new measurement
+#define PTP_CLOCK_ERR_WINDOW (100) // number of cross-timestamps the error bound is evaluated over
+
+// statistics of the extrapolation
+typedef struct {
+    uint32_t syncs; // number of cross-timestamps taken
+    uint32_t resets; // number of model restarts (time steps, missed cross-timestamps)
+    int32_t lastErrNs; // prediction error at the last cross-timestamp [ns]
+    uint32_t maxErrNs; // maximal absolute prediction error since clear [ns]
+    uint32_t errBoundNs; // recent maximal absolute prediction error [ns]
+    int32_t rateDevPpb; // deviation of the PTP clock from the nominal cycle counter rate [ppb]
+} PtpClockStats;
+
+void ptp_clock_init(ETH_HandleTypeDef *heth); // initialize the clock API and register CLI command
+void ptp_clock_tick(); // take cross-timestamps periodically, call from the 1 ms tick interrupt
+void ptp_clock_now(uint32_t *pSec, uint32_t *pNsec); // read the PTP clock (tear-free)
+uint32_t ptp_clock_now_fast(uint32_t *pSec, uint32_t *pNsec); // get the extrapolated PTP time, returns the error bound at the extrapolation distance [ns] (0 if the MAC was read)
+void ptp_clock_get_stats(PtpClockStats *pStats); // get extrapolation statistics
+
+#endif /* PTP_CLOCK_H_ */
@@ -0,0 +1,326 @@
+/*
+ * ptp_sched.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "ptp_sched.h"
+#include "ptp_clock.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cli.h"
+#include "utils.h"
+
+#include <string.h>
+
+static ETH_HandleTypeDef *spEth; // interface running the PTP clock
+static PtpSchedTimer *spHead; // timers sorted by their deadlines
+static PtpSchedStats sStats; // statistics
+static uint32_t sStepCnt; // time step count of the HAL the timers are anchored to
+
+// The lock masks interrupts up to the syscall priority (including the Ethernet
+// interrupt), it can be taken both from tasks and from interrupts.
+static inline uint32_t ptp_sched_lock() {
+    return portSET_INTERRUPT_MASK_FROM_ISR();
+}
+
+static inline void ptp_sched_unlock(uint32_t mask) {
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+// get the current PTP time in nanoseconds
+__ITCM_FUNC static int64_t ptp_sched_now() {
+    uint32_t sec, nsec;
+    ptp_clock_now(&sec, &nsec);
+    return ((int64_t) sec) * PTP_SCHED_NSEC_PER_SEC + nsec;
+}
+
+// clamp a quantity into 32 bits
+static inline uint32_t ptp_sched_sat_u32(int64_t x) {
+    return (x < 0) ? 0 : ((x > (int64_t) UINT32_MAX) ? UINT32_MAX : (uint32_t) x);
+}
+
+// add to a saturating counter
+static inline uint32_t ptp_sched_sat_add(uint32_t cnt, int64_t x) {
+    return ptp_sched_sat_u32(((int64_t) cnt) + x);
+}
+
+// the earliest deadline n * period + phase being far enough in the future
+__ITCM_FUNC static int64_t ptp_sched_align(uint64_t periodNs, uint64_t phaseNs) {
+    int64_t now = ptp_sched_now() + PTP_SCHED_MIN_LEAD_NS;
+    int64_t n = (now - (int64_t) phaseNs) / (int64_t) periodNs + 1;
+    return n * (int64_t) periodNs + (int64_t) phaseNs;
+}
+
+// insert a timer into the sorted list, timers of equal deadlines keep their insertion order (call with lock taken)
+__ITCM_FUNC static void ptp_sched_insert(PtpSchedTimer *pTimer) {
+    PtpSchedTimer **ppIter = &spHead;
+    while ((*ppIter != NULL) && ((*ppIter)->deadline <= pTimer->deadline)) {
+        ppIter = &((*ppIter)->pNext);
+    }
+    pTimer->pNext = *ppIter;
+    *ppIter = pTimer;
+    pTimer->active = true;
+}
+
+// remove a timer from the list (call with lock taken)
+__ITCM_FUNC static void ptp_sched_remove(PtpSchedTimer *pTimer) {
+    PtpSchedTimer **ppIter = &spHead;
+    while (*ppIter != NULL) {
+        if (*ppIter == pTimer) {
+            *ppIter = pTimer->pNext;
+            break;
+        }
+        ppIter = &((*ppIter)->pNext);
+    }
+    pTimer->pNext = NULL;
+    pTimer->active = false;
+}
+
+// program the deadline of the first timer into the MAC (call with lock taken)
+__ITCM_FUNC static void ptp_sched_program() {
+    if (spHead == NULL) {
+        return; // a target time left in the past does not trigger again
+    }
+
+    // a target time too close or already in the past would be missed
+    int64_t target = spHead->deadline;
+    int64_t earliest = ptp_sched_now() + PTP_SCHED_MIN_LEAD_NS;
+    if (target < earliest) {
+        target = earliest;
+    }
+
+    if (!ETH_SetPTPTargetTime(spEth, (uint32_t) (target / PTP_SCHED_NSEC_PER_SEC), (uint32_t) (target % PTP_SCHED_NSEC_PER_SEC))) {
+        sStats.progErr++;
+    }
+}
+
+#define PTP_SCHED_STEP_BUSY_TIMEOUT (1000) // maximal number of polls of the time update flag
+
+// Re-anchor the periodic timers if the clock has been stepped since they were
+// scheduled, otherwise a backward step would stall them and a forward step
+// would count the periods passed over as missed (call with lock taken).
+__ITCM_FUNC static void ptp_sched_check_step(uint32_t stepCnt) {
+    if (stepCnt == sStepCnt) {
+        return;
+    }
+
+    // the MAC takes over the step within a few clock cycles, if it does not
+    // (e.g. the PTP block is stopped), it is checked again on the next tick
+    uint32_t polls = 0;
+    while (spEth->Instance->MACTSCR & ETH_MACTSCR_TSUPDT) {
+        if (++polls >= PTP_SCHED_STEP_BUSY_TIMEOUT) {
+            return;
+        }
+    }
+
+    sStepCnt = stepCnt;
+    sStats.steps++;
+
+    // rebuild the list, one-shot timers keep their deadlines
+    PtpSchedTimer *pIter = spHead;
+    spHead = NULL;
+    while (pIter != NULL) {
+        PtpSchedTimer *pNext = pIter->pNext;
+        if (pIter->period > 0) {
+            pIter->deadline = ptp_sched_align(pIter->period, pIter->phase);
+        }
+        ptp_sched_insert(pIter);
+        pIter = pNext;
+    }
+
+    ptp_sched_program();
+}
+
+// add a timer, reprogram the MAC if it became the first one
+static void ptp_sched_add(PtpSchedTimer *pTimer) {
+    uint32_t mask = ptp_sched_lock();
+    if (pTimer->active) {
+        ptp_sched_remove(pTimer);
+    }
+    ptp_sched_insert(pTimer);
+    if (spHead == pTimer) {
+        ptp_sched_program();
+    }
+    ptp_sched_unlock(mask);
+}
+
+int ptp_sched_at(PtpSchedTimer *pTimer, uint32_t sec, uint32_t nsec, PtpSchedCb cb, void *pArg) {
+    if ((spEth == NULL) || (cb == NULL) || (nsec >= PTP_SCHED_NSEC_PER_SEC)) {
+        return -1;
+    }
+
+    ptp_sched_cancel(pTimer);
+
+    pTimer->deadline = ((int64_t) sec) * PTP_SCHED_NSEC_PER_SEC + nsec;
+    pTimer->period = 0;
+    pTimer->phase = 0;
+    pTimer->cb = cb;
+    pTimer->pArg = pArg;
+    pTimer->missed = 0;
+
+    ptp_sched_add(pTimer);
+
+    return 0;
+}
+
+int ptp_sched_periodic(PtpSchedTimer *pTimer, uint64_t periodNs, uint64_t phaseNs, PtpSchedCb cb, void *pArg) {
+    // deadlines are aligned to the PTP second only if the period divides it or is a multiple of it
+    if ((spEth == NULL) || (cb == NULL) || (periodNs == 0) || (phaseNs >= periodNs)
+            || (((PTP_SCHED_NSEC_PER_SEC % periodNs) != 0) && ((periodNs % PTP_SCHED_NSEC_PER_SEC) != 0))) {
+        return -1;
+    }
+
+    ptp_sched_cancel(pTimer);
+
+    // first deadline: the earliest aligned instant being far enough in the future
+    pTimer->deadline = ptp_sched_align(periodNs, phaseNs);
+    pTimer->period = periodNs;
+    pTimer->phase = phaseNs;
+    pTimer->cb = cb;
+    pTimer->pArg = pArg;
+    pTimer->missed = 0;
+
+    ptp_sched_add(pTimer);
+
+    return 0;
+}
+
+void ptp_sched_cancel(PtpSchedTimer *pTimer) {
+    uint32_t mask = ptp_sched_lock();
+    if (pTimer->active) {
+        ptp_sched_remove(pTimer);
+        // the target time of a removed first timer is left in place,
+        // the spurious interrupt finds nothing due and reprograms the MAC
+    }
+    ptp_sched_unlock(mask);
+}
+
+void ptp_sched_get_stats(PtpSchedStats *pStats) {
+    uint32_t mask = ptp_sched_lock();
+    *pStats = sStats;
+    ptp_sched_unlock(mask);
+}
+
+// A backward step leaves the programmed target time far ahead, its interrupt
+// would not come in time, so steps are also looked for periodically.
+void ptp_sched_tick() {
+    if ((spEth == NULL) || (ETH_GetPTPStepCount(spEth) == sStepCnt)) {
+        return;
+    }
+
+    uint32_t mask = ptp_sched_lock();
+    ptp_sched_check_step(ETH_GetPTPStepCount(spEth));
+    ptp_sched_unlock(mask);
+}
+
+// Invoke the callbacks of the due timers. Every timer whose deadline has passed
+// is fired, regardless of the status flags: they might have been cleared by
+// another reader of the timestamp status register (e.g. auxiliary snapshots).
+__ITCM_FUNC void HAL_ETH_PTPTimestampCallback(ETH_HandleTypeDef *heth, uint32_t tsStatus) {
+    if (spEth == NULL) {
+        return;
+    }
+
+    while (true) {
+        uint32_t mask = ptp_sched_lock();
+
+        ptp_sched_check_step(ETH_GetPTPStepCount(spEth));
+
+        PtpSchedTimer *pTimer = spHead;
+        if (pTimer == NULL) {
+            ptp_sched_unlock(mask);
+            break;
+        }
+
+        int64_t now = ptp_sched_now();
+        int64_t deadline = pTimer->deadline;
+        if (deadline > now) {
+            if ((deadline - now) > PTP_SCHED_SPIN_NS) {
+                ptp_sched_program(); // not due yet, wait for the next interrupt
+                ptp_sched_unlock(mask);
+                break;
+            }
+
+            // deadline is too close to program, wait for it here
+            while (now < deadline) {
+                now = ptp_sched_now();
+            }
+        }
+
+        // take the timer out, periodic timers are rescheduled right away
+        ptp_sched_remove(pTimer);
+        if (pTimer->period > 0) {
+            int64_t period = (int64_t) pTimer->period;
+            int64_t next = deadline + period;
+            if (next <= now) { // skip the missed periods (e.g. long interrupt latency)
+                int64_t skipped = (now - deadline) / period;
+                next += skipped * period;
+                pTimer->missed = ptp_sched_sat_add(pTimer->missed, skipped);
+                sStats.missed = ptp_sched_sat_add(sStats.missed, skipped);
+            }
+            pTimer->deadline = next;
+            ptp_sched_insert(pTimer);
+        }
+
+        uint32_t late = ptp_sched_sat_u32(now - deadline);
+        sStats.fired++;
+        sStats.lastLateNs = late;
+        if (late > sStats.maxLateNs) {
+            sStats.maxLateNs = late;
+        }
+
+        PtpSchedCb cb = pTimer->cb;
+        void *pArg = pTimer->pArg;
+
+        ptp_sched_unlock(mask);
+
+        // the callback may reschedule or cancel any timer (including this one)
+        cb(pArg, (uint32_t) (deadline / PTP_SCHED_NSEC_PER_SEC), (uint32_t) (deadline % PTP_SCHED_NSEC_PER_SEC));
+    }
+}
+
+// print scheduler statistics
+static int CB_ptpsched(const CliToken_Type *ppArgs, uint8_t argc) {
+    if (argc > 0) {
+        if (!strcmp(ppArgs[0], "clear")) {
+            uint32_t mask = ptp_sched_lock();
+            memset(&sStats, 0, sizeof(sStats));
+            ptp_sched_unlock(mask);
+            return 0;
+        }
+        return -1;
+    }
+
+    PtpSchedStats stats;
+    uint32_t active = 0;
+
+    uint32_t mask = ptp_sched_lock();
+    stats = sStats;
+    for (PtpSchedTimer *pIter = spHead; pIter != NULL; pIter = pIter->pNext) {
+        active++;
+    }
+    ptp_sched_unlock(mask);
+
+    MSG("Active timers: %u\n", active);
+    MSG("Callbacks fired: %u\n", stats.fired);
+    MSG("Periods missed: %u\n", stats.missed);
+    MSG("Target time programming failures: %u\n", stats.progErr);
+    MSG("Re-anchored after time steps: %u\n", stats.steps);
+    MSG("Lateness [ns]: last %u, max. %u\n", stats.lastLateNs, stats.maxLateNs);
+
+    return 0;
+}
+
+void ptp_sched_init(ETH_HandleTypeDef *heth) {
+    spHead = NULL;
+    memset(&sStats, 0, sizeof(sStats));
+    sStepCnt = ETH_GetPTPStepCount(heth);
+    spEth = heth;
+
+    ETH_EnablePTPTargetTimeInterrupt(heth, true);
+
+    cli_register_command("ptpsched [clear] \t\t\tPrint/clear PTP-time scheduler statistics", 1, 0, CB_ptpsched);
+}
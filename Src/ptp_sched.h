@@ -0,0 +1,65 @@
+/*
+ * ptp_sched.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef PTP_SCHED_H_
+#define PTP_SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stm32h7xx_hal.h"
+
+// Event scheduler running on the PTP clock. Timers are kept in a list sorted
+// by their deadlines, only the earliest deadline is programmed into the MAC's
+// target time registers. Callbacks are invoked from the Ethernet interrupt.
+//
+// The scheduler owns the target time of the MAC: starting a PPS pulse train
+// (ETH_StartPTPPPSPulseTrain()) overwrites it and stops the scheduler.
+// The fixed frequency PPS output (ETH_SetPTPPPSFreq()) can be used along with it.
+//
+// Time steps of the PTP clock are detected by the step counter of the HAL:
+// periodic timers are re-anchored to the new timeline (the periods passed over
+// by a forward step are not counted as missed), one-shot timers keep their
+// absolute deadlines.
+
+#define PTP_SCHED_MIN_LEAD_NS (2000) // minimal distance of the programmed target time from the current time
+#define PTP_SCHED_SPIN_NS (2000) // deadlines closer than this are waited for in the interrupt instead of programming the target time
+
+#define PTP_SCHED_NSEC_PER_SEC (1000000000LL)
+
+// timer callback, sec and nsec hold the deadline the timer was scheduled for (interrupt context)
+typedef void (*PtpSchedCb)(void *pArg, uint32_t sec, uint32_t nsec);
+
+// timer (storage provided by the user, must not be touched while active)
+typedef struct PtpSchedTimer_ {
+    struct PtpSchedTimer_ *pNext; // next timer in the list
+    int64_t deadline; // next deadline [ns]
+    uint64_t period; // period [ns], 0 for one-shot timers
+    uint64_t phase; // phase relative to the PTP second [ns] (periodic timers)
+    PtpSchedCb cb; // callback
+    void *pArg; // callback argument
+    uint32_t missed; // number of periods skipped, saturates
+    bool active; // the timer is in the list
+} PtpSchedTimer;
+
+// scheduler statistics
+typedef struct {
+    uint32_t fired; // number of callbacks invoked
+    uint32_t missed; // number of periods skipped, saturates
+    uint32_t progErr; // number of failed target time programming attempts
+    uint32_t steps; // number of time steps periodic timers were re-anchored after
+    uint32_t lastLateNs; // lateness of the last callback [ns], saturates
+    uint32_t maxLateNs; // maximal lateness [ns], saturates
+} PtpSchedStats;
+
+void ptp_sched_init(ETH_HandleTypeDef *heth); // initialize the scheduler and register CLI command
+int ptp_sched_at(PtpSchedTimer *pTimer, uint32_t sec, uint32_t nsec, PtpSchedCb cb, void *pArg); // call cb at PTP time sec.nsec once
+int ptp_sched_periodic(PtpSchedTimer *pTimer, uint64_t periodNs, uint64_t phaseNs, PtpSchedCb cb, void *pArg); // call cb periodically, phase-locked to the PTP second
+void ptp_sched_cancel(PtpSchedTimer *pTimer); // stop a timer
+void ptp_sched_get_stats(PtpSchedStats *pStats); // get scheduler statistics
+void ptp_sched_tick(); // detect time steps, call from the 1 ms tick interrupt
+
+#endif /* PTP_SCHED_H_ */
@@ -36,6 +36,8 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32h7xx_hal.h"
+#include "ptp_clock.h"
+#include "ptp_sched.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -159,6 +161,15 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
     UNUSED(htim);
 
     HAL_IncTick();
+
+    /* Complete deferred PTP clock updates */
+    ETH_PTPClockTick();
+
+    /* Take PTP clock cross-timestamps */
+    ptp_clock_tick();
+
+    /* Re-anchor the PTP-time scheduler after time steps */
+    ptp_sched_tick();
 }
 
 /**
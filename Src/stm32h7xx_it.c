@@ -21,6 +21,8 @@
 #include "stm32h7xx_it.h"
 #include "main.h"
 #include "cmsis_os.h"
+#include "console_uart.h"
+#include "persistent_storage.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -75,8 +77,31 @@ void MemManage_Handler(void)
   * @param  None
   * @retval None
   */
-void BusFault_Handler(void)
+__attribute__((naked)) void BusFault_Handler(void)
 {
+  /* pass the stack frame of the interrupted context, lr (EXC_RETURN) is kept */
+  __ASM volatile (
+    "tst lr, #4        \n"
+    "ite eq            \n"
+    "mrseq r0, msp     \n"
+    "mrsne r0, psp     \n"
+    "b BusFault_Handler_C \n"
+  );
+}
+
+/**
+  * @brief  Bus Fault handler body.
+  * @param  pFrame: exception stack frame of the faulting context
+  * @retval None
+  */
+void BusFault_Handler_C(uint32_t * pFrame)
+{
+  /* ECC errors of torn flash words are survived while reading the persistent storage */
+  if (ps_bus_fault(pFrame))
+  {
+    return;
+  }
+
   /* Go to infinite loop when Bus Fault exception occurs */
   while (1)
   {
@@ -128,11 +153,41 @@ void SysTick_Handler(void)
   * @param  None
   * @retval None
   */
-void ETH_IRQHandler(void)
+__ITCM_FUNC void ETH_IRQHandler(void)
 {
   HAL_ETH_IRQHandler(&EthHandle);
 }
 
+/**
+  * @brief  This function handles USART3 (console) interrupt request.
+  * @param  None
+  * @retval None
+  */
+void USART3_IRQHandler(void)
+{
+  console_uart_irq_handler();
+}
+
+/**
+  * @brief  This function handles DMA1 Stream0 (console reception) interrupt request.
+  * @param  None
+  * @retval None
+  */
+void DMA1_Stream0_IRQHandler(void)
+{
+  console_uart_dma_rx_irq_handler();
+}
+
+/**
+  * @brief  This function handles DMA1 Stream1 (console transmission) interrupt request.
+  * @param  None
+  * @retval None
+  */
+void DMA1_Stream1_IRQHandler(void)
+{
+  console_uart_dma_tx_irq_handler();
+}
+
 /**
   * @}
   */ 
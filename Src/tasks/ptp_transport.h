@@ -0,0 +1,32 @@
+/*
+ * ptp_transport.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef TASKS_PTP_TRANSPORT_H_
+#define TASKS_PTP_TRANSPORT_H_
+
+#include <stdbool.h>
+
+#include "lwip/pbuf.h"
+#include "lwip/err.h"
+
+// transport: 0 - UDP/IPv4, 1 - IEEE 802.3 (EtherType 0x88F7, requires PTP_CUT_THROUGH)
+#ifndef PTP_TRANSPORT_L2
+#define PTP_TRANSPORT_L2 (0)
+#endif
+
+// The flexPTP core transmits through the UDP PCBs passed to ptp_init(). Receiving
+// over IEEE 802.3 alone would leave the node silent, so the L2 transport can only
+// be selected with a flexPTP core sending through ptp_transmit_l2() (such a core
+// defines PTP_CORE_L2_TX).
+#if (PTP_TRANSPORT_L2 == 1) && !defined(PTP_CORE_L2_TX)
+#error "The IEEE 802.3 transport requires a flexPTP core transmitting through ptp_transmit_l2()!"
+#endif
+
+#if PTP_TRANSPORT_L2 == 1
+err_t ptp_transmit_l2(struct pbuf *pP, bool pdelay); // transmit a PTP message over IEEE 802.3, pdelay selects the peer delay destination address
+#endif
+
+#endif /* TASKS_PTP_TRANSPORT_H_ */
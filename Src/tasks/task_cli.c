@@ -5,6 +5,7 @@
 
 #include "cli.h"
 #include "retarget.h"
+#include "console_uart.h"
 
 // ----- TASK PROPERTIES -----
 static TaskHandle_t sTH; // task handle
@@ -27,7 +28,7 @@ struct CliCommand {
 
 #define CLI_MAX_CMD_CNT (32) // limit on number of separate commands
 static struct CliCommand spCliCmds[CLI_MAX_CMD_CNT];
-static uint8_t sCliCmdCnt;
+static uint8_t sCliCmdCnt; // zero-initialized: modules register their commands before reg_task_cli() is called, it must not reset the table
 static bool sCmdsTidy = false;
 
 // ---------------------------
@@ -39,9 +40,6 @@ void reg_task_cli() {
     if (result != pdPASS) { // taszk létrehozása
         MSG("Failed to create task! (errcode: %ld)\n", result);
     }
-
-    // ----------------------
-    sCliCmdCnt = 0;
 }
 
 // remove task
@@ -59,8 +57,10 @@ static void tokenize_cli_line(char *pLine, CliToken_Type ppTok[],
     uint32_t len = strlen(pLine);
 
     // copy to prevent modifying original one
-    static char pLineCpy[CLI_BUF_LENGTH];
-    strcpy(pLineCpy, pLine);
+    char pLineCpy[CLI_BUF_LENGTH + 1]; // commands may be processed by multiple tasks at once
+    strncpy(pLineCpy, pLine, CLI_BUF_LENGTH);
+    pLineCpy[CLI_BUF_LENGTH] = '\0';
+    char *pSave;
 
     *pTokCnt = 0;
 
@@ -70,13 +70,13 @@ static void tokenize_cli_line(char *pLine, CliToken_Type ppTok[],
     }
 
     // first token
-    char *pTok = strtok(pLineCpy, " ");
+    char *pTok = strtok_r(pLineCpy, " ", &pSave);
     strncpy(&ppTok[0][0], pTok, tokMaxLen);
     (*pTokCnt)++;
 
     // further tokens
     while ((*pTokCnt < tokMaxCnt) && (pTok != NULL)) {
-        pTok = strtok(NULL, " ");
+        pTok = strtok_r(NULL, " ", &pSave);
 
         if (pTok != NULL) {
             strncpy(&ppTok[*pTokCnt][0], pTok, tokMaxLen); // store token
@@ -268,9 +268,7 @@ static void get_line(char *pStr, size_t *pLen) {
     bool escString = false;
 
     while (c != '\r' && c != '\n' && (*pLen) < CLI_BUF_LENGTH) {
-        vTaskDelay(pdMS_TO_TICKS(10));
-
-        c = getchar();
+        c = getchar(); // blocks until a character is received
         putchar(c);
 
         // ESC received
@@ -313,20 +311,14 @@ static char pBuf[CLI_BUF_LENGTH + 1];
 void task_cli(void *pParam) {
     size_t len;
 
+    // the output of the commands always goes to the console
+    RetargetRedirectTask(xTaskGetCurrentTaskHandle(), console_uart_write, true); // the console is the fallback output as well
+
     MSG("CLI on!\n");
 
     while (1) {
         get_line(pBuf, &len);
-        vTaskDelay(pdMS_TO_TICKS(10));
-
-        // replace stream output function
-        StreamOutputFunction oldSof = RetargetGetOutput();
-        RetargetSetOutput(output_usart);
-
         process_cli_line(pBuf);
-
-        // restore the old one
-        RetargetSetOutput(oldSof);
     }
 }
 
@@ -334,6 +326,7 @@ int cli_register_command(char *pCmdParsHelp, uint8_t cmdTokCnt,
         uint8_t minArgCnt, fnCliCallback pCB) {
     // if command storage is full, then return -1;
     if (sCliCmdCnt == CLI_MAX_CMD_CNT) {
+        MSG("CLI command table is full, not registered: %s\n", pCmdParsHelp);
     	return -1;
     }
 
@@ -3,11 +3,18 @@
 
 #include "lwip/netif.h"
 
+#include "ethernetif.h"
+
 #include "user_tasks.h"
 
 #include "cli.h"
 
 #include "netterm.h"
+#include "pcap_tap.h"
+
+#include <string.h>
+
+extern ETH_HandleTypeDef EthHandle;
 
 // ----- TASK PROPERTIES -----
 static TaskHandle_t sTH; // task handle
@@ -34,6 +41,76 @@ static int CB_ip(const CliToken_Type *ppArgs, uint8_t argc) {
 	return 0;
 }
 
+static int CB_ethstat(const CliToken_Type *ppArgs, uint8_t argc) {
+	EthIfStats stats;
+	ethernetif_get_stats(&stats);
+
+	MSG("Rx descriptors: %u, Rx buffers: %u, Tx descriptors: %u\n", ETH_RX_DESC_CNT, ETH_RX_BUFFER_CNT, ETH_TX_DESC_CNT);
+	MSG("Rx spare buffers: %u (min. %u)\n", stats.rxFreeBuff, stats.rxFreeBuffMin);
+	MSG("Rx dropped, no spare buffer: %u\n", stats.rxNoBuffer);
+	MSG("Rx descriptors unavailable: %u\n", stats.rxDescUnavailable);
+	MSG("Rx FIFO overflow: %u\n", stats.rxFifoOverflow);
+	MSG("Rx missed: %u\n", stats.rxMissed);
+	MSG("Rx dropped, stack busy: %u\n", stats.rxStackBusy);
+	MSG("Tx dropped, ring full: %u\n", stats.txRingFull);
+	MSG("Rx frames: %u, timestamped: %u\n", stats.rxFrames, stats.rxTimestamped);
+	MSG("Tx one-step Syncs: %u, Follow_Ups suppressed: %u\n", stats.txOneStepSync, stats.txFollowUpSuppressed);
+	return 0;
+}
+
+static int CB_onestep(const CliToken_Type *ppArgs, uint8_t argc) {
+	if (argc >= 1) {
+		int en = ONOFF(ppArgs[0]);
+		if (en < 0) {
+			return -1;
+		}
+		ethernetif_set_ptp_one_step(en > 0);
+	}
+
+	MSG("One-step Sync: %s\n", ethernetif_get_ptp_one_step() ? "on" : "off");
+	return 0;
+}
+
+static const char *spRxTsFilterNames[] = { "all", "ptp", "e2e", "p2p" };
+static const char *spRxTsTransportNames[] = { "none", "udp", "l2", "both" };
+
+// find a name in a table, returns -1 if not found
+static int find_name(const char *pName, const char **ppNames, int cnt) {
+	for (int i = 0; i < cnt; i++) {
+		if (!strcmp(pName, ppNames[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int CB_rxts(const CliToken_Type *ppArgs, uint8_t argc) {
+	ETH_PTPRxTsFilter filter;
+	uint32_t transports;
+	ETH_GetPTPRxTimestampFilter(&EthHandle, &filter, &transports);
+
+	if (argc >= 1) {
+		int f = find_name(ppArgs[0], spRxTsFilterNames, 4);
+		if (f < 0) {
+			return -1;
+		}
+		filter = (ETH_PTPRxTsFilter) f;
+
+		if (argc >= 2) {
+			int t = find_name(ppArgs[1], spRxTsTransportNames, 4);
+			if (t <= 0) {
+				return -1;
+			}
+			transports = (uint32_t) t; // UDP/IPv4 = bit 0, L2 = bit 1
+		}
+
+		ETH_SetPTPRxTimestampFilter(&EthHandle, filter, transports);
+	}
+
+	MSG("Rx timestamp filter: %s, transports: %s\n", spRxTsFilterNames[filter], spRxTsTransportNames[transports & 0b11]);
+	return 0;
+}
+
 // register task
 void reg_task_eth() {
 	BaseType_t result = xTaskCreate(task_eth, "eth", sStkSize, NULL, sPrio, &sTH);
@@ -44,6 +121,9 @@ void reg_task_eth() {
 
 	// register CLI commands
 	cli_register_command("ip \t\t\tPrint IP-address", 1, 0, CB_ip);
+	cli_register_command("ethstat \t\t\tPrint Ethernet ring usage and drop counters", 1, 0, CB_ethstat);
+	cli_register_command("rxts [{all|ptp|e2e|p2p} [udp|l2|both]] \t\t\tPrint/set hardware Rx timestamp filter", 1, 0, CB_rxts);
+	cli_register_command("onestep [on|off] \t\t\tPrint/set one-step Sync transmission", 1, 0, CB_onestep);
 }
 
 #define IP_ADDR_VALID(ip) (ip != 0 && ip != ~0)
@@ -78,6 +158,9 @@ void task_eth(void * pParam) {
 			MSG("Starting NETTERM!\n");
 			netterm_init();
 
+			MSG("Starting capture tap!\n");
+			pcap_tap_init();
+
 		} else if (sState.isConnected == true && !IP_ADDR_VALID(currentIP) && !netif_is_link_up(netif_default)) { // if we have disconnected from the network
 
 		    MSG("Disconnected!\n");
@@ -93,6 +176,9 @@ void task_eth(void * pParam) {
 			MSG("Stopping NETTERM!\n");
 			netterm_deinit();
 
+			MSG("Stopping capture tap!\n");
+			pcap_tap_deinit();
+
 		} else { // we are connected
 			// Todo ...
 		}
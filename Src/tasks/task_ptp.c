@@ -7,6 +7,16 @@
 
 #include "lwip/igmp.h"
 
+#include "ethernetif.h"
+
+#include "cli.h"
+#include "utils.h"
+#include "pkt_trace.h"
+#include "dlog.h"
+#include "ptp_transport.h"
+
+#include <string.h>
+
 // ----- TASK PROPERTIES -----
 static TaskHandle_t sTH; // task handle
 static uint8_t sPrio = 5; // priority
@@ -24,14 +34,152 @@ static struct udp_pcb * spPTP_pcb[2];
 // callback function receiveing data from udp "sockets"
 void ptp_recv_cb(void * pArg, struct udp_pcb * pPCB, struct pbuf *pP, ip_addr_t * pAddr, uint16_t port);
 
-// FIFO for incoming packets
+// FIFO for incoming packets: bounded, never blocks the producers (tcpip thread
+// or Ethernet interface thread), the PTP task is woken by a task notification
 #define PACKET_FIFO_LENGTH (32)
-static QueueHandle_t sPacketFIFO;
+#define PACKET_FIFO_DROP_OLDEST (1) // on overflow, 1: drop the oldest packet, 0: drop the incoming one
+
+typedef struct {
+    struct pbuf * pPBuf; // packet
+    uint32_t enqCycles; // cycle counter value at enqueueing
+} PacketFIFOEntry;
+
+static struct {
+    PacketFIFOEntry pEntries[PACKET_FIFO_LENGTH]; // entries
+    uint32_t head, tail; // free-running write and read indices
+    uint32_t enqueued, processed; // packet counters
+    uint32_t droppedOldest, droppedNewest; // overflow counters
+    uint32_t maxLevel; // highest fill level
+    uint32_t latMin, latMax; // extremes of queueing latency (cycles)
+    uint64_t latSum; // sum of queueing latencies (cycles)
+} sPacketFIFO;
+
+static int sCliFifoCmd = -1; // handle of the FIFO statistics command
+
+// receive PTP frames directly from the Ethernet interface, bypassing the tcpip thread
+#define PTP_CUT_THROUGH (1)
+
+#if (PTP_TRANSPORT_L2 == 1) && (PTP_CUT_THROUGH != 1)
+#error "The IEEE 802.3 transport requires PTP_CUT_THROUGH!"
+#endif
+
+// reset the FIFO and its statistics
+static void packet_fifo_init() {
+    memset(&sPacketFIFO, 0, sizeof(sPacketFIFO));
+    sPacketFIFO.latMin = UINT32_MAX;
+}
+
+// push packet into the FIFO, never blocks
+static void packet_fifo_push(struct pbuf *pP) {
+    struct pbuf *pDrop = NULL;
+
+    taskENTER_CRITICAL();
+    if ((sPacketFIFO.head - sPacketFIFO.tail) >= PACKET_FIFO_LENGTH) { // full
+#if PACKET_FIFO_DROP_OLDEST == 1
+        pDrop = sPacketFIFO.pEntries[sPacketFIFO.tail % PACKET_FIFO_LENGTH].pPBuf;
+        sPacketFIFO.tail++;
+        sPacketFIFO.droppedOldest++;
+#else
+        pDrop = pP;
+        pP = NULL;
+        sPacketFIFO.droppedNewest++;
+#endif
+    }
+
+    if (pP != NULL) {
+        PacketFIFOEntry *pEntry = &sPacketFIFO.pEntries[sPacketFIFO.head % PACKET_FIFO_LENGTH];
+        pEntry->pPBuf = pP;
+        pEntry->enqCycles = DWT_CYCCNT();
+        sPacketFIFO.head++;
+        sPacketFIFO.enqueued++;
+        sPacketFIFO.maxLevel = MAX(sPacketFIFO.maxLevel, sPacketFIFO.head - sPacketFIFO.tail);
+    }
+    taskEXIT_CRITICAL();
+
+    // release dropped packet outside of the critical section
+    if (pDrop != NULL) {
+        pbuf_free(pDrop);
+    }
+
+    // wake up the PTP task
+    if ((pP != NULL) && (sTH != NULL)) {
+        xTaskNotifyGive(sTH);
+    }
+}
+
+// pop packet from the FIFO, returns NULL if empty
+static struct pbuf * packet_fifo_pop() {
+    struct pbuf *pP = NULL;
+
+    taskENTER_CRITICAL();
+    if (sPacketFIFO.head != sPacketFIFO.tail) {
+        PacketFIFOEntry *pEntry = &sPacketFIFO.pEntries[sPacketFIFO.tail % PACKET_FIFO_LENGTH];
+        pP = pEntry->pPBuf;
+        sPacketFIFO.tail++;
+
+        // update queueing latency statistics
+        uint32_t lat = DWT_CYCCNT() - pEntry->enqCycles;
+        sPacketFIFO.latMin = MIN(sPacketFIFO.latMin, lat);
+        sPacketFIFO.latMax = MAX(sPacketFIFO.latMax, lat);
+        sPacketFIFO.latSum += lat;
+        sPacketFIFO.processed++;
+    }
+    taskEXIT_CRITICAL();
+
+    return pP;
+}
+
+// release all packets waiting in the FIFO
+static void packet_fifo_flush() {
+    struct pbuf *pP;
+    while ((pP = packet_fifo_pop()) != NULL) {
+        pbuf_free(pP);
+    }
+}
+
+// print FIFO statistics
+static int CB_ptpfifo(const CliToken_Type *ppArgs, uint8_t argc) {
+    uint32_t processed = sPacketFIFO.processed;
+    uint32_t latAvg = (processed > 0) ? (uint32_t) (sPacketFIFO.latSum / processed) : 0;
+
+    MSG("Level: %u/%u (max. %u)\n", sPacketFIFO.head - sPacketFIFO.tail, PACKET_FIFO_LENGTH, sPacketFIFO.maxLevel);
+    MSG("Enqueued: %u, processed: %u\n", sPacketFIFO.enqueued, processed);
+    MSG("Dropped oldest: %u, dropped newest: %u\n", sPacketFIFO.droppedOldest, sPacketFIFO.droppedNewest);
+    if (processed > 0) {
+        MSG("Queueing latency [us]: min. %u, avg. %u, max. %u\n", dwt_cycles_to_us(sPacketFIFO.latMin), dwt_cycles_to_us(latAvg), dwt_cycles_to_us(sPacketFIFO.latMax));
+    }
+    return 0;
+}
+
+#if PTP_CUT_THROUGH == 1
+// early receive hook, called from the Ethernet interface thread (must not block!)
+static bool ptp_cut_through_hook(struct pbuf *pP, const PtpFrameInfo *pInfo) {
+#if PTP_TRANSPORT_L2 == 1
+    if (pInfo->cls != PTP_FRAME_L2) {
+        return false; // let the stack process the frame
+    }
+#else
+    if ((pInfo->cls != PTP_FRAME_UDP_EVENT) && (pInfo->cls != PTP_FRAME_UDP_GENERAL)) {
+        return false; // let the stack process the frame
+    }
+#endif
+
+    // strip Ethernet (IP and UDP) headers and the padding
+    pbuf_remove_header(pP, pInfo->payloadOffset);
+    pbuf_realloc(pP, pInfo->payloadLen);
+
+    // push packet into the FIFO, hardware timestamp is carried by the pbuf
+    PKT_TRACE_STAMP(pP, PKT_TRACE_PTP_RECV);
+    packet_fifo_push(pP);
+
+    return true;
+}
+#endif
 
 // create udp listeners
 void create_ptp_listeners() {
-    // create packet FIFO
-    sPacketFIFO = xQueueCreate(PACKET_FIFO_LENGTH, sizeof(struct pbuf *));
+    // initialize packet FIFO
+    packet_fifo_init();
 
     // listening on the port 319
     spPTP_pcb[0] = udp_new();
@@ -54,8 +202,8 @@ void destroy_ptp_listeners() {
     udp_remove(spPTP_pcb[0]);
     udp_remove(spPTP_pcb[1]);
 
-    // destroy packet FIFO
-    vQueueDelete(sPacketFIFO);
+    // release queued packets
+    packet_fifo_flush();
 }
 
 // join PTP IGMP groups
@@ -80,11 +228,28 @@ void leave_ptp_igmp_groups() {
     igmp_leavegroup(&netif_default->ip_addr, &addr_PTP_IGMP);
 }
 
+#if PTP_TRANSPORT_L2 == 1
+// the pbuf must have room for the Ethernet header, timestamps are delivered as with UDP
+err_t ptp_transmit_l2(struct pbuf *pP, bool pdelay) {
+    static const uint8_t defaultAddr[] = ETHIF_PTP_L2_DEFAULT_ADDR;
+    static const uint8_t pdelayAddr[] = ETHIF_PTP_L2_PEER_DELAY_ADDR;
+    return ethernetif_l2_output(pP, pdelay ? pdelayAddr : defaultAddr);
+}
+#endif
+
 // register PTP task and initialize
 void reg_task_ptp() {
+#if PTP_TRANSPORT_L2 == 1
+    ethernetif_set_ptp_l2_filters(true); // accept PTP multicast frames, no IGMP needed
+#else
     join_ptp_igmp_groups(); // enter PTP IGMP groups
+#endif
     create_ptp_listeners(); // create listeners
 
+#if PTP_CUT_THROUGH == 1
+    ethernetif_set_ptp_rx_hook(ptp_cut_through_hook); // receive PTP frames directly from the interface
+#endif
+
     ptp_init(spPTP_pcb); // initialize PTP subsystem
 
     // create task
@@ -95,16 +260,45 @@ void reg_task_ptp() {
     	return;
     }
 
+    // log messages of the PTP task must not wait for the output
+    dlog_defer_task(sTH);
+
+    // register CLI commands
+    sCliFifoCmd = cli_register_command("ptpfifo \t\t\tPrint PTP packet FIFO statistics", 1, 0, CB_ptpfifo);
+
     sPTP_operating = true; // the PTP subsystem is operating
 }
 
 // unregister PTP task
 void unreg_task_ptp() {
-	vTaskDelete(sTH); // taszk törlése
+#if PTP_CUT_THROUGH == 1
+	// unregister the hook before deleting the task; the hook never blocks and the interface
+	// thread has higher priority, so it cannot be in the middle of the hook at this point
+	ethernetif_set_ptp_rx_hook(NULL);
+#endif
+
+	// stop feeding the FIFO
+	udp_recv(spPTP_pcb[0], NULL, NULL);
+	udp_recv(spPTP_pcb[1], NULL, NULL);
+
+	if (sTH != NULL) {
+		dlog_undefer_task(sTH);
+		vTaskDelete(sTH); // taszk törlése
+		sTH = NULL;
+	}
+
+	if (sCliFifoCmd >= 0) {
+		cli_remove_command(sCliFifoCmd);
+		sCliFifoCmd = -1;
+	}
 
 	ptp_deinit(); // ptp subsystem de-initialization
 
+#if PTP_TRANSPORT_L2 == 1
+	ethernetif_set_ptp_l2_filters(false); // drop PTP multicast frames
+#else
 	leave_ptp_igmp_groups(); // leave IGMP groups
+#endif
 	destroy_ptp_listeners(); // delete listeners
 
     sPTP_operating = false; // the PTP subsystem is operating
@@ -112,7 +306,8 @@ void unreg_task_ptp() {
 
 // callback for packet reception on port 319 and 320
 void ptp_recv_cb(void * pArg, struct udp_pcb * pPCB, struct pbuf *pP, ip_addr_t * pAddr, uint16_t port) {
-    xQueueSend(sPacketFIFO, &pP, portMAX_DELAY);
+    PKT_TRACE_STAMP(pP, PKT_TRACE_PTP_RECV);
+    packet_fifo_push(pP); // never blocks the tcpip thread
 }
 
 // taszk függvénye
@@ -121,14 +316,20 @@ void task_ptp(void * pParam) {
     struct pbuf * pPBuf;
     
     while (1) {
-        // pop packet from FIFO
-        xQueueReceive(sPacketFIFO, &pPBuf, portMAX_DELAY);
-
-        // process packet
-        ptp_process_packet(pPBuf);
-        
-        // release pbuf resources
-        pbuf_free(pPBuf);
+        // process every packet waiting in the FIFO
+        while ((pPBuf = packet_fifo_pop()) != NULL) {
+            PKT_TRACE_STAMP(pPBuf, PKT_TRACE_QUEUE_POP);
+
+            // process packet
+            ptp_process_packet(pPBuf);
+            PKT_TRACE_END(pPBuf);
+
+            // release pbuf resources
+            pbuf_free(pPBuf);
+        }
+
+        // wait for new packets
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
 }
 
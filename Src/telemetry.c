@@ -0,0 +1,374 @@
+/*
+ * telemetry.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "telemetry.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#include "cli.h"
+#include "utils.h"
+#include "netterm.h"
+#include "property_map.h"
+#include "ptp_clock.h"
+
+// ----- TASK PROPERTIES -----
+static TaskHandle_t sTH; // task handle
+static uint8_t sPrio = 2; // priority
+static uint16_t sStkSize = 512; // stack size
+static void task_tlm(void *pParam); // task routine function
+// ---------------------------
+
+// a subscription
+typedef struct {
+    uint16_t hSession; // subscribing session (NETTERM_SESSION_NONE: unused entry)
+    PM_Type type; // type of the property
+    const void *pField; // the property
+    uint8_t len; // length of the value [bytes] (strings: maximal length)
+    uint32_t period; // sending period [ticks] (0: on change)
+    uint32_t lastSent; // tick of the last sending
+    bool sentOnce; // the value has been sent at least once
+    bool due; // the value goes into the records of the current tick
+    uint8_t curLen; // length of the current sample
+    uint8_t lastLen; // length of the last value sent
+    uint8_t pCur[TLM_MAX_VALUE_LEN]; // sample of the current tick
+    uint8_t pLast[TLM_MAX_VALUE_LEN]; // last value sent
+} TlmSub;
+
+static TlmSub sSubs[TLM_MAX_SUB_CNT]; // subscription table, the index is the subscription ID
+static SemaphoreHandle_t sMtx; // protects the subscription table
+static uint32_t sTickCnt; // number of sampling ticks
+static TlmStats sStats; // statistics
+
+#define TLM_CMD_BUF_LEN (127) // maximal length of a subscription command
+
+static uint8_t sRec[TLM_MAX_RECORD_LEN] __attribute__((aligned(4))); // record being assembled
+
+// ------------------------
+
+// take a sample of a subscribed property
+static void tlm_sample(TlmSub *pSub) {
+    taskENTER_CRITICAL(); // values updated from interrupts must not tear
+    if (pSub->type == PMT_STRING) {
+        pSub->curLen = strnlen(pSub->pField, pSub->len);
+    } else {
+        pSub->curLen = pSub->len;
+    }
+    memcpy(pSub->pCur, pSub->pField, pSub->curLen);
+    taskEXIT_CRITICAL();
+}
+
+// queue the assembled record, returns false if the session is closed
+static bool tlm_send_record(uint16_t hSession, uint32_t len, uint32_t first, uint32_t last) {
+    TlmRecordHeader *pHdr = (TlmRecordHeader*) sRec;
+    pHdr->len = len - sizeof(TlmRecordHeader);
+
+    int ret = netterm_session_write_record(hSession, sRec, len);
+    if (ret < 0) {
+        return false;
+    }
+
+    if (ret > 0) {
+        sStats.records++;
+        for (uint32_t i = first; i <= last; i++) { // the values in the record are sent
+            TlmSub *pSub = sSubs + i;
+            if ((pSub->hSession == hSession) && pSub->due) {
+                pSub->due = false;
+                pSub->sentOnce = true;
+                pSub->lastSent = sTickCnt;
+                memcpy(pSub->pLast, pSub->pCur, pSub->curLen);
+                pSub->lastLen = pSub->curLen;
+                sStats.entries++;
+            }
+        }
+    } else {
+        sStats.dropped++;
+    }
+
+    return true;
+}
+
+// drop the subscriptions of a closed session
+static void tlm_drop_session(uint16_t hSession) {
+    for (uint32_t i = 0; i < TLM_MAX_SUB_CNT; i++) {
+        if (sSubs[i].hSession == hSession) {
+            sSubs[i].hSession = NETTERM_SESSION_NONE;
+        }
+    }
+}
+
+// sample the subscriptions and send the due values
+static void tlm_tick() {
+    sTickCnt++;
+
+    // select the due values
+    bool any = false;
+    for (uint32_t i = 0; i < TLM_MAX_SUB_CNT; i++) {
+        TlmSub *pSub = sSubs + i;
+        pSub->due = false;
+        if (pSub->hSession == NETTERM_SESSION_NONE) {
+            continue;
+        }
+
+        if (pSub->period > 0) {
+            pSub->due = !pSub->sentOnce || ((sTickCnt - pSub->lastSent) >= pSub->period);
+            if (pSub->due) {
+                tlm_sample(pSub);
+            }
+        } else {
+            tlm_sample(pSub);
+            pSub->due = !pSub->sentOnce || (pSub->curLen != pSub->lastLen) || memcmp(pSub->pCur, pSub->pLast, pSub->curLen);
+        }
+
+        any |= pSub->due;
+    }
+
+    if (!any) {
+        return;
+    }
+
+    uint32_t sec, nsec;
+    ptp_clock_now(&sec, &nsec);
+
+    TlmRecordHeader *pHdr = (TlmRecordHeader*) sRec;
+    pHdr->sync = TLM_SYNC;
+    pHdr->version = TLM_VERSION;
+    pHdr->sec = sec;
+    pHdr->nsec = nsec;
+
+    // assemble the records session by session
+    for (uint32_t i = 0; i < TLM_MAX_SUB_CNT; i++) {
+        if (!sSubs[i].due) {
+            continue;
+        }
+
+        uint16_t hSession = sSubs[i].hSession;
+        uint32_t len = sizeof(TlmRecordHeader);
+        uint32_t first = i;
+        bool open = true;
+        for (uint32_t k = i; (k < TLM_MAX_SUB_CNT) && open; k++) {
+            TlmSub *pSub = sSubs + k;
+            if (!pSub->due || (pSub->hSession != hSession)) {
+                continue;
+            }
+
+            // the record is full, send it and start a new one
+            if ((len + 2 + pSub->curLen) > TLM_MAX_RECORD_LEN) {
+                open = tlm_send_record(hSession, len, first, k - 1);
+                len = sizeof(TlmRecordHeader);
+                first = k;
+                if (!open) {
+                    break;
+                }
+            }
+
+            sRec[len++] = k;
+            sRec[len++] = pSub->curLen;
+            memcpy(sRec + len, pSub->pCur, pSub->curLen);
+            len += pSub->curLen;
+        }
+
+        if (open) {
+            open = tlm_send_record(hSession, len, first, TLM_MAX_SUB_CNT - 1);
+        }
+
+        if (!open) {
+            tlm_drop_session(hSession);
+        }
+
+        // values not sent are retried in the next tick
+        for (uint32_t k = i; k < TLM_MAX_SUB_CNT; k++) {
+            if (sSubs[k].hSession == hSession) {
+                sSubs[k].due = false;
+            }
+        }
+    }
+}
+
+static void task_tlm(void *pParam) {
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(TLM_TICK_MS));
+
+        xSemaphoreTake(sMtx, portMAX_DELAY);
+        tlm_tick();
+        xSemaphoreGive(sMtx);
+    }
+}
+
+// ------------------------
+
+// subscribe to a property
+static void tlm_subscribe(uint16_t hSession, char *pKey, char *pPeriod, char *pResp, size_t respLen) {
+    PM_Type type;
+    const void *pField;
+    size_t count;
+
+    if ((pKey == NULL) || (pPeriod == NULL)) {
+        SNPRINTF(pResp, respLen, "sub error: %s\r\n", "usage: sub <key> <period ms>|change");
+        return;
+    }
+
+    if (!pm_find(pKey, &type, &pField, &count)) {
+        SNPRINTF(pResp, respLen, "sub error: unknown property '%s'\r\n", pKey);
+        return;
+    }
+
+    // strings are sent up to their terminating zero
+    size_t len = (type == PMT_STRING) ? TLM_MAX_VALUE_LEN : (pm_type_size(type) * count);
+    if ((len == 0) || (len > TLM_MAX_VALUE_LEN)) {
+        SNPRINTF(pResp, respLen, "sub error: '%s' is too large\r\n", pKey);
+        return;
+    }
+
+    uint32_t period = 0;
+    if (strcmp(pPeriod, "change")) {
+        char *pEnd;
+        uint32_t periodMs = strtoul(pPeriod, &pEnd, 10);
+        if ((*pEnd != '\0') || (periodMs == 0)) {
+            SNPRINTF(pResp, respLen, "sub error: invalid period '%s'\r\n", pPeriod);
+            return;
+        }
+        period = (periodMs + TLM_TICK_MS - 1) / TLM_TICK_MS;
+    }
+
+    xSemaphoreTake(sMtx, portMAX_DELAY);
+    int id = -1;
+    for (uint32_t i = 0; i < TLM_MAX_SUB_CNT; i++) {
+        if (sSubs[i].hSession == NETTERM_SESSION_NONE) {
+            TlmSub *pSub = sSubs + i;
+            memset(pSub, 0, sizeof(TlmSub));
+            pSub->type = type;
+            pSub->pField = pField;
+            pSub->len = len;
+            pSub->period = period;
+            pSub->hSession = hSession;
+            id = i;
+            break;
+        }
+    }
+    xSemaphoreGive(sMtx);
+
+    if (id < 0) {
+        SNPRINTF(pResp, respLen, "sub error: %s\r\n", "too many subscriptions");
+    } else {
+        SNPRINTF(pResp, respLen, "sub %d %s %u %u %u\r\n", id, pKey, type, count, len);
+    }
+}
+
+// cancel a subscription or all subscriptions of a session
+static void tlm_unsubscribe(uint16_t hSession, char *pId, char *pResp, size_t respLen) {
+    if (pId == NULL) {
+        SNPRINTF(pResp, respLen, "unsub error: %s\r\n", "usage: unsub <id>|all");
+        return;
+    }
+
+    if (!strcmp(pId, "all")) {
+        xSemaphoreTake(sMtx, portMAX_DELAY);
+        tlm_drop_session(hSession);
+        xSemaphoreGive(sMtx);
+        SNPRINTF(pResp, respLen, "unsub %s\r\n", "all");
+        return;
+    }
+
+    char *pEnd;
+    uint32_t id = strtoul(pId, &pEnd, 10);
+    bool ok = false;
+
+    xSemaphoreTake(sMtx, portMAX_DELAY);
+    if ((*pEnd == '\0') && (id < TLM_MAX_SUB_CNT) && (sSubs[id].hSession == hSession)) { // only the own subscriptions
+        sSubs[id].hSession = NETTERM_SESSION_NONE;
+        ok = true;
+    }
+    xSemaphoreGive(sMtx);
+
+    if (ok) {
+        SNPRINTF(pResp, respLen, "unsub %u\r\n", id);
+    } else {
+        SNPRINTF(pResp, respLen, "unsub error: no subscription '%s'\r\n", pId);
+    }
+}
+
+void tlm_session_closed(uint16_t hSession) {
+    xSemaphoreTake(sMtx, portMAX_DELAY);
+    tlm_drop_session(hSession);
+    xSemaphoreGive(sMtx);
+}
+
+bool tlm_process_line(uint16_t hSession, const char *pLine, char *pResp, size_t respLen) {
+    char pCpy[TLM_CMD_BUF_LEN + 1];
+    strncpy(pCpy, pLine, TLM_CMD_BUF_LEN);
+    pCpy[TLM_CMD_BUF_LEN] = '\0';
+
+    char *pSave;
+    char *pCmd = strtok_r(pCpy, " ", &pSave);
+    if (pCmd == NULL) {
+        return false;
+    }
+
+    if (!strcmp(pCmd, "sub")) {
+        char *pKey = strtok_r(NULL, " ", &pSave);
+        char *pPeriod = strtok_r(NULL, " ", &pSave);
+        tlm_subscribe(hSession, pKey, pPeriod, pResp, respLen);
+    } else if (!strcmp(pCmd, "unsub")) {
+        tlm_unsubscribe(hSession, strtok_r(NULL, " ", &pSave), pResp, respLen);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+void tlm_get_stats(TlmStats *pStats) {
+    xSemaphoreTake(sMtx, portMAX_DELAY);
+    *pStats = sStats;
+    xSemaphoreGive(sMtx);
+}
+
+// print telemetry statistics and subscriptions
+static int CB_tlm(const CliToken_Type *ppArgs, uint8_t argc) {
+    TlmStats stats;
+    tlm_get_stats(&stats);
+
+    MSG("Records: %u, values: %u, dropped (output full): %u\n", stats.records, stats.entries, stats.dropped);
+
+    for (uint32_t i = 0; i < TLM_MAX_SUB_CNT; i++) {
+        xSemaphoreTake(sMtx, portMAX_DELAY);
+        TlmSub sub = sSubs[i];
+        xSemaphoreGive(sMtx);
+        if (sub.hSession == NETTERM_SESSION_NONE) {
+            continue;
+        }
+
+        if (sub.period > 0) {
+            MSG("#%u session %u: %u bytes every %u ms\n", i, sub.hSession & 0xFF, sub.len, sub.period * TLM_TICK_MS);
+        } else {
+            MSG("#%u session %u: %u bytes on change\n", i, sub.hSession & 0xFF, sub.len);
+        }
+    }
+
+    return 0;
+}
+
+void tlm_init() {
+    for (uint32_t i = 0; i < TLM_MAX_SUB_CNT; i++) {
+        sSubs[i].hSession = NETTERM_SESSION_NONE;
+    }
+    memset(&sStats, 0, sizeof(sStats));
+    sTickCnt = 0;
+
+    sMtx = xSemaphoreCreateMutex();
+
+    BaseType_t result = xTaskCreate(task_tlm, "tlm", sStkSize, NULL, sPrio, &sTH);
+    if (result != pdPASS) { // error handling
+        MSG("Failed to create task! (errcode: %ld)\n", result);
+    }
+
+    cli_register_command("tlm \t\t\tPrint telemetry statistics and subscriptions", 1, 0, CB_tlm);
+}
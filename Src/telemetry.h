@@ -0,0 +1,62 @@
+/*
+ * telemetry.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary telemetry over the network terminal. A session subscribes to
+// properties registered in the property map (pm_add()) with
+//
+//   sub <key> <period ms>|change   ->  "sub <id> <key> <type> <count> <value length>" or "sub error: ..."
+//   unsub <id>|all                 ->  "unsub <id>|all" or "unsub error: ..."
+//
+// and gets binary records interleaved with its text output. A record starts
+// with TLM_SYNC and carries its length, so clients can separate the two: the
+// network terminal strips TLM_SYNC bytes from the text output (the msg relay
+// included), non-ASCII text loses them. All values of a session sampled in
+// the same tick go into a single record (more records if they do not fit):
+//
+//   header: TlmRecordHeader (little-endian), PTP time of the sampling
+//   payload: entries of: subscription ID (8 bit), value length (8 bit), raw value (little-endian)
+//
+// On change subscriptions are sent at the first tick and then whenever their
+// value differs from the last value sent. Records not fitting into the output
+// buffer of the session are dropped (the values are retried in the next tick).
+
+#define TLM_SYNC (0xA5) // first byte of a record
+#define TLM_VERSION (1) // version of the record format
+#define TLM_MAX_SUB_CNT (32) // number of subscriptions (all sessions)
+#define TLM_MAX_VALUE_LEN (32) // maximal length of a subscribed value [bytes]
+#define TLM_MAX_RECORD_LEN (256) // maximal length of a record, including the header [bytes]
+#define TLM_TICK_MS (10) // sampling period, subscription periods are rounded to its multiples [ms]
+#define TLM_MAX_RESP_LEN (79) // maximal length of a response to a subscription command
+
+// header of a telemetry record
+typedef struct __attribute__((packed)) {
+    uint8_t sync; // TLM_SYNC
+    uint8_t version; // TLM_VERSION
+    uint16_t len; // length of the payload following the header [bytes]
+    uint32_t sec; // PTP time of the sampling, seconds
+    uint32_t nsec; // PTP time of the sampling, nanoseconds
+} TlmRecordHeader;
+
+// telemetry statistics
+typedef struct {
+    uint32_t records; // number of records queued
+    uint32_t entries; // number of values queued
+    uint32_t dropped; // number of records dropped, the output buffer of the session was full
+} TlmStats;
+
+void tlm_init(); // create the sampling task and register CLI command
+void tlm_session_closed(uint16_t hSession); // drop the subscriptions of a closed netterm session (tcpip thread)
+bool tlm_process_line(uint16_t hSession, const char *pLine, char *pResp, size_t respLen); // handle a subscription command of a netterm session (tcpip thread), the response (at most respLen characters) is written to pResp, returns false if the line is not a telemetry command
+void tlm_get_stats(TlmStats *pStats); // get telemetry statistics
+
+#endif /* TELEMETRY_H_ */
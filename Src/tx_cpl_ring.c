@@ -0,0 +1,59 @@
+/*
+ * tx_cpl_ring.c
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#include "tx_cpl_ring.h"
+
+#include <stddef.h>
+
+void tx_cpl_ring_init(TxCplRing *pRing, TxCompletion *pRecs, uint32_t len) {
+	pRing->pRecs = pRecs;
+	pRing->len = len;
+	pRing->head = 0;
+	pRing->tail = 0;
+	pRing->descCnt = 0;
+}
+
+TxCompletion *tx_cpl_ring_collect(TxCplRing *pRing, bool last) {
+	pRing->descCnt++;
+
+	if (!last) {
+		return NULL;
+	}
+
+	TxCompletion *pCpl = &pRing->pRecs[pRing->head & (pRing->len - 1)];
+	pCpl->descCnt = pRing->descCnt;
+	pRing->descCnt = 0;
+	return pCpl;
+}
+
+void tx_cpl_ring_publish(TxCplRing *pRing) {
+	// the record must be complete before the consumer sees it
+	TX_CPL_BARRIER();
+	pRing->head++;
+}
+
+uint32_t tx_cpl_ring_dispatch(TxCplRing *pRing, TxCplDispatchCb cb, void *pArg) {
+	uint32_t descCnt = 0;
+
+	while (pRing->tail != pRing->head) {
+		const TxCompletion *pCpl = &pRing->pRecs[pRing->tail & (pRing->len - 1)];
+
+		// read the record only after its publication
+		TX_CPL_BARRIER();
+		cb(pCpl, pArg);
+		descCnt += pCpl->descCnt;
+
+		// done with the record before handing its slot back
+		TX_CPL_BARRIER();
+		pRing->tail++;
+	}
+
+	return descCnt;
+}
+
+uint32_t tx_cpl_ring_level(const TxCplRing *pRing) {
+	return pRing->head - pRing->tail;
+}
@@ -0,0 +1,53 @@
+/*
+ * tx_cpl_ring.h
+ *
+ *  Created on: 2026. okt. 16.
+ */
+
+#ifndef TX_CPL_RING_H_
+#define TX_CPL_RING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Single-producer single-consumer ring of transmit completion records. The
+// producer (Tx complete ISR) walks the descriptors released by the DMA and
+// publishes a record at the last descriptor of each frame, the consumer
+// (interface thread) dispatches the records and gives back the descriptors.
+// The ring can never overflow if it has as many records as there are
+// descriptors: each record holds at least one descriptor, that is not
+// reusable until the record has been dispatched.
+
+// memory barrier ordering the record accesses and the index updates
+#ifndef TX_CPL_BARRIER
+#define TX_CPL_BARRIER() __sync_synchronize()
+#endif
+
+// transmit completion record
+typedef struct {
+	void *p; // the transmitted frame
+	uint32_t sec; // transmit timestamp, seconds
+	uint32_t nsec; // transmit timestamp, nanoseconds
+	uint16_t descCnt; // number of descriptors the frame occupied
+	uint16_t tsValid; // the timestamp fields are valid
+	uint32_t tapRec; // frame tap record handle (0: not captured)
+} TxCompletion;
+
+// completion ring
+typedef struct {
+	TxCompletion *pRecs; // record storage
+	uint32_t len; // number of records (power of 2)
+	volatile uint32_t head; // free-running write index, written by the producer only
+	volatile uint32_t tail; // free-running read index, written by the consumer only
+	uint32_t descCnt; // descriptors of the frame being collected (producer only)
+} TxCplRing;
+
+typedef void (*TxCplDispatchCb)(const TxCompletion *pCpl, void *pArg); // called for each dispatched record
+
+void tx_cpl_ring_init(TxCplRing *pRing, TxCompletion *pRecs, uint32_t len); // initialize an empty ring on a storage of len records (len must be a power of 2)
+TxCompletion *tx_cpl_ring_collect(TxCplRing *pRing, bool last); // producer: account a released descriptor, at the last descriptor of a frame returns the record to fill (descCnt already set), NULL otherwise
+void tx_cpl_ring_publish(TxCplRing *pRing); // producer: publish the record returned by tx_cpl_ring_collect()
+uint32_t tx_cpl_ring_dispatch(TxCplRing *pRing, TxCplDispatchCb cb, void *pArg); // consumer: dispatch all published records in order, returns the number of descriptors released
+uint32_t tx_cpl_ring_level(const TxCplRing *pRing); // number of published, not yet dispatched records
+
+#endif /* TX_CPL_RING_H_ */
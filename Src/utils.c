@@ -2,20 +2,54 @@
 
 #include "embfmt/embformat.h"
 
-#include <stdio.h>
+#include <retarget.h>
 
-//char gMSGBuf[64];
+#include "dlog.h"
 
+// Messages are formatted right into the output stream, there is no limit on
+// their length. The output is locked meanwhile, so lines of concurrent
+// callers do not get interleaved.
 
+// pass the formatted pieces on to the output
+static void msg_sink(void *pArg, const char *pChunk, unsigned long int len) {
+    RetargetStreamWrite((RetargetStream *) pArg, pChunk, (int) len);
+}
+
+void (MSG)(const char *pcString, ...) {
+    RetargetStream stream;
+    RetargetStreamOpen(&stream);
 
-#define MAX_LINE_LENGTH (383)
+    va_list vaArgP;
+    va_start(vaArgP, pcString);
+    vembfmt_sink(msg_sink, &stream, (char *) pcString, vaArgP);
+    va_end(vaArgP);
 
-static char linebuf[MAX_LINE_LENGTH + 1];
+    RetargetStreamClose(&stream);
+}
 
-void MSG(const char *pcString, ...) {
+void MSG_cached(EmbFmtCompiled *pCache, const char *pcString, ...) {
     va_list vaArgP;
     va_start(vaArgP, pcString);
-    vembfmt(linebuf, MAX_LINE_LENGTH, pcString, vaArgP);
+
+    // interrupts and time critical tasks only store the message, it gets printed by the log task,
+    // tasks print it right away if it could not be stored (interrupts never wait for the output)
+    if (!dlog_is_deferred_context() || (!dlog_vcached(pCache, pcString, vaArgP) && (__get_IPSR() == 0))) {
+        RetargetStream stream;
+        RetargetStreamOpen(&stream);
+        vembfmt_cached_sink(pCache, msg_sink, &stream, (char *) pcString, vaArgP);
+        RetargetStreamClose(&stream);
+    }
+
     va_end(vaArgP);
-    printf(linebuf);
+}
+
+void dwt_init() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // enable trace and debug blocks
+    DWT->LAR = 0xC5ACCE55; // unlock DWT access (Cortex-M7)
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk; // start the cycle counter
+}
+
+uint32_t dwt_cycles_to_us(uint32_t cycles) {
+    return cycles / (SystemCoreClock / 1000000);
 }
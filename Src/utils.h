@@ -30,10 +30,14 @@
     #define ntohs(a)    htons((a))
 #endif*/
 
-void MSG(const char *pcString, ...);
+void (MSG)(const char *pcString, ...); // print a message (also usable as a function pointer)
+void MSG_cached(EmbFmtCompiled *pCache, const char *pcString, ...); // print a message using a compiled format
 
-#define SPRINTF(str,n,fmt, ...) embfmt(str,n,fmt,__VA_ARGS__)
-#define SNPRINTF(str,n,fmt, ...) embfmt(str,n,fmt,__VA_ARGS__)
+// formats are compiled on the first use at each call site
+#define MSG(...) ({ static EmbFmtCompiled msgCache_; MSG_cached(&msgCache_, __VA_ARGS__); })
+
+#define SPRINTF(str,n,fmt, ...) EMBFMT_CACHED(str,n,fmt,__VA_ARGS__)
+#define SNPRINTF(str,n,fmt, ...) EMBFMT_CACHED(str,n,fmt,__VA_ARGS__)
 
 #define CLILOG(en, ...) { if (en) MSG(__VA_ARGS__); }
 
@@ -42,5 +46,10 @@ void MSG(const char *pcString, ...);
 #define LIMIT(x,l) (x < -l ? -l : (x > l ? l : x))
 
 #define ONOFF(str) ((!strcmp(str, "on")) ? 1 : ((!strcmp(str, "off")) ? 0 : -1))
+
+// cycle counter for latency measurements
+void dwt_init(); // enable the DWT cycle counter
+#define DWT_CYCCNT() (DWT->CYCCNT) // read the cycle counter
+uint32_t dwt_cycles_to_us(uint32_t cycles); // convert cycles to microseconds
  
 #endif /* SRC_UTILS_H_ */
@@ -44,6 +44,13 @@ defined in linker script */
 .word  _sbss
 /* end address for the .bss section. defined in linker script */
 .word  _ebss
+/* start address for the initialization values of the .itcm_text section.
+defined in linker script */
+.word  _siitcm_text
+/* start address for the .itcm_text section. defined in linker script */
+.word  _sitcm_text
+/* end address for the .itcm_text section. defined in linker script */
+.word  _eitcm_text
 /* stack used for SystemInit_ExtMemCtl; always internal RAM used */
 
 /**
@@ -89,6 +96,20 @@ LoopFillZerobss:
   cmp  r2, r3
   bcc  FillZerobss
 
+/* Copy the ITCM code from flash */
+  ldr  r0, =_sitcm_text
+  ldr  r1, =_eitcm_text
+  ldr  r2, =_siitcm_text
+  b  LoopCopyItcm
+
+CopyItcm:
+  ldr  r3, [r2], #4
+  str  r3, [r0], #4
+
+LoopCopyItcm:
+  cmp  r0, r1
+  bcc  CopyItcm
+
 /* Call the clock system intitialization function.*/
   bl  SystemInit   
 /* Call static constructors */